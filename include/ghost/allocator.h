@@ -18,6 +18,7 @@
 #include <ghost/image.h>
 
 #include <cstddef>
+#include <cstdlib>
 
 namespace ghost {
 
@@ -116,12 +117,51 @@ class Allocator {
 
   /// @brief Free host memory previously returned by @ref allocateHostMemory.
   ///
-  /// When an allocator is installed, Ghost always routes @c freeHostMemory
-  /// through it. Implementations that may receive pointers they did not
-  /// allocate are responsible for routing those to @c ::free internally.
+  /// When an allocator is installed, Ghost routes @c freeHostMemory through
+  /// it, except for blocks the device's own pinned pool handed out before the
+  /// allocator was installed. Implementations that may receive pointers they
+  /// did not allocate are responsible for routing those to @c ::free
+  /// internally.
   virtual void freeHostMemory(void* ptr) { (void)ptr; }
 };
 
+/// @brief Allocator that serves buffers and host memory from the C heap.
+///
+/// A heap pointer is a native buffer handle only on the CPU backend. Install
+/// this (or a @c CachingAllocator over it) on CPU devices only; on other
+/// backends it would hand the driver a pointer where it expects a
+/// @c cl_mem, @c CUdeviceptr, etc. Images are declined.
+class HeapAllocator : public Allocator {
+ public:
+  virtual void* allocateBuffer(size_t bytes,
+                               const BufferOptions& opts) override {
+    (void)opts;
+    return ::malloc(bytes);
+  }
+
+  virtual void freeBuffer(void* handle, size_t bytes) override {
+    (void)bytes;
+    ::free(handle);
+  }
+
+  virtual void* allocateMappedBuffer(size_t bytes,
+                                     const BufferOptions& opts) override {
+    (void)opts;
+    return ::malloc(bytes);
+  }
+
+  virtual void freeMappedBuffer(void* handle, size_t bytes) override {
+    (void)bytes;
+    ::free(handle);
+  }
+
+  virtual void* allocateHostMemory(size_t bytes) override {
+    return ::malloc(bytes);
+  }
+
+  virtual void freeHostMemory(void* ptr) override { ::free(ptr); }
+};
+
 }  // namespace ghost
 
 #endif
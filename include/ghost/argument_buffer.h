@@ -16,13 +16,100 @@
 #define GHOST_ARGUMENT_BUFFER_H
 
 #include <ghost/device.h>
+#include <ghost/event.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <mutex>
 #include <vector>
 
 namespace ghost {
 
+class ArgumentBuffer;
+
+/// @brief A ring of GPU memory that argument buffers are suballocated from.
+///
+/// Each allocation is a sub-buffer of one backing buffer, so per-frame
+/// uploads make no driver allocations in steady state. Space is handed out
+/// in order and reclaimed by fences: @c fence records an event on a stream,
+/// and everything allocated before it is reused once that event completes.
+/// Allocations made since the last completed fence are never overwritten,
+/// so the previous frame's arguments can stay in flight while the next
+/// frame's are written.
+///
+/// When the ring is full, a backing buffer of twice the size replaces it.
+/// Sub-buffers already handed out keep the old one alive. A ring that is
+/// never fenced therefore keeps growing; call @c fence once per frame.
+/// Fences are only meaningful for the stream they are recorded on, so use
+/// one ring per stream (or fence on a stream that waits for the others).
+/// Backends without sub-buffers fall back to a regular allocation per call.
+///
+/// Thread-safe.
+/// @code
+/// ghost::ArgumentRing ring(device, 64 * 1024);
+/// for (;;) {
+///   ab.set(0, time);
+///   ab.upload(ring, stream);
+///   fn(stream, launchArgs, ab);
+///   ring.fence(stream);
+/// }
+/// @endcode
+class ArgumentRing {
+ public:
+  /// @brief Construct a ring. The backing buffer is allocated on first use.
+  /// @param device The device to allocate from.
+  /// @param capacity Initial size of the backing buffer in bytes.
+  ArgumentRing(const Device& device, size_t capacity);
+
+  ArgumentRing(const ArgumentRing&) = delete;
+  ArgumentRing& operator=(const ArgumentRing&) = delete;
+
+  /// @brief Suballocate @p bytes from the ring.
+  ///
+  /// The offset is aligned to @c kDeviceBufferAlignment.
+  /// @param bytes Size of the sub-buffer in bytes.
+  /// @return A sub-buffer valid until a later fence completes and the ring
+  /// wraps around to it.
+  Buffer allocate(size_t bytes);
+
+  /// @brief Mark the end of a frame on @p stream.
+  ///
+  /// Space allocated before this call is reclaimed once the work enqueued
+  /// on @p stream so far has completed.
+  /// @param stream The stream consuming the allocations.
+  void fence(Stream& stream);
+
+  /// @brief Get the current size of the backing buffer in bytes.
+  size_t capacity() const;
+
+ private:
+  friend class ArgumentBuffer;
+
+  struct Fence {
+    Event event;
+    size_t end;
+  };
+
+  Buffer allocate(size_t bytes, uint64_t& epoch);
+  bool reserve(size_t bytes, size_t& offset);
+  void retire();
+
+  std::shared_ptr<implementation::Device> _device;
+  mutable std::mutex _mutex;
+  Buffer _buffer;
+  size_t _capacity;
+  size_t _alignment;
+  size_t _head;
+  size_t _tail;
+  bool _unsupported;
+  // Identifies the span between two fences. An argument buffer may keep its
+  // slice while the epoch it was allocated in is current.
+  uint64_t _epoch;
+  std::deque<Fence> _fences;
+};
+
 /// @brief A host-side buffer for packing kernel parameters into a struct.
 ///
 /// ArgumentBuffer allows grouping multiple scalar kernel arguments into a
@@ -47,6 +134,11 @@ namespace ghost {
 /// ab.upload(device, stream);
 /// fn(stream, launchArgs, ab);  // passed as buffer pointer
 /// @endcode
+///
+/// Writes since the last upload are tracked as a dirty byte range, so a
+/// repeated upload copies only what changed. Uploading to an
+/// @c ArgumentRing instead writes each change to a fresh slice, leaving the
+/// previous one untouched for dispatches still in flight.
 class ArgumentBuffer {
  public:
   /// @brief Construct an empty argument buffer.
@@ -69,17 +161,30 @@ class ArgumentBuffer {
   void set(size_t offset, const T& value) {
     ensureSize(offset + sizeof(T));
     memcpy(_data.data() + offset, &value, sizeof(T));
+    markDirty(offset, offset + sizeof(T));
   }
 
   /// @brief Upload the packed data to a GPU buffer.
   ///
   /// After calling this, the argument buffer will be passed as a GPU buffer
   /// argument rather than a by-value struct. Allocates a device buffer on
-  /// first call (or if the data has grown), then copies the host data.
+  /// first call (or if the data has grown) and copies all of the host data.
+  /// Later calls copy only the bytes written since the previous upload into
+  /// the same buffer, in stream order with earlier work.
   /// @param device The device to allocate the buffer on.
   /// @param stream The stream to enqueue the copy on.
   void upload(const Device& device, const Encoder& stream);
 
+  /// @brief Upload the packed data to a slice of @p ring.
+  ///
+  /// If nothing was written since the previous upload to @p ring and no
+  /// fence has been recorded since, the current slice is kept. Otherwise the
+  /// data is copied to a new slice, so a dispatch still reading the previous
+  /// one is unaffected.
+  /// @param ring The ring to suballocate from.
+  /// @param stream The stream to enqueue the copy on.
+  void upload(ArgumentRing& ring, const Encoder& stream);
+
   /// @brief Check whether this argument buffer should be passed as a struct.
   ///
   /// Returns @c true if upload() has not been called (or was reset),
@@ -97,8 +202,23 @@ class ArgumentBuffer {
  private:
   void ensureSize(size_t minSize);
 
+  void markDirty(size_t begin, size_t end) {
+    if (_dirtyBegin >= _dirtyEnd) {
+      _dirtyBegin = begin;
+      _dirtyEnd = end;
+    } else {
+      _dirtyBegin = std::min(_dirtyBegin, begin);
+      _dirtyEnd = std::max(_dirtyEnd, end);
+    }
+  }
+
   std::vector<uint8_t> _data;
   Buffer _gpuBuffer;
+  // Bytes written since the last upload; empty when begin >= end.
+  size_t _dirtyBegin;
+  size_t _dirtyEnd;
+  // Ring epoch _gpuBuffer was allocated in, or 0 if it is not a ring slice.
+  uint64_t _ringEpoch;
 };
 
 }  // namespace ghost
@@ -88,38 +88,77 @@ class Attribute {
 
  private:
   Type _type;
-  size_t _count;
-
-  union {
-    float f[4];
-    int32_t i[4];
-    uint32_t u[4];
-    bool b[4];
-  } _u;
-
-  union {
-    double f[4];
-    int64_t i[4];
-    uint64_t u[4];
-    bool b[4];
-  } _u64;
-
-  std::string _s;
-
-  // Strong references kept alive for the Attribute's lifetime. These are
-  // what make Buffer/Image/ArgumentBuffer Attributes safe to outlive the
-  // user's wrapper objects (e.g., when recording into a CommandBuffer and
-  // submitting later).
-  std::shared_ptr<implementation::Buffer> _bufferImpl;
-  std::shared_ptr<implementation::Image> _imageImpl;
-  std::shared_ptr<ArgumentBuffer> _argBuffer;
-  std::optional<SamplerDescription> _sampler;
+  uint32_t _count;
   // Read/write intent for resource args; unset means "defer to WriteDefault".
   std::optional<Access> _access;
+  std::optional<SamplerDescription> _sampler;
+
+  struct Values {
+    union {
+      float f[4];
+      int32_t i[4];
+      uint32_t u[4];
+      bool b[4];
+    } u32;
+
+    union {
+      double f[4];
+      int64_t i[4];
+      uint64_t u[4];
+      bool b[4];
+    } u64;
+  };
+
+  // An Attribute holds either numeric values or one owned object, never
+  // both, so they share storage. The active member follows _type: the
+  // string for Type_String, the strong reference for Type_Buffer,
+  // Type_Image and Type_ArgumentBuffer, and the values otherwise. The strong
+  // references are what make resource Attributes safe to outlive the user's
+  // wrapper objects (e.g., when recording into a CommandBuffer and
+  // submitting later).
+  union Payload {
+    Payload() : v{} {}
+    ~Payload() {}
+
+    Values v;
+    std::string s;
+    std::shared_ptr<implementation::Buffer> buffer;
+    std::shared_ptr<implementation::Image> image;
+    std::shared_ptr<ArgumentBuffer> argBuffer;
+  } _p;
+
+  bool ownsPayload() const {
+    return _type == Type_String || _type == Type_Buffer ||
+           _type == Type_Image || _type == Type_ArgumentBuffer;
+  }
+
+  /// @brief Destroy the owned string or reference and switch the payload
+  /// back to zeroed values. Called before storing values over it.
+  void releasePayload();
+  void copyPayload(const Attribute& other);
+  void movePayload(Attribute& other);
+
+  // Returned by accessors for an inactive type. Defined inline so kernels
+  // built as separate modules (CPU shared libraries) need no symbols from
+  // the library.
+  static const std::string& emptyString() {
+    static const std::string empty;
+    return empty;
+  }
+
+  static const std::shared_ptr<implementation::Buffer>& nullBuffer() {
+    static const std::shared_ptr<implementation::Buffer> null;
+    return null;
+  }
+
+  static const std::shared_ptr<implementation::Image>& nullImage() {
+    static const std::shared_ptr<implementation::Image> null;
+    return null;
+  }
 
   template <typename S, typename T>
   void setT(const S* v, S v0, S* s, T* t, size_t num) {
-    _count = num;
+    _count = (uint32_t)num;
     size_t idx;
     for (idx = 0; idx < num; idx++) {
       s[idx] = v[idx];
@@ -223,38 +262,45 @@ class Attribute {
   /// and stores the values in both 32-bit and 64-bit representations.
   /// @{
   void set(const float* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_Float;
-    setT(v, 0.f, _u.f, _u64.f, num);
+    setT(v, 0.f, _p.v.u32.f, _p.v.u64.f, num);
   }
 
   void set(const double* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_Float;
-    setT(v, 0.0, _u64.f, _u.f, num);
+    setT(v, 0.0, _p.v.u64.f, _p.v.u32.f, num);
   }
 
   void set(const int32_t* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_Int;
-    setT(v, (int32_t)0, _u.i, _u64.i, num);
+    setT(v, (int32_t)0, _p.v.u32.i, _p.v.u64.i, num);
   }
 
   void set(const uint32_t* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_UInt;
-    setT(v, (uint32_t)0, _u.u, _u64.u, num);
+    setT(v, (uint32_t)0, _p.v.u32.u, _p.v.u64.u, num);
   }
 
   void set(const int64_t* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_Int;
-    setT(v, (int64_t)0, _u64.i, _u.i, num);
+    setT(v, (int64_t)0, _p.v.u64.i, _p.v.u32.i, num);
   }
 
   void set(const uint64_t* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_UInt;
-    setT(v, (uint64_t)0, _u64.u, _u.u, num);
+    setT(v, (uint64_t)0, _p.v.u64.u, _p.v.u32.u, num);
   }
 
   void set(const bool* v, size_t num) {
+    if (ownsPayload()) releasePayload();
     _type = Type_Bool;
-    setT(v, false, _u.b, _u64.b, num);
+    setT(v, false, _p.v.u32.b, _p.v.u64.b, num);
   }
 
   /// @}
@@ -263,9 +309,10 @@ class Attribute {
   /// @param bytes Size of local (shared) memory in bytes.
   /// @return Reference to this attribute for chaining.
   Attribute& localMem(uint32_t bytes) {
+    if (ownsPayload()) releasePayload();
     _type = Type_LocalMem;
     _count = 1;
-    _u.u[0] = bytes;
+    _p.v.u32.u[0] = bytes;
     return *this;
   }
 
@@ -283,35 +330,37 @@ class Attribute {
   /// Retrieve the stored value in the requested type. The caller must ensure
   /// the attribute's type matches the accessor used.
   /// @{
-  const std::string& asString() const { return _s; }
+  const std::string& asString() const {
+    return _type == Type_String ? _p.s : emptyString();
+  }
 
-  const float asFloat() const { return _u.f[0]; }
+  const float asFloat() const { return _p.v.u32.f[0]; }
 
-  const float* floatArray() const { return _u.f; }
+  const float* floatArray() const { return _p.v.u32.f; }
 
-  const double asDouble() const { return _u64.f[0]; }
+  const double asDouble() const { return _p.v.u64.f[0]; }
 
-  const double* doubleArray() const { return _u64.f; }
+  const double* doubleArray() const { return _p.v.u64.f; }
 
-  const int32_t asInt() const { return _u.i[0]; }
+  const int32_t asInt() const { return _p.v.u32.i[0]; }
 
-  const int32_t* intArray() const { return _u.i; }
+  const int32_t* intArray() const { return _p.v.u32.i; }
 
-  const uint32_t asUInt() const { return _u.u[0]; }
+  const uint32_t asUInt() const { return _p.v.u32.u[0]; }
 
-  const uint32_t* uintArray() const { return _u.u; }
+  const uint32_t* uintArray() const { return _p.v.u32.u; }
 
-  const int64_t asInt64() const { return _u64.i[0]; }
+  const int64_t asInt64() const { return _p.v.u64.i[0]; }
 
-  const int64_t* int64Array() const { return _u64.i; }
+  const int64_t* int64Array() const { return _p.v.u64.i; }
 
-  const uint64_t asUInt64() const { return _u64.u[0]; }
+  const uint64_t asUInt64() const { return _p.v.u64.u[0]; }
 
-  const uint64_t* uint64Array() const { return _u64.u; }
+  const uint64_t* uint64Array() const { return _p.v.u64.u; }
 
-  const bool asBool() const { return _u.b[0]; }
+  const bool asBool() const { return _p.v.u32.b[0]; }
 
-  const bool* boolArray() const { return _u.b; }
+  const bool* boolArray() const { return _p.v.u32.b; }
 
   /// @brief Strong reference to the underlying buffer implementation.
   ///
@@ -319,12 +368,12 @@ class Attribute {
   /// instead of dereferencing the user's wrapper, which may have already
   /// been destroyed in deferred execution paths.
   const std::shared_ptr<implementation::Buffer>& bufferImpl() const {
-    return _bufferImpl;
+    return _type == Type_Buffer ? _p.buffer : nullBuffer();
   }
 
   /// @brief Strong reference to the underlying image implementation.
   const std::shared_ptr<implementation::Image>& imageImpl() const {
-    return _imageImpl;
+    return _type == Type_Image ? _p.image : nullImage();
   }
 
   /// @brief Snapshot of the ArgumentBuffer captured at construction time.
@@ -332,7 +381,9 @@ class Attribute {
   /// Returns a pointer to a heap-allocated copy of the user's
   /// ArgumentBuffer. The host-side data is snapshotted; the GPU buffer
   /// (if any) shares its impl with the original via shared_ptr.
-  ArgumentBuffer* argumentBuffer() const { return _argBuffer.get(); }
+  ArgumentBuffer* argumentBuffer() const {
+    return _type == Type_ArgumentBuffer ? _p.argBuffer.get() : nullptr;
+  }
 
   /// @brief Sampler description attached to an image attribute.
   ///
@@ -0,0 +1,209 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef GHOST_AUTOTUNER_H
+#define GHOST_AUTOTUNER_H
+
+#include <ghost/device.h>
+#include <ghost/function.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ghost {
+
+class KernelSource;
+
+/// @brief Picks the fastest local size and kernel variant for a dispatch, and
+/// remembers the choice per device.
+///
+/// @c tune benchmarks every candidate local size (see @c localSizeCandidates)
+/// of every variant with a representative argument set. Dispatches are timed
+/// with stream events, falling back to host time on backends without event
+/// timing. OpenCL streams need @c StreamOptions::profiling for event timing.
+/// The fastest candidate is stored under a key built from the device
+/// fingerprint that @c BinaryCache uses, the tuning name, the global size
+/// and the number of variants. Later @c tune calls with the same key return
+/// the stored choice without benchmarking.
+///
+/// Results can be saved to @c Options::path. They are then loaded at
+/// construction, so later runs start with tuned settings. Thread-safe;
+/// concurrent @c tune calls for the same key may both benchmark.
+///
+/// @code
+/// ghost::Autotuner::Options options;
+/// options.path = cacheDir / "autotune.txt";
+/// ghost::Autotuner tuner(options);
+/// auto best = tuner.tune(device, stream, "blur", fn,
+///                        LaunchArgs().global_size(width, height),
+///                        {outBuf, inBuf, radius});
+/// fn(best.launchArgs, stream)(outBuf, inBuf, radius);
+/// @endcode
+class Autotuner {
+ public:
+  /// @brief Tuning settings.
+  struct Options {
+    /// @brief File results are loaded from and saved to. Empty keeps them in
+    /// memory only.
+    std::filesystem::path path;
+    /// @brief Untimed dispatches per candidate before timing.
+    unsigned warmup = 1;
+    /// @brief Timed dispatches per candidate. The median time is used.
+    unsigned iterations = 5;
+    /// @brief Save to @c path after each benchmark.
+    bool autoSave = true;
+  };
+
+  /// @brief Outcome of tuning one dispatch.
+  struct Result {
+    /// @brief The caller's launch arguments with the chosen local size.
+    LaunchArgs launchArgs;
+    /// @brief Index of the chosen variant.
+    size_t variant = 0;
+    /// @brief Median time of the chosen candidate in seconds.
+    double seconds = 0;
+    /// @brief @c true if the result was stored by an earlier benchmark.
+    bool cached = false;
+  };
+
+  /// @brief Construct a tuner with default options.
+  Autotuner();
+
+  /// @brief Construct a tuner, loading results from @c options.path if set.
+  explicit Autotuner(const Options& options);
+
+  Autotuner(const Autotuner&) = delete;
+  Autotuner& operator=(const Autotuner&) = delete;
+
+  /// @brief Candidate launch configurations for @p function.
+  ///
+  /// Local sizes are multiples of @c kFunctionPreferredWorkMultiple up to
+  /// @c kFunctionMaxThreads, and no larger than needed to cover the global
+  /// size. Multi-dimensional candidates use power-of-two extents with at
+  /// least a quarter of the maximum threads per group. A kernel with a
+  /// @c kFunctionRequiredWorkSize has only that candidate. The local size in
+  /// @p launchArgs, if set, is always a candidate.
+  /// @param function The kernel.
+  /// @param launchArgs Launch arguments with the global size to tune for.
+  /// @return Copies of @p launchArgs with candidate local sizes.
+  static std::vector<LaunchArgs> localSizeCandidates(
+      const Function& function, const LaunchArgs& launchArgs);
+
+  /// @brief Tune the local size of one kernel.
+  ///
+  /// @param device The device @p function belongs to.
+  /// @param stream Stream to benchmark on.
+  /// @param name Name identifying the dispatch in stored results.
+  /// @param function The kernel.
+  /// @param launchArgs Launch arguments with the global size to tune for.
+  /// @param args Representative kernel arguments. Candidates run with them,
+  ///   so output buffers are overwritten.
+  /// @return The fastest configuration.
+  /// @throws std::runtime_error if no candidate could be dispatched.
+  Result tune(Device& device, Stream& stream, const std::string& name,
+              const Function& function, const LaunchArgs& launchArgs,
+              const std::vector<Attribute>& args);
+
+  /// @brief Tune the local size and choice among kernel variants.
+  ///
+  /// All variants must accept @p args.
+  /// @param device The device the variants belong to.
+  /// @param stream Stream to benchmark on.
+  /// @param name Name identifying the dispatch in stored results.
+  /// @param variants Interchangeable kernels.
+  /// @param launchArgs Launch arguments with the global size to tune for.
+  /// @param args Representative kernel arguments.
+  /// @return The fastest configuration; @c variant indexes @p variants.
+  /// @throws std::runtime_error if no candidate could be dispatched.
+  Result tune(Device& device, Stream& stream, const std::string& name,
+              const std::vector<Function>& variants,
+              const LaunchArgs& launchArgs,
+              const std::vector<Attribute>& args);
+
+  /// @brief Tune the local size and choice among @c KernelSource variants.
+  ///
+  /// Variants are compiled only if no result is stored yet.
+  /// @param device The device to compile and benchmark on.
+  /// @param stream Stream to benchmark on.
+  /// @param name Name identifying the dispatch in stored results.
+  /// @param source Source of the variants.
+  /// @param functionName The kernel function name.
+  /// @param variants Constant sets, as for @c KernelSource::getFunction.
+  /// @param launchArgs Launch arguments with the global size to tune for.
+  /// @param args Representative kernel arguments.
+  /// @return The fastest configuration; @c variant indexes @p variants.
+  /// @throws std::runtime_error if no candidate could be dispatched.
+  Result tune(
+      Device& device, Stream& stream, const std::string& name,
+      KernelSource& source, const std::string& functionName,
+      const std::vector<std::vector<std::pair<std::string, Attribute>>>&
+          variants,
+      const LaunchArgs& launchArgs, const std::vector<Attribute>& args);
+
+  /// @brief Look up a stored result without benchmarking.
+  /// @param device The device.
+  /// @param name Name passed to @c tune.
+  /// @param launchArgs Launch arguments with the tuned global size.
+  /// @param variantCount Number of variants passed to @c tune.
+  /// @param[out] result The stored result.
+  /// @return @c true if a result is stored.
+  bool find(const Device& device, const std::string& name,
+            const LaunchArgs& launchArgs, size_t variantCount,
+            Result& result) const;
+
+  /// @brief Write all results to @c Options::path.
+  ///
+  /// Results already in the file under other keys, for example from other
+  /// devices or processes, are kept.
+  /// @return @c false if @c path is empty or the file cannot be written.
+  bool save() const;
+
+  /// @brief Forget the results held in memory. Saved results stay in the
+  /// file at @c Options::path.
+  void clear();
+
+ private:
+  struct Entry {
+    size_t variant;
+    size_t dims;
+    size_t local[3];
+    double seconds;
+  };
+
+  static std::string makeKey(const Device& device, const std::string& name,
+                             const LaunchArgs& launchArgs,
+                             size_t variantCount);
+  static Result toResult(const Entry& entry, const LaunchArgs& launchArgs,
+                         bool cached);
+  double measure(Stream& stream, Function& function,
+                 const LaunchArgs& launchArgs,
+                 const std::vector<Attribute>& args) const;
+  static void readResults(const std::filesystem::path& path,
+                          std::unordered_map<std::string, Entry>& results);
+  void load();
+
+  Options _options;
+  mutable std::mutex _mutex;
+  std::unordered_map<std::string, Entry> _results;
+};
+
+}  // namespace ghost
+
+#endif
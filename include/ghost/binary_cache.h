@@ -15,9 +15,11 @@
 #ifndef GHOST_BINARY_CACHE_H
 #define GHOST_BINARY_CACHE_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -28,6 +30,7 @@ namespace implementation {
 class Device;
 }
 class Digest;
+class FileLock;
 
 /// @brief Number of hex characters of the digest to use in cache filenames.
 #define GHOST_DIGEST_FILENAME_LENGTH 32
@@ -38,6 +41,27 @@ class Digest;
 /// digest of the source data, compiler options, and device identity. Cached
 /// files are stored under @c cachePath and are subject to a time-to-live
 /// purge policy. Set the cachePath member to enable caching.
+///
+/// Entries that are loaded or saved are also kept in a process-wide,
+/// size-bounded in-memory tier keyed by the same digest and shared by every
+/// device and backend. A repeat load of a resident entry skips the file read
+/// and the integrity hash. The tier is only consulted when the cache is
+/// enabled, and is cleared by @c purgeBinaries.
+///
+/// Cache files are memory-mapped rather than read, so backends that can build
+/// a program from a pointer get the blobs without a heap copy.
+///
+/// Saves return immediately: a process-wide background thread writes each
+/// entry to a staging file in the cache directory and renames it into place,
+/// so a crash or a concurrent writer never leaves a torn entry behind. Call
+/// @c flush before shutdown to make sure pending entries reach the disk.
+///
+/// Processes sharing @c cachePath coordinate through per-entry lock files:
+/// the CUDA and OpenCL backends take @c lockEntry before compiling a missing
+/// entry, so when many processes start at once one of them compiles it and
+/// the rest wait for the published result instead of compiling it too. The
+/// DirectX and Vulkan backends do not lock: they cache the bytecode they are
+/// given without compiling it, so a miss costs no more than the wait would.
 class BinaryCache {
  protected:
   /// @brief Remove cached files older than @p days from @p subfolder.
@@ -47,9 +71,118 @@ class BinaryCache {
   static bool purgeFiles(const std::filesystem::path& subfolder, int days);
 
  public:
+  /// @brief Read-only view of a cached entry, one blob per device.
+  struct CachedBinaries {
+    /// @brief Start of each blob.
+    std::vector<const unsigned char*> binaries;
+    /// @brief Size of each blob in bytes.
+    std::vector<size_t> sizes;
+    /// @brief Keeps the memory behind @c binaries alive (a file mapping or a
+    /// resident copy). Release it once the backend has consumed the blobs.
+    std::shared_ptr<const void> owner;
+  };
+
+  /// @brief Binary cache counters (see @c getStats).
+  ///
+  /// A lookup counts as exactly one hit or one miss. Entries rejected on
+  /// the way to a miss are counted as well, by reason. A driver update
+  /// shows up as misses rather than mismatches, because the driver version
+  /// is part of every key.
+  struct Stats {
+    /// @brief Lookups served by any tier.
+    uint64_t hits = 0;
+    /// @brief Of @c hits, those served by the in-memory tier.
+    uint64_t memoryHits = 0;
+    /// @brief Lookups that found no usable entry.
+    uint64_t misses = 0;
+    /// @brief Entries rejected because they were built for another device.
+    uint64_t deviceMismatches = 0;
+    /// @brief Entries rejected as truncated, torn, or failing the content
+    /// hash.
+    uint64_t corruptEntries = 0;
+    /// @brief Bytes of entries mapped from cache files and packs.
+    uint64_t bytesRead = 0;
+    /// @brief Bytes of entries written to cache files.
+    uint64_t bytesWritten = 0;
+    /// @brief Entries that could not be written.
+    uint64_t writeFailures = 0;
+    /// @brief Library loads that compiled (everything the cache did not
+    /// serve, including backends that never use it).
+    uint64_t compiles = 0;
+    /// @brief Wall time of those loads, in seconds.
+    double compileSeconds = 0;
+    /// @brief Library loads served by the cache.
+    uint64_t cacheLoads = 0;
+    /// @brief Wall time of those loads, in seconds.
+    double cacheLoadSeconds = 0;
+  };
+
+  /// @brief Exclusive claim on one cache entry, shared across processes.
+  ///
+  /// Returned by @c lockEntry. A save of the claimed entry made while the
+  /// claim is held keeps the underlying lock until the entry file has been
+  /// published, so a waiter that takes the lock next always finds it.
+  class EntryLock {
+   public:
+    /// @brief Construct an empty claim.
+    EntryLock() = default;
+    EntryLock(const EntryLock&) = delete;
+    EntryLock& operator=(const EntryLock&) = delete;
+    /// @brief Take over the claim held by @p other.
+    EntryLock(EntryLock&& other) noexcept;
+    /// @brief Release the current claim and take over the one in @p other.
+    EntryLock& operator=(EntryLock&& other) noexcept;
+    /// @brief Release the claim if held.
+    ~EntryLock();
+
+    /// @brief Check whether the claim is held.
+    explicit operator bool() const { return _lock != nullptr; }
+
+    /// @brief Give up the claim. Pending saves of the entry keep the lock
+    /// until they are published.
+    void release();
+
+   private:
+    friend class BinaryCache;
+    std::string _path;
+    std::shared_ptr<FileLock> _lock;
+  };
+
   /// @brief Root directory for cached binary files.
   std::filesystem::path cachePath;
 
+  /// @brief Pack archive consulted before individual cache files, or empty.
+  ///
+  /// A pack is a single memory-mapped file holding many entries, typically
+  /// built at install time with @c packCache, so that a cold start with
+  /// hundreds of kernels opens one file instead of hundreds. Packs are read
+  /// only at run time; new entries are still saved under @c cachePath. A
+  /// pack alone (with an empty @c cachePath) also enables the cache.
+  std::filesystem::path packPath;
+
+  /// @brief Byte budget for the cache directory, or 0 for no limit.
+  ///
+  /// When set, entry sizes and last-use times are tracked in an append-only
+  /// index file in @c cachePath, and saves evict least recently used entries
+  /// once the directory exceeds the budget. @c purgeBinaries then works from
+  /// the index instead of listing the directory. Processes sharing a cache
+  /// directory should use the same setting.
+  uint64_t maxCacheBytes = 0;
+
+  /// @brief Verify the content hash of an entry when it is first mapped.
+  ///
+  /// The header, entry count and blob sizes are always checked against the
+  /// file length, which rejects truncated or torn files. The SHA-256 pass
+  /// over the blobs runs once per entry per process (resident entries are not
+  /// re-hashed); set this to @c false to skip it when the cache directory is
+  /// trusted and cold-start latency matters more.
+  bool verifyContents = true;
+
+  /// @brief Longest time in milliseconds @c lockEntry waits for another
+  /// process (or thread) that is compiling the same entry. 0 disables
+  /// locking.
+  unsigned lockTimeout = 30000;
+
   /// @brief Build a SHA-256 digest key for a compiled program.
   /// @param[in,out] d Digest object to update with the key material.
   /// @param dev The device whose identity is included in the digest.
@@ -62,14 +195,58 @@ class BinaryCache {
                          const CompilerOptions& options);
 
   /// @brief Check whether the binary cache is enabled.
-  /// @return @c true if @c cachePath is non-empty.
+  /// @return @c true if @c cachePath or @c packPath is non-empty.
   bool isEnabled() const;
 
   /// @brief Remove cached binaries older than @p days for the given device.
+  ///
+  /// Pending saves are flushed and the in-memory tier is cleared first. With
+  /// @c maxCacheBytes set, age is the last use recorded in the index and the
+  /// budget is enforced as well; otherwise file modification times are used.
   /// @param dev The device whose cache subfolder to purge.
   /// @param days Maximum age in days (default 30).
   void purgeBinaries(const implementation::Device& dev, int days) const;
 
+  /// @brief Total bytes of cached files tracked by the index.
+  /// @return 0 unless @c maxCacheBytes is set.
+  uint64_t getCacheSize() const;
+
+  /// @brief Set the byte budget of the process-wide in-memory tier.
+  ///
+  /// Least recently used entries are dropped when the budget is exceeded.
+  /// A limit of 0 disables the tier. The default is 64 MiB.
+  /// @param bytes Maximum bytes of binary data to keep resident.
+  static void setMemoryCacheLimit(size_t bytes);
+
+  /// @brief Get the byte budget of the in-memory tier.
+  static size_t getMemoryCacheLimit();
+
+  /// @brief Get the bytes of binary data currently held in memory.
+  static size_t getMemoryCacheSize();
+
+  /// @brief Drop every entry from the in-memory tier.
+  static void clearMemoryCache();
+
+  /// @brief Snapshot of the counters for the whole process.
+  static Stats getStats();
+
+  /// @brief Snapshot of the counters for work done on the calling thread.
+  ///
+  /// Useful to attribute a load to the cache: compare snapshots taken
+  /// before and after it. Writes are counted on the background writer
+  /// thread, so @c bytesWritten and @c writeFailures stay 0 here.
+  static Stats getThreadStats();
+
+  /// @brief Zero the process-wide counters. Per-thread counters are kept.
+  static void resetStats();
+
+  /// @brief Count one library load in @c Stats.
+  ///
+  /// Called by @c Device for every library it loads.
+  /// @param seconds Wall time of the load.
+  /// @param fromCache Whether the binary cache served the load.
+  static void recordLibraryLoad(double seconds, bool fromCache);
+
   /// @brief Load previously cached compiled binaries.
   /// @param[out] binaries Vector of binary blobs, one per device/program.
   /// @param[out] sizes Corresponding sizes of each binary blob.
@@ -83,7 +260,73 @@ class BinaryCache {
                     const implementation::Device& dev, const void* data,
                     size_t length, const CompilerOptions& options) const;
 
+  /// @brief Load previously cached compiled binaries without copying them.
+  /// @param[out] cached Views of the blobs and the owner that keeps them
+  /// mapped.
+  /// @param dev The device to look up cached binaries for.
+  /// @param data Pointer to the source data used to compute the cache key.
+  /// @param length Length of @p data in bytes.
+  /// @param options Compiler options used to compute the cache key.
+  /// @return @c true if cached binaries were found and validated.
+  bool loadBinaries(CachedBinaries& cached, const implementation::Device& dev,
+                    const void* data, size_t length,
+                    const CompilerOptions& options) const;
+
+  /// @brief Claim an entry before compiling it.
+  ///
+  /// Waits up to @c lockTimeout for any other holder to finish. Whoever held
+  /// the claim before has published its entry by the time this returns, so
+  /// callers should try @c loadBinaries again once the claim is held, and
+  /// compile and save only on a second miss. A claim that times out is
+  /// returned empty; compiling anyway is safe, since saves replace entries
+  /// atomically.
+  /// @param dev The device the entry is compiled for.
+  /// @param data Pointer to the source data used to compute the cache key.
+  /// @param length Length of @p data in bytes.
+  /// @param options Compiler options used to compute the cache key.
+  /// @return The held claim, or an empty one if @c cachePath is empty,
+  /// locking is disabled, or the wait timed out.
+  EntryLock lockEntry(const implementation::Device& dev, const void* data,
+                      size_t length, const CompilerOptions& options) const;
+
+  /// @brief Look an entry up again once @c lockEntry has claimed it.
+  ///
+  /// Counts as part of the @c loadBinaries miss before the claim: a second
+  /// miss is not counted, and a hit replaces the earlier miss.
+  /// @param[out] cached Views of the blobs and the owner that keeps them
+  /// mapped.
+  /// @param dev The device to look up cached binaries for.
+  /// @param data Pointer to the source data used to compute the cache key.
+  /// @param length Length of @p data in bytes.
+  /// @param options Compiler options used to compute the cache key.
+  /// @return @c true if cached binaries were found and validated.
+  bool reloadBinaries(CachedBinaries& cached, const implementation::Device& dev,
+                      const void* data, size_t length,
+                      const CompilerOptions& options) const;
+
+  /// @brief Add the entries of a cache directory to a pack archive.
+  ///
+  /// Creates @p pack if it does not exist. Otherwise the archive is
+  /// rewritten with its entries plus the new ones; entries already in the
+  /// pack are skipped. Every update is staged in a copy and renamed over
+  /// @p pack, so readers and failed writes never see a torn archive.
+  /// @param pack Archive to create or extend.
+  /// @param dir Cache directory whose entries are added.
+  /// @return Number of entries added, excluding files that vanished or could
+  /// not be read, or 0 if the archive could not be written.
+  static size_t packCache(const std::filesystem::path& pack,
+                          const std::filesystem::path& dir);
+
+  /// @brief Block until every pending save has been written to disk.
+  ///
+  /// Entries queued by any @c BinaryCache in the process are flushed. Queued
+  /// entries are also written out at process exit.
+  static void flush();
+
   /// @brief Save compiled binaries to the cache.
+  ///
+  /// The entry is available to @c loadBinaries in this process immediately;
+  /// the file is written asynchronously (see @c flush).
   /// @param dev The device the binaries were compiled for.
   /// @param binaries Vector of raw binary pointers.
   /// @param sizes Corresponding sizes of each binary.
@@ -94,6 +337,11 @@ class BinaryCache {
                     const std::vector<unsigned char*>& binaries,
                     const std::vector<size_t>& sizes, const void* data,
                     size_t length, const CompilerOptions& options) const;
+
+ private:
+  bool lookup(CachedBinaries& cached, const implementation::Device& dev,
+              const void* data, size_t length, const CompilerOptions& options,
+              bool countMiss) const;
 };
 
 }  // namespace ghost
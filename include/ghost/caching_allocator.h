@@ -0,0 +1,166 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#ifndef GHOST_CACHING_ALLOCATOR_H
+#define GHOST_CACHING_ALLOCATOR_H
+
+#include <ghost/allocator.h>
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ghost {
+
+/// @brief Ready-made pooling @c Allocator that recycles freed blocks.
+///
+/// Requests are rounded up to a size class (four classes per power of two, so
+/// at most 25% slack) and freed blocks are parked in a per-class bucket instead
+/// of being released. A later request for the same class, kind and
+/// @c BufferOptions reuses a parked block without touching the upstream
+/// allocator. Ghost drains device work that references a resource before
+/// freeing it (see @c Allocator), so a parked block may be handed out again
+/// immediately, in stream order with the work that released it.
+///
+/// Blocks come from an @em upstream allocator that produces native handles
+/// (see the table in @c Allocator); the caching allocator supplies
+/// bucketing, limits and statistics on top of it. Pass
+/// @c Device::nativeAllocator() as the upstream to recycle device buffers on
+/// any backend:
+///
+/// @code
+/// device.setAllocator(
+///     std::make_shared<ghost::CachingAllocator>(device.nativeAllocator()));
+/// @endcode
+///
+/// With no upstream, only host memory is cached, from the host heap, and
+/// buffer requests are declined so the device allocates them itself. Images
+/// are passed through to the upstream uncached.
+///
+/// Install with @c Device::setAllocator. Thread-safe.
+class CachingAllocator : public Allocator {
+ public:
+  /// @brief Tuning for a @c CachingAllocator.
+  struct Options {
+    /// @brief High-water limit on parked (idle) bytes. When a free would
+    /// exceed it, the least recently freed blocks are released upstream.
+    size_t maxCachedBytes = size_t(256) << 20;
+    /// @brief Requests larger than this bypass the cache entirely.
+    size_t maxBlockBytes = size_t(1) << 30;
+  };
+
+  /// @brief Allocation counters. All byte counts are in size-class bytes.
+  struct Stats {
+    /// @brief Requests served from a parked block.
+    size_t hits = 0;
+    /// @brief Requests that had to allocate upstream.
+    size_t misses = 0;
+    /// @brief Blocks returned to the upstream allocator.
+    size_t releases = 0;
+    /// @brief Bytes currently handed out to Ghost.
+    size_t allocatedBytes = 0;
+    /// @brief Bytes currently parked in buckets.
+    size_t cachedBytes = 0;
+    /// @brief High-water mark of @c allocatedBytes + @c cachedBytes.
+    size_t peakBytes = 0;
+  };
+
+  /// @brief Construct a caching allocator with default limits.
+  /// @param upstream Allocator that creates native handles on a miss, or
+  /// null to cache host memory only.
+  explicit CachingAllocator(std::shared_ptr<Allocator> upstream = nullptr);
+
+  /// @brief Construct a caching allocator.
+  /// @param upstream Allocator that creates native handles on a miss, or
+  /// null to cache host memory only.
+  /// @param options Cache limits.
+  CachingAllocator(std::shared_ptr<Allocator> upstream,
+                   const Options& options);
+
+  CachingAllocator(const CachingAllocator&) = delete;
+  CachingAllocator& operator=(const CachingAllocator&) = delete;
+
+  /// @brief Release every parked block upstream.
+  ~CachingAllocator() override;
+
+  virtual void* allocateBuffer(size_t bytes,
+                               const BufferOptions& opts) override;
+  virtual void freeBuffer(void* handle, size_t bytes) override;
+  virtual void* allocateMappedBuffer(size_t bytes,
+                                     const BufferOptions& opts) override;
+  virtual void freeMappedBuffer(void* handle, size_t bytes) override;
+  virtual void* allocateImage(const ImageDescription& descr) override;
+  virtual void freeImage(void* handle, const ImageDescription& descr) override;
+  virtual void* allocateHostMemory(size_t bytes) override;
+  virtual void freeHostMemory(void* ptr) override;
+
+  /// @brief Release parked blocks upstream until at most @p keepBytes remain.
+  ///
+  /// Least recently freed blocks go first. Blocks handed out to Ghost are
+  /// unaffected.
+  /// @param keepBytes Parked bytes to retain.
+  void trim(size_t keepBytes = 0);
+
+  /// @brief Snapshot of the allocation counters.
+  Stats stats() const;
+
+  /// @brief Change the high-water limit, trimming if the cache is over it.
+  void setMaxCachedBytes(size_t bytes);
+
+  /// @brief Round @p bytes up to its size class.
+  static size_t sizeClass(size_t bytes);
+
+ private:
+  enum class Kind { Buffer, MappedBuffer, Host };
+
+  struct Key {
+    Kind kind;
+    Access access;
+    AllocHint hint;
+    size_t bytes;
+
+    bool operator<(const Key& rhs) const;
+  };
+
+  struct Parked {
+    Key key;
+    void* handle;
+  };
+
+  typedef std::list<Parked> ParkedList;
+
+  void* allocate(Kind kind, size_t bytes, const BufferOptions& opts);
+  bool release(Kind kind, void* handle);
+  void* allocateUpstream(const Key& key, const BufferOptions& opts);
+  void freeUpstream(const Key& key, void* handle);
+  void trimLocked(size_t keepBytes, std::vector<Parked>& evicted);
+  void notePeak();
+
+  std::shared_ptr<Allocator> _upstream;
+  Options _options;
+  mutable std::mutex _mutex;
+  // Parked blocks, most recently freed at the front.
+  ParkedList _lru;
+  std::map<Key, std::vector<ParkedList::iterator>> _buckets;
+  std::unordered_map<void*, Key> _live;
+  Stats _stats;
+};
+
+}  // namespace ghost
+
+#endif
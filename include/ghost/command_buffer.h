@@ -51,6 +51,14 @@ class CommandBuffer : public Encoder {
                         const LaunchArgs& launchArgs,
                         const std::vector<Attribute>& args) = 0;
 
+  /// @brief Dispatch overload that takes ownership of @p args. Recording
+  /// command buffers override it to store the vector without copying it.
+  virtual void dispatch(std::shared_ptr<Function> function,
+                        const LaunchArgs& launchArgs,
+                        std::vector<Attribute>&& args) {
+    dispatch(function, launchArgs, args);
+  }
+
   virtual void dispatchIndirect(std::shared_ptr<Function> function,
                                 std::shared_ptr<Buffer> indirectBuffer,
                                 size_t indirectOffset,
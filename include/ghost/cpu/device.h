@@ -15,6 +15,7 @@
 #ifndef GHOST_CPU_DEVICE_H
 #define GHOST_CPU_DEVICE_H
 
+#include <ghost/cpu/impl_device.h>
 #include <ghost/cpu/impl_function.h>
 #include <ghost/device.h>
 #include <ghost/gpu_info.h>
@@ -48,6 +49,43 @@ class DeviceCPU : public Device {
 
   static std::vector<GpuInfo> enumerateDevices();
 
+  /// @brief Native handle type for cross-process shared buffers.
+  ///
+  /// A file descriptor on Unix systems and a file-mapping @c HANDLE on
+  /// Windows.
+  typedef implementation::SharedMemoryBufferCPU::Handle SharedMemoryHandle;
+
+  /// @brief Allocate a buffer that can be mapped by another process.
+  ///
+  /// The memory is backed by an anonymous shared-memory object (memfd on
+  /// Linux, @c shm_open elsewhere on Unix, a pagefile-backed mapping on
+  /// Windows) instead of the heap. Kernels on this device use it like any
+  /// other buffer.
+  /// @param bytes Size of the buffer in bytes.
+  /// @return The shared buffer.
+  Buffer allocateSharedMemoryBuffer(size_t bytes) const;
+
+  /// @brief Export a handle to a buffer from @c allocateSharedMemoryBuffer
+  /// or @c importSharedMemoryBuffer.
+  ///
+  /// The returned handle is a duplicate owned by the caller: pass it to the
+  /// other process (e.g. over a Unix domain socket or by inheritance) and
+  /// close it locally once transferred.
+  /// @param buffer A shared-memory buffer on this device.
+  /// @return A new handle referring to the same memory.
+  SharedMemoryHandle exportSharedMemoryBuffer(const Buffer& buffer) const;
+
+  /// @brief Map a buffer exported by another process.
+  ///
+  /// The memory is mapped, not copied: writes from either process are
+  /// visible to the other. Ghost takes ownership of @p handle and closes it
+  /// when the returned buffer is destroyed.
+  /// @param handle A handle from @c exportSharedMemoryBuffer.
+  /// @param bytes Size of the buffer in bytes.
+  /// @return A buffer aliasing the exporter's memory.
+  Buffer importSharedMemoryBuffer(SharedMemoryHandle handle,
+                                  size_t bytes) const;
+
   /// @brief Create a library from inline C++ function pointers.
   ///
   /// This allows registering native C++ functions as CPU kernels without
@@ -82,6 +82,11 @@ class BufferCPU : public Buffer {
   virtual void fill(const ghost::Encoder& s, size_t offset, size_t size,
                     const void* pattern, size_t patternSize) override;
 
+  virtual void readFromFile(const ghost::Stream& s, FileWrapper& file,
+                            size_t dstOffset, size_t bytes) override;
+  virtual void writeToFile(const ghost::Stream& s, FileWrapper& file,
+                           size_t srcOffset, size_t bytes) const override;
+
   virtual std::shared_ptr<Buffer> createSubBuffer(
       const std::shared_ptr<Buffer>& self, size_t offset, size_t size) override;
 };
@@ -97,6 +102,32 @@ class MappedBufferCPU : public BufferCPU {
   virtual void unmap(const ghost::Encoder& s) override;
 };
 
+/// @brief Buffer backed by an anonymous shared-memory object.
+///
+/// The mapping lives in a memfd (Linux), a POSIX shared-memory object
+/// (other Unix systems) or a pagefile-backed file mapping (Windows), so the
+/// same pages can be mapped by another process from an exported handle.
+class SharedMemoryBufferCPU : public BufferCPU {
+ public:
+#if defined(_WIN32)
+  typedef void* Handle;
+#else
+  typedef int Handle;
+#endif
+
+  Handle handle;
+
+  SharedMemoryBufferCPU(const DeviceCPU& dev, size_t bytes);
+  SharedMemoryBufferCPU(Handle imported, size_t bytes);
+  ~SharedMemoryBufferCPU();
+
+  /// @brief Duplicate the underlying handle for transfer to another process.
+  Handle exportHandle() const;
+
+ private:
+  void map();
+};
+
 class SubBufferCPU : public BufferCPU {
  public:
   std::shared_ptr<Buffer> _parent;
@@ -150,6 +181,7 @@ class DeviceCPU : public Device {
   DeviceCPU(const SharedContext& share);
   DeviceCPU(const GpuInfo& info);
   DeviceCPU(std::shared_ptr<ghost::ThreadPool> pool);
+  ~DeviceCPU() override;
 
   std::shared_ptr<ghost::ThreadPool> threadPool() const override {
     return pool;
@@ -192,6 +224,13 @@ class DeviceCPU : public Device {
   virtual Attribute getAttribute(DeviceAttributeId what) const override;
 
   static size_t getNumberOfCores();
+
+ protected:
+  /// @brief Native buffer handles are heap pointers, as BufferCPU allocates.
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const override;
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const override;
 };
 }  // namespace implementation
 }  // namespace ghost
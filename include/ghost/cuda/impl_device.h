@@ -463,6 +463,18 @@ class DeviceCUDA : public Device {
   void reapDeferredTextures(bool waitAll = false) const;
 
  protected:
+  /// @brief Staging-pool blocks are page-locked via @c cuMemAllocHost.
+  virtual void* allocatePinnedMemory(size_t bytes) const override;
+  virtual void freePinnedMemory(void* ptr) const override;
+
+  /// @brief Native buffer handles are @c cuMemAlloc device pointers, or for
+  /// mapped buffers @c cuMemHostAlloc host pointers, as BufferCUDA and
+  /// MappedBufferCUDA allocate.
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const override;
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const override;
+
   struct PendingTextureRelease {
     std::vector<TexturePtr> textures;
     std::vector<cu::ptr<CUevent>> events;
@@ -84,7 +84,7 @@ class LibraryCUDA : public Library {
  private:
   std::vector<uint8_t> _binaryData;
   void loadFromCache(const void* data, size_t length,
-                     const CompilerOptions& options);
+                     const CompilerOptions& options, bool claimed = false);
   void saveToCache(void* binary, size_t binarySize, const void* data,
                    size_t length, const CompilerOptions& options) const;
   const DeviceCUDA& _dev;
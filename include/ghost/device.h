@@ -25,6 +25,8 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <memory>
 #include <optional>
 #include <stdexcept>
@@ -156,6 +158,35 @@ class Buffer {
   void fill(const Encoder& s, size_t offset, size_t size, const void* pattern,
             size_t patternSize);
 
+  /// @brief Load a region of a file into this buffer.
+  ///
+  /// The file is read in chunks through a small ring of host staging
+  /// buffers, so disk reads overlap the uploads of earlier chunks instead of
+  /// staging the whole region in host memory first. The uploads are ordered
+  /// on @p s; use @c s.sync() or @c s.record() to wait for completion.
+  /// @param s The stream to enqueue the uploads on.
+  /// @param path File to read.
+  /// @param dstOffset Byte offset into this buffer.
+  /// @param bytes Number of bytes to read.
+  /// @param fileOffset Byte offset into the file.
+  /// @throws std::runtime_error if the file cannot be opened or is too short.
+  void readFromFile(const Stream& s, const std::filesystem::path& path,
+                    size_t dstOffset, size_t bytes, uint64_t fileOffset = 0);
+
+  /// @brief Write a region of this buffer to a file.
+  ///
+  /// The file is created or truncated. Readbacks are issued a few chunks
+  /// ahead of the disk writes so the two overlap. Work already enqueued on
+  /// @p s is ordered before the readback; the file is complete when the
+  /// call returns.
+  /// @param s The stream to enqueue the readbacks on.
+  /// @param path File to write.
+  /// @param srcOffset Byte offset into this buffer.
+  /// @param bytes Number of bytes to write.
+  /// @throws std::runtime_error if the file cannot be created or written.
+  void writeToFile(const Stream& s, const std::filesystem::path& path,
+                   size_t srcOffset, size_t bytes) const;
+
   /// @brief Create a sub-buffer view into this buffer.
   ///
   /// The returned buffer shares memory with this buffer, starting at
@@ -312,6 +343,24 @@ class Image {
   std::shared_ptr<implementation::Image> _impl;
 };
 
+/// @brief One program for Device::precompile().
+///
+/// Set @c source to compile from text, or @c binary to load pre-compiled
+/// data; @c binary takes precedence when both are set.
+struct PrecompileEntry {
+  /// @brief Program source text, as for Device::loadLibraryFromText().
+  std::string source;
+  /// @brief Pre-compiled program, as for Device::loadLibraryFromData().
+  std::vector<unsigned char> binary;
+  /// @brief Compiler options.
+  CompilerOptions options;
+  /// @brief Functions to look up once the program is loaded, so their
+  /// pipelines are created on the worker too.
+  std::vector<std::string> functions;
+  /// @brief Retain the binary for Library::getBinary().
+  bool retainBinary = false;
+};
+
 /// @brief A GPU device providing resource allocation, kernel compilation, and
 /// stream management.
 ///
@@ -425,6 +474,26 @@ class Device {
       const CompilerOptions& options = CompilerOptions(),
       bool retainBinary = false) const;
 
+  /// @brief Compile or load a batch of programs concurrently.
+  ///
+  /// Each entry is compiled (or loaded from the binary cache) on a worker
+  /// thread, so warm-up takes about as long as the slowest program rather
+  /// than the sum of all of them. Finished libraries are parked in an
+  /// in-process table: the next loadLibraryFromText() or
+  /// loadLibraryFromData() call with the same inputs takes the parked
+  /// library (waiting for it if it is still building) instead of compiling
+  /// again. Each parked library is handed out once. Errors are reported
+  /// through the futures and rethrown by that call.
+  ///
+  /// The workers belong to the device. Destroying it fails builds that have
+  /// not started and waits for running ones.
+  /// @param manifest Programs to build.
+  /// @param workers Maximum concurrent builds; 0 uses the hardware
+  /// concurrency.
+  /// @return One future per manifest entry, in order.
+  std::vector<std::shared_future<Library>> precompile(
+      const std::vector<PrecompileEntry>& manifest, size_t workers = 0) const;
+
   /// @brief Create a new stream for enqueuing operations.
   /// @param options Optional stream creation flags (profiling, event chaining).
   /// @return A new Stream.
@@ -447,6 +516,12 @@ class Device {
   void setMemoryPoolSize(size_t bytes) const;
 
   /// @brief Allocate page-locked host memory suitable for fast DMA transfers.
+  ///
+  /// Without an installed @c Allocator, requests are served from a
+  /// device-owned staging pool: sizes are rounded to a size class and freed
+  /// blocks are recycled, so the pin cost is paid once per block rather than
+  /// per transfer. CUDA and OpenCL pool pinned memory; other backends pool
+  /// host-heap blocks.
   /// @param bytes Number of bytes to allocate.
   /// @return Pointer to the allocated memory.
   void* allocateHostMemory(size_t bytes) const;
@@ -455,6 +530,23 @@ class Device {
   /// @param ptr Pointer to the memory to free.
   void freeHostMemory(void* ptr) const;
 
+  /// @brief Allocate staging memory as an owned @c HostBytes.
+  ///
+  /// The block comes from @c allocateHostMemory and returns to the staging
+  /// pool when the last reference drops, which on backends that keep
+  /// transfers async is after the DMA completes. Pass it straight to
+  /// @c Buffer::copy / @c Buffer::copyTo.
+  /// @param bytes Number of bytes to allocate.
+  /// @return Owned host bytes.
+  HostBytes allocateHostBytes(size_t bytes) const;
+
+  /// @brief Release every parked staging-pool block.
+  void trimHostMemoryPool() const;
+
+  /// @brief Set the high-water limit on idle staging-pool bytes (default
+  /// 64 MiB). Blocks freed beyond it are released immediately.
+  void setHostMemoryPoolLimit(size_t bytes) const;
+
   /// @brief Install a host-supplied @c Allocator on this device.
   ///
   /// Buffers, mapped buffers, images, and host memory allocated after this
@@ -472,6 +564,20 @@ class Device {
   /// @brief Get the installed allocator, or @c nullptr.
   Allocator* allocator() const;
 
+  /// @brief Get an allocator that creates buffers the way this device does
+  /// without one, returning native handles.
+  ///
+  /// Use it as the upstream of a @c CachingAllocator so device buffers are
+  /// recycled:
+  /// @code
+  /// device.setAllocator(
+  ///     std::make_shared<ghost::CachingAllocator>(device.nativeAllocator()));
+  /// @endcode
+  /// Images are declined, and host memory comes from the heap. Once the
+  /// device is destroyed the allocator declines every request; blocks an
+  /// installed @c CachingAllocator had parked are released at that point.
+  std::shared_ptr<Allocator> nativeAllocator() const;
+
   /// @brief Allocate a GPU buffer.
   /// @param bytes Size in bytes.
   /// @param opts Allocation options (access mode and lifetime hint). Implicitly
@@ -479,6 +585,30 @@ class Device {
   /// @return The allocated Buffer.
   Buffer allocateBuffer(size_t bytes, BufferOptions opts = {}) const;
 
+  /// @brief Enable the transient arena for @c AllocHint::Transient buffers.
+  ///
+  /// When non-zero, @c allocateBuffer with @c AllocHint::Transient
+  /// bump-allocates a sub-buffer out of backing blocks of at least
+  /// @p blockBytes instead of making a driver allocation. The space is only
+  /// recycled by @c resetTransientArena. Blocks are read-write: requests with
+  /// another @c Access, and backends without sub-buffer support, fall back
+  /// to regular allocations. Safe to call concurrently with allocations.
+  /// @param blockBytes Backing block size in bytes, or 0 to disable (the
+  /// default). Changing the size releases the current blocks.
+  void setTransientArenaSize(size_t blockBytes) const;
+
+  /// @brief Get the transient arena block size, or 0 if disabled.
+  size_t getTransientArenaSize() const;
+
+  /// @brief Recycle all transient arena space at a frame boundary.
+  ///
+  /// Every buffer previously allocated from the arena becomes invalid: its
+  /// memory is handed out again by later transient allocations. Call this
+  /// only once device work using those buffers has completed (e.g. after
+  /// @c stream.sync() at the end of a frame). Backing blocks are kept, so a
+  /// steady-state frame makes no driver allocations.
+  void resetTransientArena() const;
+
   /// @brief Allocate a memory-mapped GPU buffer.
   /// @param bytes Size in bytes.
   /// @param opts Allocation options (access mode and lifetime hint).
@@ -570,6 +700,10 @@ class Device {
   std::shared_ptr<implementation::Device>& impl() { return _impl; }
 
  private:
+  // Run a library load, recording its duration and whether the binary cache
+  // served it on the library and in BinaryCache::Stats.
+  static Library timedLoad(const std::function<Library()>& load);
+
   std::shared_ptr<implementation::Device> _impl;
   Stream _stream;
 };
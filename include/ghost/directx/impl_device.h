@@ -319,6 +319,8 @@ class MappedBufferDirectX : public BufferDirectX {
 
   MappedBufferDirectX(const DeviceDirectX& dev_, size_t bytes,
                       const BufferOptions& opts = {});
+  /// Adopts an UPLOAD or READBACK buffer (e.g. from an Allocator) and maps it.
+  MappedBufferDirectX(ComPtr<ID3D12Resource> res, size_t bytes);
   ~MappedBufferDirectX();
 
   virtual void* map(const ghost::Encoder& s, Access access,
@@ -412,6 +414,12 @@ class DeviceDirectX : public Device {
       D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE,
       D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON) const;
 
+ protected:
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const override;
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const override;
+
  private:
   ComPtr<IDXGIFactory4> _factory;
   ComPtr<IDXGIAdapter1> _adapter;
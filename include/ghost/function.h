@@ -20,6 +20,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 
 namespace ghost {
 
@@ -183,6 +184,77 @@ class LaunchArgs {
   }
 };
 
+class Function;
+
+/// @brief A kernel launch with its configuration and arguments bound once,
+/// for enqueueing repeatedly.
+///
+/// Created by @c Function::bind. The arguments are converted when binding,
+/// and backends that can precompute their native argument state (OpenCL) do
+/// so then. Later enqueues reuse that state, and @c set re-translates only the
+/// argument it replaces. Other backends re-translate every argument on each
+/// enqueue, as a plain dispatch does.
+///
+/// Copies share the bound state. A Dispatch must not be used from several
+/// threads at once.
+/// @code
+/// ghost::Dispatch d = fn.bind(LaunchArgs().global_size(n), out, in, 1.0f);
+/// for (float gain : gains) {
+///   d.set(2, gain);
+///   d.enqueue(stream);
+/// }
+/// @endcode
+class Dispatch {
+ public:
+  /// @brief Construct an empty dispatch; @c valid() returns @c false.
+  Dispatch() {}
+
+  /// @brief Bind @p function to a launch configuration and arguments.
+  /// Prefer @c Function::bind.
+  Dispatch(const Function& function, const LaunchArgs& launchArgs,
+           std::vector<Attribute> args);
+
+  /// @brief Check whether this dispatch was bound to a function.
+  bool valid() const { return _state != nullptr; }
+
+  /// @brief The bound launch configuration.
+  const LaunchArgs& launchArgs() const;
+
+  /// @brief Replace the launch configuration.
+  /// @return @c *this for chaining.
+  Dispatch& launchArgs(const LaunchArgs& launchArgs);
+
+  /// @brief Number of bound arguments.
+  size_t size() const;
+
+  /// @brief The bound argument at @p index.
+  const Attribute& arg(size_t index) const;
+
+  /// @brief Replace the argument at @p index in place.
+  ///
+  /// Write intent set by @c writes is applied to the new value.
+  /// @return @c *this for chaining.
+  /// @throws std::out_of_range if @p index is not a bound argument.
+  /// @throws std::invalid_argument if @p value has a different type than the
+  ///   bound argument.
+  Dispatch& set(size_t index, const Attribute& value);
+
+  /// @brief Declare that the first @p n Buffer/Image arguments are written,
+  /// as @c Function::BoundFunction::writes does.
+  /// @return @c *this for chaining.
+  Dispatch& writes(size_t n);
+
+  /// @brief Launch the kernel on @p encoder with the bound arguments.
+  ///
+  /// Recording into a CommandBuffer copies the current arguments, so later
+  /// @c set calls do not change recorded dispatches.
+  void enqueue(const Encoder& encoder);
+
+ private:
+  struct State;
+  std::shared_ptr<State> _state;
+};
+
 /// @brief A compiled GPU kernel function that can be dispatched on a stream.
 ///
 /// Functions are obtained from a Library via lookupFunction(). They are
@@ -237,26 +309,16 @@ class Function {
     template <typename... ARGS>
     void operator()(ARGS&&... args) {
       std::vector<Attribute> attrArgs;
+      attrArgs.reserve(sizeof...(ARGS));
       implementation::Function::addArgs(attrArgs, std::forward<ARGS>(args)...);
       if (_writeCount) {
-        // Stamp the first n Buffer/Image args Write and the rest Read, leaving
-        // any arg the caller already marked (ghost::write/read) untouched.
-        size_t resourceIndex = 0;
-        for (auto& a : attrArgs) {
-          if (a.type() != Attribute::Type_Buffer &&
-              a.type() != Attribute::Type_Image)
-            continue;
-          if (!a.access())
-            a.access(resourceIndex < *_writeCount ? Access::WriteOnly
-                                                  : Access::ReadOnly);
-          ++resourceIndex;
-        }
+        implementation::Function::stampWrites(attrArgs, *_writeCount);
       }
-      dispatch(attrArgs);
+      dispatch(std::move(attrArgs));
     }
 
    private:
-    void dispatch(const std::vector<Attribute>& args);
+    void dispatch(std::vector<Attribute>&& args);
 
     std::shared_ptr<implementation::Function> _impl;
     LaunchArgs _launchArgs;
@@ -272,6 +334,25 @@ class Function {
     return BoundFunction(_impl, launchArgs, s);
   }
 
+  /// @brief Bind a launch configuration and kernel arguments for repeated
+  /// launches.
+  ///
+  /// The arguments are the same as for a BoundFunction call:
+  /// @code
+  /// auto d = fn.bind(LaunchArgs().global_size(1024), buffer, 42.0f);
+  /// d.enqueue(stream);
+  /// @endcode
+  /// @param launchArgs Global and local work size configuration.
+  /// @param args Kernel arguments.
+  /// @return A Dispatch that launches the kernel each time it is enqueued.
+  template <typename... ARGS>
+  Dispatch bind(const LaunchArgs& launchArgs, ARGS&&... args) const {
+    std::vector<Attribute> attrArgs;
+    attrArgs.reserve(sizeof...(ARGS));
+    implementation::Function::addArgs(attrArgs, std::forward<ARGS>(args)...);
+    return Dispatch(*this, launchArgs, std::move(attrArgs));
+  }
+
   /// @brief Dispatch the kernel with a pre-built argument vector.
   ///
   /// Use this overload when kernel arguments are assembled dynamically
@@ -323,6 +404,35 @@ class Function {
   std::shared_ptr<implementation::Library> _parent;
 };
 
+/// @brief An interned kernel function name for repeated lookups.
+///
+/// Construction interns the string once; Library::lookupFunction() then finds
+/// the cached function by address instead of hashing the name. Interned
+/// names live for the rest of the process. Cheap to copy.
+/// @code
+/// static const ghost::FunctionName kBlur("blur");
+/// library.lookupFunction(kBlur)(stream, launchArgs, out, in);
+/// @endcode
+class FunctionName {
+ public:
+  /// @brief Intern @p name.
+  explicit FunctionName(const std::string& name);
+
+  /// @brief Intern @p name.
+  explicit FunctionName(const char* name);
+
+  /// @brief Get the name.
+  const std::string& str() const { return *_name; }
+
+  bool operator==(const FunctionName& rhs) const { return _name == rhs._name; }
+  bool operator!=(const FunctionName& rhs) const { return _name != rhs._name; }
+
+ private:
+  friend class Library;
+
+  const std::string* _name;
+};
+
 /// @brief A compiled GPU program containing one or more kernel functions.
 ///
 /// Libraries are created by Device::loadLibraryFromText(),
@@ -337,20 +447,40 @@ class Library {
   Library(std::shared_ptr<implementation::Library> impl);
 
   /// @brief Look up a kernel function by name.
+  ///
+  /// Results are cached per library, so repeated lookups of the same name
+  /// return the same function without asking the backend again. Use a
+  /// FunctionName to also skip hashing the name.
+  ///
+  /// Every caller shares that one function, so Function::setAttribute()
+  /// (e.g. the CUDA cache config) affects all of them. Functions from
+  /// lookupSpecializedFunction() are not cached and so not shared.
   /// @param name The kernel function name.
   /// @return The Function object.
   /// @throws std::runtime_error if the function is not found.
   Function lookupFunction(const std::string& name) const;
 
+  /// @brief Look up a kernel function by interned name.
+  /// @param name The interned kernel function name.
+  /// @return The Function object.
+  /// @throws std::runtime_error if the function is not found.
+  Function lookupFunction(const FunctionName& name) const;
+
   /// @brief Look up a kernel function by name with additional backend-specific
   /// arguments.
+  ///
+  /// These lookups bypass the cache.
+  /// @tparam ARG First additional argument type.
   /// @tparam ARGS Additional argument types forwarded to the backend.
   /// @param name The kernel function name.
+  /// @param arg First backend-specific argument.
   /// @param args Backend-specific arguments.
   /// @return The Function object.
-  template <typename... ARGS>
-  Function lookupFunction(const std::string& name, ARGS&&... args) {
-    Function fn = _impl->lookupFunction(name, std::forward<ARGS>(args)...);
+  template <typename ARG, typename... ARGS>
+  Function lookupFunction(const std::string& name, ARG&& arg,
+                          ARGS&&... args) {
+    Function fn = _impl->lookupFunction(name, std::forward<ARG>(arg),
+                                        std::forward<ARGS>(args)...);
     return _stamp(fn);
   }
 
@@ -409,7 +539,8 @@ class Library {
   /// - OpenCL: recompiles from source with -D defines (only if loaded from
   ///   source text; throws unsupported_error for binary/SPIR-V).
   ///
-  /// Previously looked-up functions may be invalidated by this call.
+  /// Previously looked-up functions may be invalidated by this call. The
+  /// lookup cache is cleared, so later lookups see the new program.
   ///
   /// @param globals Name/value pairs where names match kernel global variable
   ///   names or preprocessor define names.
@@ -431,6 +562,14 @@ class Library {
   /// @brief The current write-intent default policy for this library.
   WriteDefault writeDefault() const { return _impl->writeDefault; }
 
+  /// @brief Wall time in seconds of the load or compile that produced this
+  /// library, as measured by the @c Device call that returned it.
+  double loadTime() const { return _impl->loadSeconds; }
+
+  /// @brief Whether the binary cache supplied this library, so that no
+  /// compile ran. Always @c false on backends that do not use the cache.
+  bool loadedFromCache() const { return _impl->loadedFromCache; }
+
   /// @brief Retrieve the compiled binary data from this library.
   ///
   /// Returns the backend-specific compiled binary (e.g., cubin for CUDA,
@@ -447,6 +586,8 @@ class Library {
   std::shared_ptr<implementation::Library>& impl() { return _impl; }
 
  private:
+  friend class Device;
+
   // Stamp library-owned state (parent reference + write-default policy) onto a
   // freshly looked-up function. Library is a friend of Function.
   Function& _stamp(Function& fn) const {
@@ -26,12 +26,16 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace ghost {
 
 class Allocator;
+class FileWrapper;
 
 /// @brief Identifiers for queryable device attributes.
 ///
@@ -440,6 +444,24 @@ class Buffer {
   virtual void fill(const ghost::Encoder& s, size_t offset, size_t size,
                     const void* pattern, size_t patternSize) = 0;
 
+  /// @brief Stream a region of @p file into this buffer.
+  ///
+  /// The default pipelines fixed-size chunks through a ring of host staging
+  /// buffers, recycling a chunk once the event recorded after its upload has
+  /// completed. Backends whose memory is host-addressable override to read
+  /// straight into the allocation.
+  /// @param file Open file, positioned at the first byte to read.
+  virtual void readFromFile(const ghost::Stream& s, FileWrapper& file,
+                            size_t dstOffset, size_t bytes);
+
+  /// @brief Stream a region of this buffer into @p file.
+  ///
+  /// The default keeps up to a ring's worth of @c HostBytes readbacks in
+  /// flight and writes each chunk once its event has completed.
+  /// @param file Open file, positioned at the first byte to write.
+  virtual void writeToFile(const ghost::Stream& s, FileWrapper& file,
+                           size_t srcOffset, size_t bytes) const;
+
   /// @brief Map the buffer into host address space.
   ///
   /// The default implementation throws ghost::unsupported_error. Backends
@@ -515,11 +537,11 @@ class Image {
 /// resource allocation, context sharing, and attribute queries. Not copyable.
 class Device {
  protected:
-  Device() : _poolSize(0) {}
+  Device();
 
   Device(const Device& rhs) = delete;
 
-  virtual ~Device() {}
+  virtual ~Device();
 
   Device& operator=(const Device& rhs) = delete;
 
@@ -528,6 +550,37 @@ class Device {
   /// host-memory routing goes through it as well.
   std::shared_ptr<ghost::Allocator> _allocator;
 
+  /// @brief Allocate a staging-pool block of exactly @p bytes.
+  ///
+  /// Default uses malloc(). Backends override to return pinned or
+  /// host-visible memory the driver can DMA from directly. Backends that
+  /// override must call @c trimHostMemoryPool() in their destructor, while
+  /// they can still free their blocks.
+  virtual void* allocatePinnedMemory(size_t bytes) const;
+
+  /// @brief Release a block from @c allocatePinnedMemory. Default uses free().
+  virtual void freePinnedMemory(void* ptr) const;
+
+  /// @brief Create a buffer handle for @c nativeAllocator().
+  ///
+  /// Returns a handle in the form @c Allocator::allocateBuffer (or, when
+  /// @p mapped, @c Allocator::allocateMappedBuffer) must produce for this
+  /// backend, made as the device's own allocation path would. Default
+  /// returns @c nullptr. Backends that override must call
+  /// @c detachNativeAllocator() in their destructor, while they can still
+  /// free handles.
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const;
+
+  /// @brief Release a handle from @c allocateNativeBuffer.
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const;
+
+  /// @brief Release what an installed @c CachingAllocator holds of this
+  /// device and detach @c nativeAllocator(), which then declines every
+  /// request and drops frees.
+  void detachNativeAllocator() const;
+
  public:
   /// @brief Install an external allocator. Should be set before any buffers
   /// or images are allocated. Pass @c nullptr to clear.
@@ -538,10 +591,81 @@ class Device {
   /// @brief Get the installed allocator, or @c nullptr.
   ghost::Allocator* allocator() const { return _allocator.get(); }
 
+  /// @brief Allocator that creates buffer handles on this device, for use
+  /// as a @c CachingAllocator upstream. Declines what the backend cannot
+  /// create, and everything once the device is destroyed.
+  std::shared_ptr<ghost::Allocator> nativeAllocator() const;
+
   /// @brief Per-device binary cache. Each device owns its own cache so
   /// different backends (or devices) can target different paths/policies.
   BinaryCache& binaryCache() const { return _cache; }
 
+  /// @brief Device identity used to key binary cache entries.
+  struct Fingerprint {
+    /// @brief Value of @c kDeviceCount.
+    size_t count;
+    /// @brief Vendor, name and driver version bytes, as hashed once per
+    /// device into every cache key.
+    std::string identity;
+    /// @brief SHA-256 of @c identity repeated @c count times: the device
+    /// digest stored in each cache file's header.
+    uint8_t digest[32];
+  };
+
+  /// @brief Park a library built by Device::precompile under @p key.
+  ///
+  /// If a library is already parked under @p key it is kept and @p lib is
+  /// replaced with it, so duplicate manifest entries share one build.
+  /// @param key Key from precompileKey().
+  /// @param[in,out] lib Future of the library to park.
+  /// @return @c true if @p lib was parked, @c false if @p key was taken.
+  bool parkPrecompiled(const std::string& key,
+                       std::shared_future<ghost::Library>& lib) const;
+
+  /// @brief Remove and return the library parked under @p key, if any.
+  /// @param key Key from precompileKey().
+  /// @param[out] lib The parked library's future.
+  /// @return @c true if a library was parked under @p key.
+  bool takePrecompiled(const std::string& key,
+                       std::shared_future<ghost::Library>& lib) const;
+
+  /// @brief Whether any library is parked. Lets loads skip hashing their
+  /// inputs when nothing was precompiled.
+  bool hasPrecompiled() const;
+
+  /// @brief Run @p worker on @p count threads owned by this device.
+  ///
+  /// The threads are joined by clearPrecompiled(). Workers must not hold a
+  /// strong reference to the device.
+  void startPrecompileWorkers(size_t count,
+                              const std::function<void()>& worker) const;
+
+  /// @brief Whether clearPrecompiled() is tearing down the workers. Workers
+  /// check this between builds and fail the remaining ones.
+  bool precompileStopping() const;
+
+  /// @brief Stop precompile workers and drop parked libraries that were
+  /// never taken.
+  ///
+  /// Queued builds fail and running ones are waited for. Every backend calls
+  /// this first in its destructor, so no build runs against a partly
+  /// destroyed device.
+  void clearPrecompiled() const;
+
+  /// @brief Build the key that matches a precompiled library with a later
+  /// load call.
+  /// @param binary @c true for loadLibraryFromData inputs.
+  static std::string precompileKey(const void* data, size_t len, bool binary,
+                                   const CompilerOptions& options,
+                                   bool retainBinary);
+
+  /// @brief Get the cache-key identity of this device.
+  ///
+  /// Queried from @c getAttribute (which may parse @c /proc/cpuinfo or make a
+  /// driver round trip) on first use, then reused for the device's lifetime.
+  /// Thread-safe.
+  const Fingerprint& fingerprint() const;
+
   virtual ghost::Library loadLibraryFromText(
       const std::string& text,
       const CompilerOptions& options = CompilerOptions(),
@@ -593,14 +717,43 @@ class Device {
   /// getMemoryPoolSize().
   virtual void setMemoryPoolSize(size_t bytes);
 
-  /// @brief Allocate page-locked host memory. Default uses malloc().
+  /// @brief Allocate page-locked host memory.
+  ///
+  /// Consults the installed allocator first. Otherwise requests are rounded
+  /// to a size class and served from the device's staging pool, which
+  /// recycles blocks obtained from @c allocatePinnedMemory.
   virtual void* allocateHostMemory(size_t bytes) const;
 
-  /// @brief Free page-locked host memory. Default uses free().
+  /// @brief Free page-locked host memory. Pool blocks are parked for reuse;
+  /// other pointers go to free().
   virtual void freeHostMemory(void* ptr) const;
 
+  /// @brief Release parked staging-pool blocks until at most @p keepBytes
+  /// remain. Blocks still handed out are unaffected.
+  void trimHostMemoryPool(size_t keepBytes = 0) const;
+
+  /// @brief Set the high-water limit on parked staging-pool bytes.
+  void setHostMemoryPoolLimit(size_t bytes);
+
   virtual ghost::Buffer allocateBuffer(
       size_t bytes, const BufferOptions& opts = {}) const = 0;
+
+  /// @brief Bump-allocate a sub-buffer from the transient arena.
+  ///
+  /// Falls back to @c allocateBuffer when the arena is disabled or the
+  /// backend cannot create sub-buffers.
+  ghost::Buffer allocateTransientBuffer(size_t bytes,
+                                        const BufferOptions& opts) const;
+
+  /// @brief Set the transient arena block size (0 disables the arena).
+  void setTransientArenaSize(size_t blockBytes);
+
+  /// @brief Get the transient arena block size.
+  size_t getTransientArenaSize() const;
+
+  /// @brief Rewind every arena block; previous transient buffers are dead.
+  void resetTransientArena();
+
   virtual ghost::MappedBuffer allocateMappedBuffer(
       size_t bytes, const BufferOptions& opts = {}) const = 0;
   virtual ghost::Image allocateImage(const ImageDescription& descr) const = 0;
@@ -639,7 +792,20 @@ class Device {
   }
 
  private:
+  struct TransientArena;
+  struct HostMemoryPool;
+  struct PrecompiledLibraries;
+  class NativeAllocator;
+
   size_t _poolSize;
+  std::shared_ptr<HostMemoryPool> _hostPool;
+  // Created on first use. shared_ptr so the struct can stay opaque here;
+  // only accessed with std::atomic_load/atomic_store.
+  mutable std::shared_ptr<TransientArena> _transientArena;
+  std::shared_ptr<PrecompiledLibraries> _precompiled;
+  std::shared_ptr<NativeAllocator> _nativeAllocator;
+  mutable std::once_flag _fingerprintOnce;
+  mutable Fingerprint _fingerprint;
   // Mutable so const device methods (e.g. a backend's const saveToCache) can
   // reach the cache; the cache is device-owned configuration, not device state.
   mutable BinaryCache _cache;
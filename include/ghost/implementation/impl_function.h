@@ -19,10 +19,14 @@
 #include <ghost/exception.h>
 #include <stdlib.h>
 
+#include <cstdint>
+#include <future>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace ghost {
@@ -113,6 +117,31 @@ namespace implementation {
 
 class Buffer;
 
+/// @brief Backend state precomputed for a @c ghost::Dispatch.
+///
+/// Created once by @ref Function::bind. The argument vector passed to every
+/// call is the one passed to @c bind, updated in place, so backends may keep
+/// pointers into it.
+class DispatchState {
+ public:
+  DispatchState() {}
+
+  DispatchState(const DispatchState&) = delete;
+
+  virtual ~DispatchState() {}
+
+  DispatchState& operator=(const DispatchState&) = delete;
+
+  /// @brief Called after @p args[index] was replaced by a value of the same
+  /// type.
+  virtual void argChanged(const std::vector<Attribute>& args,
+                          size_t index) = 0;
+
+  /// @brief Launch the kernel with the bound arguments.
+  virtual void enqueue(const ghost::Encoder& s, const LaunchArgs& launchArgs,
+                       const std::vector<Attribute>& args) = 0;
+};
+
 /// @brief Abstract backend interface for a compiled GPU kernel function.
 ///
 /// Backend implementations derive from this class to provide kernel execution
@@ -152,6 +181,15 @@ class Function {
                                size_t indirectOffset,
                                const std::vector<Attribute>& args);
 
+  /// @brief Precompute native argument state for a @c ghost::Dispatch.
+  ///
+  /// The default returns @c nullptr, and the dispatch calls @ref execute on
+  /// every enqueue.
+  /// @param args The bound arguments. They stay at the same address for the
+  ///   lifetime of the returned state.
+  virtual std::shared_ptr<DispatchState> bind(
+      const std::vector<Attribute>& args);
+
   virtual Attribute getAttribute(FunctionAttributeId what) const = 0;
 
   /// @brief Set a writable function attribute (e.g. the preferred L1/shared
@@ -190,6 +228,21 @@ class Function {
     return written;
   }
 
+  /// @brief Stamp the first @p n Buffer/Image arguments Write and the rest
+  /// Read, leaving any argument the caller already marked (ghost::write/read)
+  /// untouched. Implements @c BoundFunction::writes and @c Dispatch::writes.
+  static void stampWrites(std::vector<Attribute>& args, size_t n) {
+    size_t resourceIndex = 0;
+    for (auto& a : args) {
+      if (a.type() != Attribute::Type_Buffer &&
+          a.type() != Attribute::Type_Image)
+        continue;
+      if (!a.access())
+        a.access(resourceIndex < n ? Access::WriteOnly : Access::ReadOnly);
+      ++resourceIndex;
+    }
+  }
+
   /// @brief Subgroup width the compiled pipeline will actually use.
   ///
   /// Default implementation returns the value of @c kFunctionThreadWidth from
@@ -235,6 +288,7 @@ class Function {
   void operator()(const ghost::Encoder& s, const LaunchArgs& launchArgs,
                   ARGS&&... tail) {
     std::vector<Attribute> args;
+    args.reserve(sizeof...(ARGS));
     addArgs(args, std::forward<ARGS>(tail)...);
     execute(s, launchArgs, args);
   }
@@ -263,8 +317,46 @@ class Library {
   /// this library. Set via @c ghost::Library::setWriteDefault.
   WriteDefault writeDefault = WriteDefault::Conservative;
 
+  /// @brief Wall time in seconds of the load that produced this library.
+  /// Set by @c ghost::Device.
+  double loadSeconds = 0;
+
+  /// @brief Whether the binary cache served the load, so nothing compiled.
+  bool loadedFromCache = false;
+
+  /// @brief Look up a function through the per-library cache.
+  ///
+  /// The first call for @p name calls lookupFunction() and stamps
+  /// writeDefault on the result. Later calls return the same function, unless
+  /// writeDefault has changed since, in which case it is looked up again.
+  /// Concurrent first calls for one name share a single lookupFunction(),
+  /// which runs without the cache lock held. Failures are not cached.
+  std::shared_ptr<Function> findFunction(const std::string& name) const;
+
+  /// @brief As findFunction(const std::string&), keyed by an interned name
+  /// (see @c ghost::FunctionName) so a hit skips hashing the string.
+  std::shared_ptr<Function> findFunction(const std::string* interned) const;
+
+  /// @brief Forget every cached function, e.g. after setGlobals() replaced
+  /// the compiled program.
+  void clearFunctionCache();
+
  private:
+  struct CachedFunction {
+    std::shared_future<std::shared_ptr<Function>> function;
+    WriteDefault writeDefault = WriteDefault::Conservative;
+    uint64_t id = 0;
+  };
+
+  std::shared_ptr<Function> findFunction(const std::string& name,
+                                         const std::string* interned) const;
+
   bool _retainBinary = false;
+  mutable std::mutex _functionCacheMutex;
+  mutable uint64_t _functionCacheId = 0;
+  mutable std::unordered_map<std::string, CachedFunction> _functions;
+  mutable std::unordered_map<const std::string*, CachedFunction>
+      _internedFunctions;
 
  public:
   virtual ghost::Function lookupFunction(const std::string& name) const = 0;
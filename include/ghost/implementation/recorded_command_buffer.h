@@ -19,6 +19,7 @@
 
 #include <cstring>
 #include <functional>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -174,6 +175,13 @@ class RecordedCommandBuffer : public CommandBuffer {
     commands.push_back(DispatchCmd{function, launchArgs, args});
   }
 
+  void dispatch(std::shared_ptr<implementation::Function> function,
+                const LaunchArgs& launchArgs,
+                std::vector<Attribute>&& args) override {
+    commands.push_back(
+        DispatchCmd{std::move(function), launchArgs, std::move(args)});
+  }
+
   void dispatchIndirect(std::shared_ptr<implementation::Function> function,
                         std::shared_ptr<implementation::Buffer> indirectBuffer,
                         size_t indirectOffset,
@@ -17,7 +17,10 @@
 
 #include <stdio.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <stdexcept>
+#include <string>
 
 namespace ghost {
 
@@ -70,6 +73,18 @@ class FileWrapper {
       throw std::runtime_error("write error");
   }
 
+  /// @brief Move the file position to @p offset bytes from the start.
+  /// @param offset Absolute byte offset.
+  /// @throws std::runtime_error if the file is not open or the seek fails.
+  void seek(uint64_t offset) {
+#if defined(_WIN32)
+    int err = _fp ? _fseeki64(_fp, (__int64)offset, SEEK_SET) : -1;
+#else
+    int err = _fp ? fseeko(_fp, (off_t)offset, SEEK_SET) : -1;
+#endif
+    if (err != 0) throw std::runtime_error("seek error");
+  }
+
   /// @brief Check whether a file handle is open.
   /// @return @c true if the file is open.
   bool okay() const { return _fp != nullptr; }
@@ -85,6 +100,90 @@ class FileWrapper {
     return *this;
   }
 };
+
+/// @brief RAII read-only memory mapping of a whole file.
+///
+/// The mapping stays valid until @c close or destruction, independently of
+/// later renames or deletions of the file on POSIX systems. Used internally
+/// for zero-copy binary cache loads.
+class MappedFile {
+ public:
+  /// @brief Construct an empty mapping.
+  MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /// @brief Unmap the file if mapped.
+  ~MappedFile();
+
+  /// @brief Map @p path read-only, replacing any current mapping.
+  /// @param path File to map.
+  /// @return @c true on success. Empty files cannot be mapped.
+  bool open(const char* path);
+
+  /// @brief Unmap the file if mapped.
+  void close();
+
+  /// @brief Start of the mapped bytes, or @c nullptr if not mapped.
+  const unsigned char* data() const { return _data; }
+
+  /// @brief Number of mapped bytes.
+  size_t size() const { return _size; }
+
+  /// @brief Check whether a file is mapped.
+  bool okay() const { return _data != nullptr; }
+
+ private:
+  const unsigned char* _data;
+  size_t _size;
+};
+
+/// @brief RAII exclusive advisory lock held through a lock file.
+///
+/// The lock is visible to every process that locks the same path, and to
+/// other @c FileLock objects in this process. It is released when the holder
+/// unlocks, is destroyed, or exits (including by crashing), so a lock is
+/// never left stale. The lock file is deleted on unlock. Used internally to
+/// keep processes that share a binary cache from compiling the same entry at
+/// the same time.
+class FileLock {
+ public:
+  /// @brief Construct an unlocked lock.
+  FileLock();
+
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+  /// @brief Release the lock if held.
+  ~FileLock();
+
+  /// @brief Outcome of @c tryLock.
+  enum class Result {
+    /// @brief The lock is now held.
+    Locked,
+    /// @brief Another holder has the lock.
+    Busy,
+    /// @brief The lock file cannot be created or opened.
+    Failed
+  };
+
+  /// @brief Try to take the lock without blocking.
+  /// @param path Lock file to create or open.
+  /// @return Whether the lock was taken, and if not, why.
+  Result tryLock(const char* path);
+
+  /// @brief Delete the lock file and release the lock, if held.
+  void unlock();
+
+  /// @brief Check whether the lock is held.
+  bool locked() const { return _handle != -1; }
+
+ private:
+  // File descriptor, or a HANDLE on Windows. -1 when unlocked.
+  intptr_t _handle;
+  std::string _path;
+};
 }  // namespace ghost
 
 #endif
\ No newline at end of file
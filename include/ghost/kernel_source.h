@@ -18,7 +18,11 @@
 #include <ghost/device.h>
 #include <ghost/function.h>
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
@@ -56,8 +60,27 @@ namespace ghost {
 ///   loadLibraryFromData() + setGlobals() (safe for concurrent dispatch
 ///   since each variant has its own @c __constant__ memory).
 ///
-/// Thread-safe: concurrent getFunction() calls are safe. Cache reads take
-/// a shared lock; compilation takes an exclusive lock.
+/// Variants and the compile strategy are tracked per device, so a single
+/// KernelSource can serve several devices (for example a CPU device and a
+/// GPU it load-balances against). State for a device is dropped once that
+/// device is destroyed.
+///
+/// Variants are cached under a compact binary key (function name plus the
+/// packed constant values), so a cache hit formats nothing. For per-dispatch
+/// lookups, resolve a Variant once with variant() and pass it to
+/// getFunction(); a hit then neither hashes nor allocates.
+///
+/// The variant cache is unbounded by default. setCacheLimits() caps it by
+/// variant count or estimated bytes; the least recently used variants are
+/// then evicted, and compiled again (normally from Device::binaryCache())
+/// if requested later. Functions already returned stay valid after their
+/// variant is evicted.
+///
+/// Thread-safe: concurrent getFunction() calls are safe. Variants compile
+/// outside the cache lock, so different variants compile in parallel and
+/// lookups of cached variants never wait for a compile. Callers asking for
+/// a variant that is still compiling wait for that compile only; if it
+/// fails, they all see the error and the next call compiles again.
 ///
 /// @code
 /// // Text mode (OpenCL)
@@ -76,7 +99,62 @@ namespace ghost {
 /// });
 /// @endcode
 class KernelSource {
+  struct DeviceState;
+
+  // Packed cache key with its hash computed once. See makeKey().
+  struct VariantKey {
+    std::string bytes;
+    size_t hash = 0;
+
+    bool operator==(const VariantKey& rhs) const {
+      return hash == rhs.hash && bytes == rhs.bytes;
+    }
+  };
+
+  struct VariantKeyHash {
+    size_t operator()(const VariantKey& key) const { return key.hash; }
+  };
+
  public:
+  /// @brief Bounds on the in-memory variant cache. Zero means no bound.
+  ///
+  /// Limits apply to each device separately.
+  struct CacheLimits {
+    /// @brief Maximum number of cached variants.
+    size_t maxVariants = 0;
+    /// @brief Maximum estimated bytes of cached variants. A variant's
+    /// estimate is the size of the source or binary its own library was
+    /// built from, or a nominal few KiB for variants specialized from a
+    /// shared base library (Metal, Vulkan).
+    size_t maxBytes = 0;
+  };
+
+  /// @brief A variant resolved ahead of time for repeated lookups.
+  ///
+  /// Holds the variant's cache key for one device, so getFunction(device,
+  /// variant) skips building and hashing the key. It also keeps the function
+  /// name and constants, and recompiles if the variant is no longer cached.
+  /// Obtain one from variant() or specializedVariant().
+  class Variant {
+   public:
+    /// @brief Construct an empty handle.
+    Variant() = default;
+
+    /// @brief Check whether the handle refers to a variant.
+    bool valid() const { return _state != nullptr; }
+
+   private:
+    friend class KernelSource;
+
+    const KernelSource* _source = nullptr;
+    std::shared_ptr<DeviceState> _state;
+    VariantKey _key;
+    std::string _functionName;
+    bool _positional = false;
+    std::vector<std::pair<std::string, Attribute>> _constants;
+    std::vector<Attribute> _positionalConstants;
+  };
+
   /// @brief Construct from kernel source text.
   ///
   /// By default, backends that support specialization (Metal, Vulkan) will
@@ -135,18 +213,100 @@ class KernelSource {
                                   const std::string& functionName,
                                   const std::vector<Attribute>& constants);
 
+  /// @brief Resolve a handle for a variant with named constants.
+  ///
+  /// Does not compile; the first getFunction() with the handle does.
+  ///
+  /// @param device The device the handle is for.
+  /// @param functionName The kernel function name.
+  /// @param constants Named constant values, as for getFunction().
+  /// @return A handle for getFunction(Device&, const Variant&).
+  Variant variant(
+      Device& device, const std::string& functionName,
+      const std::vector<std::pair<std::string, Attribute>>& constants = {});
+
+  /// @brief Resolve a handle for a variant with positional constants.
+  ///
+  /// Does not compile; the first getFunction() with the handle does.
+  ///
+  /// @param device The device the handle is for.
+  /// @param functionName The kernel function name.
+  /// @param constants Positional constant values, as for
+  ///   getSpecializedFunction().
+  /// @return A handle for getFunction(Device&, const Variant&).
+  Variant specializedVariant(Device& device, const std::string& functionName,
+                             const std::vector<Attribute>& constants);
+
+  /// @brief Get the compiled Function for a resolved variant.
+  ///
+  /// Equivalent to the getFunction() or getSpecializedFunction() call the
+  /// handle was resolved from, without rebuilding its key.
+  ///
+  /// @param device The device the handle was resolved for.
+  /// @param variant A handle from variant() or specializedVariant() on this
+  ///   KernelSource.
+  /// @return The compiled Function.
+  /// @throws std::invalid_argument if @p variant is empty, or belongs to
+  ///   another KernelSource or device.
+  Function getFunction(Device& device, const Variant& variant);
+
+  /// @brief Bound the variant cache, evicting least recently used variants
+  /// that exceed the new limits.
+  void setCacheLimits(const CacheLimits& limits);
+
+  /// @brief Current variant cache bounds.
+  CacheLimits cacheLimits() const;
+
+  /// @brief Number of variants cached or compiling, over all devices.
+  size_t cachedVariants() const;
+
  private:
   enum class Mode { Text, Binary };
 
-  /// Build a deterministic cache key from function name and named constants.
-  static std::string makeKey(
+  struct CacheEntry {
+    std::shared_future<Function> function;
+    // _useClock value at the latest lookup. Updated under the shared lock.
+    std::atomic<uint64_t> lastUse{0};
+    // Estimated footprint, set once the variant is built.
+    size_t bytes = 0;
+    bool ready = false;
+  };
+
+  // Compile strategy and variants for one device.
+  struct DeviceState {
+    const implementation::Device* id = nullptr;
+    // Detects a destroyed device whose address has been reused.
+    std::weak_ptr<implementation::Device> device;
+    // Guards strategy resolution. The fields below it are written only
+    // before capabilityChecked is set, except useSpecialization, which a
+    // variant may clear when specialization turns out to be unsupported.
+    std::mutex strategyMutex;
+    // Base library for backends that support specialization (Metal,
+    // Vulkan), or the compiled base for CUDA text.
+    Library baseLibrary{nullptr};
+    bool hasBaseLibrary = false;
+    // CUDA text mode: the base library's binary, reused per variant.
+    std::vector<uint8_t> baseBinary;
+    std::atomic<bool> capabilityChecked{false};
+    std::atomic<bool> useSpecialization{false};
+    // Compiled or compiling Functions, and the estimated bytes of the
+    // compiled ones. Guarded by KernelSource::_mutex.
+    std::unordered_map<VariantKey, CacheEntry, VariantKeyHash> cache;
+    size_t cacheBytes = 0;
+  };
+
+  /// Pack function name and named constants into @p key, reusing its
+  /// storage.
+  static void makeKey(
       const std::string& functionName,
-      const std::vector<std::pair<std::string, Attribute>>& constants);
+      const std::vector<std::pair<std::string, Attribute>>& constants,
+      VariantKey& key);
 
-  /// Build a deterministic cache key from function name and positional
-  /// constants.
-  static std::string makeKey(const std::string& functionName,
-                             const std::vector<Attribute>& constants);
+  /// Pack function name and positional constants into @p key, reusing its
+  /// storage.
+  static void makeKey(const std::string& functionName,
+                      const std::vector<Attribute>& constants,
+                      VariantKey& key);
 
   /// Convert named Attribute constants to CompilerOptions defines.
   static void constantsToDefines(
@@ -157,29 +317,62 @@ class KernelSource {
   static std::vector<Attribute> constantsToPositional(
       const std::vector<std::pair<std::string, Attribute>>& constants);
 
+  /// Find or create the state for @p device.
+  std::shared_ptr<DeviceState> stateFor(const Device& device);
+
+  /// Choose the compile strategy from the device capabilities and build the
+  /// base library if the strategy needs one. Runs once per device.
+  void resolveStrategy(Device& device, DeviceState& state);
+
+  /// Return the variant for @p key, running @p build for it if no other
+  /// caller has. @p build takes a @c size_t& for the variant's estimated
+  /// bytes and returns the Function. A template rather than a
+  /// std::function, whose capture would be heap allocated on every call.
+  template <typename Build>
+  Function getOrBuild(DeviceState& state, const VariantKey& key,
+                      Build&& build);
+
+  /// Evict least recently used variants of @p state, other than @p keep,
+  /// until it is within _limits. Victims are chosen in one pass over the
+  /// cache, not one scan each. Requires the exclusive lock; evicted
+  /// Functions are moved to @p evicted to be released after unlocking.
+  void trimLocked(DeviceState& state, const CacheEntry* keep,
+                  std::vector<std::shared_future<Function>>& evicted);
+
+  /// Estimated bytes of a variant just built by buildNamed().
+  size_t estimateBytes(const DeviceState& state, bool hasConstants) const;
+
   Function getFunctionFromText(
-      Device& device, const std::string& functionName,
+      Device& device, DeviceState& state, const std::string& functionName,
       const std::vector<std::pair<std::string, Attribute>>& constants);
 
   Function getFunctionFromBinary(
-      Device& device, const std::string& functionName,
+      Device& device, DeviceState& state, const std::string& functionName,
       const std::vector<std::pair<std::string, Attribute>>& constants);
 
+  /// Compile a named-constant variant for @p state's device.
+  Function buildNamed(
+      Device& device, DeviceState& state, const std::string& functionName,
+      const std::vector<std::pair<std::string, Attribute>>& constants);
+
+  /// Specialize a positional-constant variant for @p state's device.
+  Function buildPositional(Device& device, DeviceState& state,
+                           const std::string& functionName,
+                           const std::vector<Attribute>& constants);
+
   Mode _mode;
   bool _forceDefines;
   std::string _text;
   std::vector<uint8_t> _binaryData;
   CompilerOptions _baseOptions;
 
+  // Guards _devices, _limits and every DeviceState::cache.
   mutable std::shared_mutex _mutex;
-  // Base library for backends that support specialization (Metal, Vulkan).
-  Library _baseLibrary;
-  bool _hasBaseLibrary = false;
-  // Resolved on first call per mode.
-  bool _capabilityChecked = false;
-  bool _useSpecialization = false;
-  // Cached Functions keyed by (functionName + serialized constants).
-  std::unordered_map<std::string, Function> _cache;
+  CacheLimits _limits;
+  std::atomic<uint64_t> _useClock{0};
+  std::unordered_map<const implementation::Device*,
+                     std::shared_ptr<DeviceState>>
+      _devices;
 };
 
 }  // namespace ghost
@@ -338,6 +338,7 @@ class DeviceMetal : public Device {
   DeviceMetal(const SharedContext& share);
   DeviceMetal(const GpuInfo& info);
   DeviceMetal(id<MTLDevice> device);
+  ~DeviceMetal() override;
 
   virtual ghost::Library loadLibraryFromText(
       const std::string& text,
@@ -374,6 +375,12 @@ class DeviceMetal : public Device {
 
   virtual Attribute getAttribute(DeviceAttributeId what) const override;
   virtual size_t imageAlignment(const ImageDescription& descr) const override;
+
+ protected:
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const override;
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const override;
 };
 }  // namespace implementation
 }  // namespace ghost
@@ -22,7 +22,9 @@
 
 #include <functional>
 #include <list>
+#include <mutex>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 namespace ghost {
@@ -445,6 +447,7 @@ class DeviceOpenCL : public Device {
   DeviceOpenCL(const SharedContext& share);
   DeviceOpenCL(const GpuInfo& info);
   DeviceOpenCL(cl_platform_id platform, cl_device_id device);
+  ~DeviceOpenCL() override;
 
   virtual ghost::Library loadLibraryFromText(
       const std::string& text,
@@ -497,11 +500,27 @@ class DeviceOpenCL : public Device {
   std::string getString(cl_device_info param_name) const;
   std::string getPlatformString(cl_platform_info param_name) const;
 
+ protected:
+  /// @brief Staging-pool blocks are @c CL_MEM_ALLOC_HOST_PTR buffers mapped
+  /// for the block's lifetime, which drivers back with pinned memory.
+  virtual void* allocatePinnedMemory(size_t bytes) const override;
+  virtual void freePinnedMemory(void* ptr) const override;
+
+  /// @brief Native buffer handles are @c cl_mem objects created with the
+  /// flags BufferOpenCL and MappedBufferOpenCL use.
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const override;
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const override;
+
  private:
   std::string _version;
   std::set<std::string> _extensions;
   bool _fullProfile;
   mutable std::shared_ptr<BufferPool> _pool;
+  // Mapped pointer -> backing buffer for allocatePinnedMemory blocks.
+  mutable std::mutex _pinnedMutex;
+  mutable std::unordered_map<void*, cl_mem> _pinned;
 #if WITH_OPENCL_COMMAND_BUFFERS
   // Resolved lazily on first commandBufferExt() query; _cmdBufExtLoaded guards
   // the one-time resolution.
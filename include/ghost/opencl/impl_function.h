@@ -18,12 +18,60 @@
 #include <ghost/implementation/impl_function.h>
 #include <ghost/opencl/ptr.h>
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace ghost {
 namespace implementation {
 class DeviceOpenCL;
 
 class FunctionOpenCL : public Function {
  public:
+  /// @brief A kernel object and the argument values last set on it.
+  ///
+  /// @c clSetKernelArg is not thread-safe for one kernel, so each dispatch
+  /// holds an instance exclusively from setting its arguments until it is
+  /// enqueued. The first instance owns @c kernel; a thread that finds every
+  /// instance busy gets a new one created from the same program.
+  struct Instance {
+    struct Arg {
+      bool valid = false;
+      bool local = false;
+      size_t size = 0;
+      // Large enough for a cl_mem or a 4-component scalar vector.
+      unsigned char bytes[16];
+    };
+
+    opencl::ptr<cl_kernel> kernel;
+    // Shadow of the values set on kernel, by argument index.
+    std::vector<Arg> args;
+    std::thread::id thread;
+    bool busy = false;
+  };
+
+  /// @brief Exclusive use of an @ref Instance, released on destruction.
+  class Lease {
+   public:
+    Lease(FunctionOpenCL& function, Instance& instance)
+        : _function(function), _instance(instance) {}
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    ~Lease() { _function.release(_instance); }
+
+    Instance& operator*() const { return _instance; }
+
+    Instance* operator->() const { return &_instance; }
+
+   private:
+    FunctionOpenCL& _function;
+    Instance& _instance;
+  };
+
   opencl::ptr<cl_kernel> kernel;
 
   FunctionOpenCL(const DeviceOpenCL& dev, opencl::ptr<cl_kernel> k);
@@ -31,18 +79,73 @@ class FunctionOpenCL : public Function {
   virtual void execute(const ghost::Encoder& s, const LaunchArgs& launchArgs,
                        const std::vector<Attribute>& args) override;
 
-  /// @brief Bind @p args to this kernel via @c clSetKernelArg. Shared by the
+  /// @brief Take an idle instance, preferring the one this thread used last.
+  /// @param primary Wait for the instance that owns @c kernel instead.
+  Lease acquire(bool primary = false);
+
+  /// @brief Bind @p args to @p instance via @c clSetKernelArg. Shared by the
   /// immediate enqueue path and the @c cl_khr_command_buffer recording path in
   /// @ref ExecutableOpenCL; the bound values are captured by the subsequent
   /// enqueue / record call.
-  void bindArgs(const std::vector<Attribute>& args);
+  void bindArgs(Instance& instance, const std::vector<Attribute>& args);
+
+  /// @brief Set one argument, skipping the call if @p instance already holds
+  /// the same value. @p value is @c nullptr for local memory.
+  static void setArg(Instance& instance, cl_uint index, size_t size,
+                     const void* value);
+
+  /// @brief Enqueue @p instance with the arguments currently set on it.
+  void enqueueKernel(Instance& instance, const ghost::Encoder& s,
+                     const LaunchArgs& launchArgs);
+
+  virtual std::shared_ptr<DispatchState> bind(
+      const std::vector<Attribute>& args) override;
 
   virtual Attribute getAttribute(FunctionAttributeId what) const override;
 
   virtual uint32_t preferredSubgroupSize() const override;
 
  private:
+  void release(Instance& instance);
+
   const DeviceOpenCL& _dev;
+  std::mutex _instancesMutex;
+  std::condition_variable _instanceReleased;
+  std::vector<std::unique_ptr<Instance>> _instances;
+};
+
+/// @brief Precomputed @c clSetKernelArg arguments for a @c ghost::Dispatch.
+///
+/// Index and size rules match @ref FunctionOpenCL::bindArgs. Values go
+/// through @ref FunctionOpenCL::setArg, so arguments that the kernel instance
+/// already holds are not set again.
+class DispatchStateOpenCL : public DispatchState {
+ public:
+  DispatchStateOpenCL(FunctionOpenCL& function,
+                      const std::vector<Attribute>& args);
+
+  virtual void argChanged(const std::vector<Attribute>& args,
+                          size_t index) override;
+
+  virtual void enqueue(const ghost::Encoder& s, const LaunchArgs& launchArgs,
+                       const std::vector<Attribute>& args) override;
+
+ private:
+  struct Slot {
+    bool mapped = false;
+    cl_uint index = 0;
+    size_t size = 0;
+    // Points into the bound Attribute, at mem, or is nullptr for local
+    // memory.
+    const void* value = nullptr;
+    cl_mem mem = nullptr;
+  };
+
+  static void fill(const Attribute& a, Slot& slot);
+
+  FunctionOpenCL& _function;
+  // One per bound argument; never resized, so value may point at mem.
+  std::vector<Slot> _slots;
 };
 
 class LibraryOpenCL : public Library {
@@ -66,7 +169,7 @@ class LibraryOpenCL : public Library {
  private:
   void checkBuildLog(cl_int err0);
   void loadFromCache(const void* data, size_t length,
-                     const CompilerOptions& options);
+                     const CompilerOptions& options, bool claimed = false);
   void saveToCache(const void* data, size_t length,
                    const CompilerOptions& options) const;
   const DeviceOpenCL& _dev;
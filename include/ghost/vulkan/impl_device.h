@@ -440,6 +440,15 @@ class DeviceVulkan : public Device {
   /// of the device.
   VkSampler getOrCreateSampler(const SamplerDescription& desc) const;
 
+ protected:
+  /// @brief Native buffer handles are heap-allocated
+  /// @c ghost::VulkanBufferHandle structs over a buffer and memory created
+  /// as BufferVulkan and MappedBufferVulkan create them.
+  virtual void* allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                     bool mapped) const override;
+  virtual void freeNativeBuffer(void* handle, size_t bytes,
+                                bool mapped) const override;
+
  private:
   bool _ownsInstance;
   VkPhysicalDeviceMemoryProperties _memProperties;
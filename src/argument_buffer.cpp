@@ -13,14 +13,126 @@
 // the License.
 
 #include <ghost/argument_buffer.h>
+#include <ghost/exception.h>
+
+#include <atomic>
 
 namespace ghost {
 
-ArgumentBuffer::ArgumentBuffer() : _gpuBuffer(nullptr) {}
+namespace {
+// Epochs are unique across rings, so a stale slice from one ring never
+// matches the epoch of another.
+uint64_t nextEpoch() {
+  static std::atomic<uint64_t> counter{0};
+  return ++counter;
+}
+}  // namespace
+
+ArgumentRing::ArgumentRing(const Device& device, size_t capacity)
+    : _device(device.impl()),
+      _buffer(nullptr),
+      _capacity(capacity),
+      _alignment(0),
+      _head(0),
+      _tail(0),
+      _unsupported(false),
+      _epoch(nextEpoch()) {}
+
+Buffer ArgumentRing::allocate(size_t bytes) {
+  uint64_t epoch;
+  return allocate(bytes, epoch);
+}
+
+Buffer ArgumentRing::allocate(size_t bytes, uint64_t& epoch) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  epoch = _epoch;
+  if (_unsupported || bytes == 0) return _device->allocateBuffer(bytes);
+  if (_alignment == 0) {
+    auto a = _device->getAttribute(kDeviceBufferAlignment).asUInt64();
+    _alignment = a > 0 ? static_cast<size_t>(a) : 1;
+  }
+  size_t need = (bytes + _alignment - 1) / _alignment * _alignment;
+  retire();
+  size_t offset = 0;
+  if (!_buffer.impl() || !reserve(need, offset)) {
+    // Full (or first use): start over in a larger buffer. Slices already
+    // handed out hold a reference to the old one.
+    if (_buffer.impl()) _capacity *= 2;
+    _capacity = std::max(_capacity, need);
+    _buffer = _device->allocateBuffer(_capacity,
+                                      BufferOptions(AllocHint::Persistent));
+    _head = _tail = 0;
+    _fences.clear();
+    reserve(need, offset);
+  }
+  try {
+    return Buffer(_buffer.impl()->createSubBuffer(_buffer.impl(), offset,
+                                                  bytes));
+  } catch (const ghost::unsupported_error&) {
+    _unsupported = true;
+    _buffer = Buffer(nullptr);
+    return _device->allocateBuffer(bytes);
+  }
+}
+
+bool ArgumentRing::reserve(size_t bytes, size_t& offset) {
+  if (_head == _tail && _fences.empty()) _head = _tail = 0;
+  // _head == _tail only when the ring is empty, so allocations stop short
+  // of _tail rather than meeting it.
+  if (_head >= _tail) {
+    if (_head + bytes <= _capacity) {
+      offset = _head;
+      _head += bytes;
+      return true;
+    }
+    if (bytes < _tail) {
+      offset = 0;
+      _head = bytes;
+      return true;
+    }
+    return false;
+  }
+  if (_head + bytes < _tail) {
+    offset = _head;
+    _head += bytes;
+    return true;
+  }
+  return false;
+}
+
+void ArgumentRing::retire() {
+  while (!_fences.empty() && _fences.front().event.isComplete()) {
+    _tail = _fences.front().end;
+    _fences.pop_front();
+  }
+}
+
+void ArgumentRing::fence(Stream& stream) {
+  Event event = stream.record();
+  std::lock_guard<std::mutex> lock(_mutex);
+  _epoch = nextEpoch();
+  if (!event) {
+    stream.sync();
+    _fences.clear();
+    _tail = _head;
+    return;
+  }
+  _fences.push_back({event, _head});
+}
+
+size_t ArgumentRing::capacity() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _capacity;
+}
+
+ArgumentBuffer::ArgumentBuffer()
+    : _gpuBuffer(nullptr), _dirtyBegin(0), _dirtyEnd(0), _ringEpoch(0) {}
 
 void ArgumentBuffer::reset() {
   _data.clear();
   _gpuBuffer = Buffer(nullptr);
+  _dirtyBegin = _dirtyEnd = 0;
+  _ringEpoch = 0;
 }
 
 size_t ArgumentBuffer::size() const { return _data.size(); }
@@ -30,15 +142,37 @@ const void* ArgumentBuffer::data() const {
 }
 
 void ArgumentBuffer::ensureSize(size_t minSize) {
-  if (_data.size() < minSize) _data.resize(minSize, 0);
+  if (_data.size() < minSize) {
+    markDirty(_data.size(), minSize);
+    _data.resize(minSize, 0);
+  }
 }
 
 void ArgumentBuffer::upload(const Device& device, const Encoder& stream) {
   if (_data.empty()) return;
-  if (!_gpuBuffer.impl() || _gpuBuffer.size() < _data.size()) {
+  if (!_gpuBuffer.impl() || _ringEpoch != 0 ||
+      _gpuBuffer.size() < _data.size()) {
     _gpuBuffer = device.allocateBuffer(_data.size());
+    _ringEpoch = 0;
+    _gpuBuffer.copy(stream, _data.data(), _data.size());
+  } else if (_dirtyBegin < _dirtyEnd) {
+    _gpuBuffer.copy(stream, _data.data() + _dirtyBegin, _dirtyBegin,
+                    _dirtyEnd - _dirtyBegin);
+  }
+  _dirtyBegin = _dirtyEnd = 0;
+}
+
+void ArgumentBuffer::upload(ArgumentRing& ring, const Encoder& stream) {
+  if (_data.empty()) return;
+  if (_gpuBuffer.impl() && _ringEpoch != 0 && _dirtyBegin >= _dirtyEnd) {
+    std::lock_guard<std::mutex> lock(ring._mutex);
+    if (_ringEpoch == ring._epoch) return;
   }
+  uint64_t epoch;
+  _gpuBuffer = ring.allocate(_data.size(), epoch);
+  _ringEpoch = epoch;
   _gpuBuffer.copy(stream, _data.data(), _data.size());
+  _dirtyBegin = _dirtyEnd = 0;
 }
 
 bool ArgumentBuffer::isStruct() const { return !_gpuBuffer.impl(); }
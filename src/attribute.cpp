@@ -17,56 +17,172 @@
 #include <ghost/device.h>
 #include <ghost/implementation/impl_device.h>
 
+#include <new>
+
 namespace ghost {
 
-// All special members are defined out-of-line because the strong-ref members
-// (shared_ptr<implementation::Buffer>, shared_ptr<implementation::Image>,
-// shared_ptr<ArgumentBuffer>) reference types that are forward-declared in
-// attribute.h. Defining the destructor and copy/move ops here ensures the
-// shared_ptr destructors are emitted in a TU where the pointee types are
+// All special members are defined out-of-line because the payload's strong
+// references (shared_ptr<implementation::Buffer>,
+// shared_ptr<implementation::Image>, shared_ptr<ArgumentBuffer>) reference
+// types that are forward-declared in attribute.h. Defining them here ensures
+// the shared_ptr destructors are emitted in a TU where the pointee types are
 // complete.
 
-Attribute::Attribute() : _type(Type_Unknown), _count(0), _u{}, _u64{} {}
+Attribute::Attribute() : _type(Type_Unknown), _count(0) {}
+
+Attribute::~Attribute() { releasePayload(); }
+
+Attribute::Attribute(const Attribute& other)
+    : _type(Type_Unknown),
+      _count(other._count),
+      _access(other._access),
+      _sampler(other._sampler) {
+  copyPayload(other);
+}
+
+Attribute::Attribute(Attribute&& other) noexcept
+    : _type(Type_Unknown),
+      _count(other._count),
+      _access(other._access),
+      _sampler(other._sampler) {
+  movePayload(other);
+}
+
+Attribute& Attribute::operator=(const Attribute& other) {
+  if (this != &other) {
+    releasePayload();
+    _count = other._count;
+    _access = other._access;
+    _sampler = other._sampler;
+    copyPayload(other);
+  }
+  return *this;
+}
 
-Attribute::~Attribute() = default;
-Attribute::Attribute(const Attribute&) = default;
-Attribute::Attribute(Attribute&&) noexcept = default;
-Attribute& Attribute::operator=(const Attribute&) = default;
-Attribute& Attribute::operator=(Attribute&&) noexcept = default;
+Attribute& Attribute::operator=(Attribute&& other) noexcept {
+  if (this != &other) {
+    releasePayload();
+    _count = other._count;
+    _access = other._access;
+    _sampler = other._sampler;
+    movePayload(other);
+  }
+  return *this;
+}
 
-Attribute::Attribute(char* s) : _type(Type_String), _count(1), _s(s) {}
+void Attribute::releasePayload() {
+  switch (_type) {
+    case Type_String:
+      _p.s.~basic_string();
+      break;
+    case Type_Buffer:
+      _p.buffer.~shared_ptr();
+      break;
+    case Type_Image:
+      _p.image.~shared_ptr();
+      break;
+    case Type_ArgumentBuffer:
+      _p.argBuffer.~shared_ptr();
+      break;
+    default:
+      return;
+  }
+  _type = Type_Unknown;
+  new (&_p.v) Values{};
+}
 
-Attribute::Attribute(const char* s) : _type(Type_String), _count(1), _s(s) {}
+// Both expect the payload to hold values (freshly constructed or released).
+void Attribute::copyPayload(const Attribute& other) {
+  switch (other._type) {
+    case Type_String:
+      new (&_p.s) std::string(other._p.s);
+      break;
+    case Type_Buffer:
+      new (&_p.buffer) std::shared_ptr<implementation::Buffer>(other._p.buffer);
+      break;
+    case Type_Image:
+      new (&_p.image) std::shared_ptr<implementation::Image>(other._p.image);
+      break;
+    case Type_ArgumentBuffer:
+      new (&_p.argBuffer) std::shared_ptr<ArgumentBuffer>(other._p.argBuffer);
+      break;
+    default:
+      _p.v = other._p.v;
+      break;
+  }
+  _type = other._type;
+}
 
-Attribute::Attribute(const std::string& s)
-    : _type(Type_String), _count(1), _s(s) {}
+void Attribute::movePayload(Attribute& other) {
+  switch (other._type) {
+    case Type_String:
+      new (&_p.s) std::string(std::move(other._p.s));
+      break;
+    case Type_Buffer:
+      new (&_p.buffer)
+          std::shared_ptr<implementation::Buffer>(std::move(other._p.buffer));
+      break;
+    case Type_Image:
+      new (&_p.image)
+          std::shared_ptr<implementation::Image>(std::move(other._p.image));
+      break;
+    case Type_ArgumentBuffer:
+      new (&_p.argBuffer)
+          std::shared_ptr<ArgumentBuffer>(std::move(other._p.argBuffer));
+      break;
+    default:
+      _p.v = other._p.v;
+      break;
+  }
+  _type = other._type;
+}
+
+Attribute::Attribute(char* s) : _type(Type_String), _count(1) {
+  new (&_p.s) std::string(s);
+}
+
+Attribute::Attribute(const char* s) : _type(Type_String), _count(1) {
+  new (&_p.s) std::string(s);
+}
+
+Attribute::Attribute(const std::string& s) : _type(Type_String), _count(1) {
+  new (&_p.s) std::string(s);
+}
 
 Attribute::Attribute(Buffer* b) : _type(Type_Buffer), _count(1) {
-  if (b) _bufferImpl = b->impl();
+  new (&_p.buffer) std::shared_ptr<implementation::Buffer>(
+      b ? b->impl() : nullptr);
 }
 
-Attribute::Attribute(Buffer& b)
-    : _type(Type_Buffer), _count(1), _bufferImpl(b.impl()) {}
+Attribute::Attribute(Buffer& b) : _type(Type_Buffer), _count(1) {
+  new (&_p.buffer) std::shared_ptr<implementation::Buffer>(b.impl());
+}
 
 Attribute::Attribute(Image* i) : _type(Type_Image), _count(1) {
-  if (i) _imageImpl = i->impl();
+  new (&_p.image) std::shared_ptr<implementation::Image>(
+      i ? i->impl() : nullptr);
 }
 
-Attribute::Attribute(Image& i)
-    : _type(Type_Image), _count(1), _imageImpl(i.impl()) {}
+Attribute::Attribute(Image& i) : _type(Type_Image), _count(1) {
+  new (&_p.image) std::shared_ptr<implementation::Image>(i.impl());
+}
 
 Attribute::Attribute(Image& i, const SamplerDescription& sampler)
-    : _type(Type_Image), _count(1), _imageImpl(i.impl()), _sampler(sampler) {}
+    : _type(Type_Image), _count(1), _sampler(sampler) {
+  new (&_p.image) std::shared_ptr<implementation::Image>(i.impl());
+}
 
 Attribute::Attribute(ArgumentBuffer* ab)
     : _type(Type_ArgumentBuffer), _count(1) {
-  if (ab) _argBuffer = std::make_shared<ArgumentBuffer>(*ab);
+  new (&_p.argBuffer) std::shared_ptr<ArgumentBuffer>(
+      ab ? std::make_shared<ArgumentBuffer>(*ab) : nullptr);
 }
 
 Attribute::Attribute(ArgumentBuffer& ab)
-    : _type(Type_ArgumentBuffer),
-      _count(1),
-      _argBuffer(std::make_shared<ArgumentBuffer>(ab)) {}
+    : _type(Type_ArgumentBuffer), _count(1) {
+  new (&_p.argBuffer)
+      std::shared_ptr<ArgumentBuffer>(std::make_shared<ArgumentBuffer>(ab));
+}
 
 Attribute::Attribute(const SamplerDescription& sampler)
     : _type(Type_Sampler), _count(1), _sampler(sampler) {}
@@ -0,0 +1,350 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include <ghost/autotuner.h>
+#include <ghost/digest.h>
+#include <ghost/event.h>
+#include <ghost/implementation/impl_device.h>
+#include <ghost/kernel_source.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace ghost {
+
+namespace {
+// First line of a results file. Files with another header are ignored.
+const char* const kResultsHeader = "ghost-autotune 1";
+
+size_t attributeSize(const Attribute& attr, size_t fallback) {
+  if (attr.type() == Attribute::Type_Int) {
+    return attr.asInt() > 0 ? size_t(attr.asInt()) : fallback;
+  }
+  if (attr.type() == Attribute::Type_UInt) {
+    return attr.asUInt() > 0 ? size_t(attr.asUInt()) : fallback;
+  }
+  return fallback;
+}
+
+size_t roundUpPow2(size_t v) {
+  size_t p = 1;
+  while (p < v) p <<= 1;
+  return p;
+}
+
+bool sameLocal(const LaunchArgs& a, const LaunchArgs& b) {
+  for (size_t i = 0; i < 3; i++) {
+    if (a.local_size()[i] != b.local_size()[i]) return false;
+  }
+  return true;
+}
+
+LaunchArgs withLocal(const LaunchArgs& base, size_t dims, const size_t* l) {
+  LaunchArgs la = base;
+  if (dims == 1) {
+    la.local_size(l[0]);
+  } else if (dims == 2) {
+    la.local_size(l[0], l[1]);
+  } else {
+    la.local_size(l[0], l[1], l[2]);
+  }
+  return la;
+}
+}  // namespace
+
+Autotuner::Autotuner() {}
+
+Autotuner::Autotuner(const Options& options) : _options(options) { load(); }
+
+std::vector<LaunchArgs> Autotuner::localSizeCandidates(
+    const Function& function, const LaunchArgs& launchArgs) {
+  std::vector<LaunchArgs> candidates;
+  const size_t dims = std::max<size_t>(launchArgs.dims(), 1);
+  auto add = [&](const LaunchArgs& la) {
+    for (auto& c : candidates) {
+      if (sameLocal(c, la)) return;
+    }
+    candidates.push_back(la);
+  };
+  if (launchArgs.is_local_defined()) add(launchArgs);
+
+  Attribute required = function.getAttribute(kFunctionRequiredWorkSize);
+  if (required.count() >= 3 && required.asInt() > 0) {
+    const int32_t* r = required.intArray();
+    size_t l[3] = {size_t(r[0]), size_t(std::max(r[1], 1)),
+                   size_t(std::max(r[2], 1))};
+    candidates.clear();
+    candidates.push_back(withLocal(launchArgs, dims, l));
+    return candidates;
+  }
+
+  const size_t maxThreads =
+      attributeSize(function.getAttribute(kFunctionMaxThreads), 256);
+  const size_t multiple = attributeSize(
+      function.getAttribute(kFunctionPreferredWorkMultiple), 1);
+  const size_t* global = launchArgs.global_size();
+
+  if (dims == 1) {
+    // Stop once a single group covers the whole global size.
+    const size_t cover = (global[0] + multiple - 1) / multiple * multiple;
+    for (size_t x = multiple; x <= maxThreads; x *= 2) {
+      size_t l[3] = {x, 1, 1};
+      add(withLocal(launchArgs, dims, l));
+      if (x >= cover) break;
+    }
+  } else {
+    const size_t minThreads = std::max(multiple, maxThreads / 4);
+    const size_t coverX = roundUpPow2(global[0]);
+    const size_t coverY = roundUpPow2(global[1]);
+    for (size_t x = 1; x <= maxThreads; x *= 2) {
+      for (size_t y = 1; x * y <= maxThreads; y *= 2) {
+        if (x * y < minThreads || x * y % multiple != 0) continue;
+        if ((x > coverX && x > multiple) || (y > coverY && y > 1)) continue;
+        size_t l[3] = {x, y, 1};
+        add(withLocal(launchArgs, dims, l));
+      }
+    }
+  }
+  if (candidates.empty()) {
+    size_t l[3] = {std::min(multiple, maxThreads), 1, 1};
+    add(withLocal(launchArgs, dims, l));
+  }
+  return candidates;
+}
+
+double Autotuner::measure(Stream& stream, Function& function,
+                          const LaunchArgs& launchArgs,
+                          const std::vector<Attribute>& args) const {
+  for (unsigned i = 0; i < _options.warmup; i++) {
+    function.execute(stream, launchArgs, args);
+  }
+  stream.sync();
+
+  std::vector<double> times;
+  const unsigned iterations = std::max(_options.iterations, 1u);
+  for (unsigned i = 0; i < iterations; i++) {
+    auto hostStart = std::chrono::steady_clock::now();
+    Event start = stream.record();
+    function.execute(stream, launchArgs, args);
+    Event end = stream.record();
+    stream.sync();
+    double seconds = Event::elapsed(start, end);
+    if (seconds <= 0) {
+      // No event timing on this backend or stream.
+      seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - hostStart)
+                    .count();
+    }
+    times.push_back(seconds);
+  }
+  std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                   times.end());
+  return times[times.size() / 2];
+}
+
+Autotuner::Result Autotuner::tune(Device& device, Stream& stream,
+                                  const std::string& name,
+                                  const Function& function,
+                                  const LaunchArgs& launchArgs,
+                                  const std::vector<Attribute>& args) {
+  return tune(device, stream, name, std::vector<Function>{function},
+              launchArgs, args);
+}
+
+Autotuner::Result Autotuner::tune(Device& device, Stream& stream,
+                                  const std::string& name,
+                                  const std::vector<Function>& variants,
+                                  const LaunchArgs& launchArgs,
+                                  const std::vector<Attribute>& args) {
+  Result result;
+  if (find(device, name, launchArgs, variants.size(), result)) return result;
+
+  bool found = false;
+  Entry best{};
+  for (size_t v = 0; v < variants.size(); v++) {
+    Function function = variants[v];
+    for (auto& candidate : localSizeCandidates(function, launchArgs)) {
+      double seconds;
+      try {
+        seconds = measure(stream, function, candidate, args);
+      } catch (const std::exception&) {
+        // The backend rejected this configuration (too many resources,
+        // global size not a multiple of the local size, ...).
+        stream.sync();
+        continue;
+      }
+      if (!found || seconds < best.seconds) {
+        found = true;
+        best.variant = v;
+        best.dims = candidate.dims();
+        std::copy(candidate.local_size(), candidate.local_size() + 3,
+                  best.local);
+        best.seconds = seconds;
+      }
+    }
+  }
+  if (!found) {
+    throw std::runtime_error("Autotuner: no candidate for '" + name +
+                             "' could be dispatched");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _results[makeKey(device, name, launchArgs, variants.size())] = best;
+  }
+  if (_options.autoSave && !_options.path.empty()) save();
+  return toResult(best, launchArgs, false);
+}
+
+Autotuner::Result Autotuner::tune(
+    Device& device, Stream& stream, const std::string& name,
+    KernelSource& source, const std::string& functionName,
+    const std::vector<std::vector<std::pair<std::string, Attribute>>>&
+        variants,
+    const LaunchArgs& launchArgs, const std::vector<Attribute>& args) {
+  Result result;
+  if (find(device, name, launchArgs, variants.size(), result)) return result;
+
+  std::vector<Function> functions;
+  functions.reserve(variants.size());
+  for (auto& constants : variants) {
+    functions.push_back(source.getFunction(device, functionName, constants));
+  }
+  return tune(device, stream, name, functions, launchArgs, args);
+}
+
+bool Autotuner::find(const Device& device, const std::string& name,
+                     const LaunchArgs& launchArgs, size_t variantCount,
+                     Result& result) const {
+  std::string key = makeKey(device, name, launchArgs, variantCount);
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _results.find(key);
+  if (it == _results.end() || it->second.variant >= variantCount) {
+    return false;
+  }
+  result = toResult(it->second, launchArgs, true);
+  return true;
+}
+
+void Autotuner::clear() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _results.clear();
+}
+
+std::string Autotuner::makeKey(const Device& device, const std::string& name,
+                               const LaunchArgs& launchArgs,
+                               size_t variantCount) {
+  Digest d;
+  d.update(device.impl()->fingerprint().digest, Digest::length);
+  d.update(name.data(), name.size());
+  uint64_t shape[5] = {uint64_t(launchArgs.dims()),
+                       uint64_t(launchArgs.global_size()[0]),
+                       uint64_t(launchArgs.global_size()[1]),
+                       uint64_t(launchArgs.global_size()[2]),
+                       uint64_t(variantCount)};
+  d.update(shape, sizeof(shape));
+  return d.get();
+}
+
+Autotuner::Result Autotuner::toResult(const Entry& entry,
+                                      const LaunchArgs& launchArgs,
+                                      bool cached) {
+  Result result;
+  result.launchArgs = withLocal(launchArgs, entry.dims, entry.local);
+  result.variant = entry.variant;
+  result.seconds = entry.seconds;
+  result.cached = cached;
+  return result;
+}
+
+void Autotuner::readResults(const fs::path& path,
+                            std::unordered_map<std::string, Entry>& results) {
+  std::ifstream in(path);
+  std::string line;
+  if (!in || !std::getline(in, line) || line != kResultsHeader) return;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    Entry entry;
+    if (!(fields >> key >> entry.variant >> entry.dims >> entry.local[0] >>
+          entry.local[1] >> entry.local[2] >> entry.seconds)) {
+      continue;
+    }
+    if (entry.dims < 1 || entry.dims > 3) continue;
+    results.emplace(key, entry);
+  }
+}
+
+void Autotuner::load() {
+  if (_options.path.empty()) return;
+  std::lock_guard<std::mutex> lock(_mutex);
+  readResults(_options.path, _results);
+}
+
+bool Autotuner::save() const {
+  if (_options.path.empty()) return false;
+  // Keep results other processes (or devices) saved since we loaded; ours
+  // win where both have a key.
+  std::unordered_map<std::string, Entry> merged;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    merged = _results;
+  }
+  readResults(_options.path, merged);
+
+  std::ostringstream out;
+  out.precision(9);
+  out << kResultsHeader << '\n';
+  for (auto& r : merged) {
+    const Entry& e = r.second;
+    out << r.first << ' ' << e.variant << ' ' << e.dims << ' ' << e.local[0]
+        << ' ' << e.local[1] << ' ' << e.local[2] << ' ' << e.seconds << '\n';
+  }
+
+  // Write a uniquely named temporary file and rename it over the results,
+  // so a reader never sees a partial file.
+  std::error_code ec;
+  if (_options.path.has_parent_path()) {
+    fs::create_directories(_options.path.parent_path(), ec);
+  }
+  fs::path tmp = _options.path;
+  tmp += "." +
+         std::to_string(
+             std::chrono::steady_clock::now().time_since_epoch().count()) +
+         ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file << out.str();
+    if (!file.flush()) {
+      file.close();
+      fs::remove(tmp, ec);
+      return false;
+    }
+  }
+  fs::rename(tmp, _options.path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace ghost
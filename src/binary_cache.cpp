@@ -17,20 +17,759 @@
 #include <ghost/digest.h>
 #include <ghost/implementation/impl_function.h>
 #include <ghost/io.h>
+#include <ctype.h>
 #include <string.h>
 #include <time.h>
 
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace ghost {
 
 namespace fs = std::filesystem;
 
+namespace {
+typedef std::shared_ptr<const BinaryCache::CachedBinaries> CachedPtr;
+
+// Process-wide LRU of verified cache entries, keyed by the entry digest. The
+// digest already covers the device identity, source and options, so an entry
+// is valid for any device and cache directory that produces the same key.
+// Entries loaded from disk hold the file mapping; saved entries hold a copy.
+class MemoryTier {
+ public:
+  CachedPtr find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it == _index.end()) return nullptr;
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return it->second->cached;
+  }
+
+  void insert(const std::string& key, CachedPtr cached, size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (bytes > _limit) return;
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+      _bytes -= it->second->bytes;
+      _lru.erase(it->second);
+      _index.erase(it);
+    }
+    _lru.push_front(Entry{key, std::move(cached), bytes});
+    _index[key] = _lru.begin();
+    _bytes += bytes;
+    trimLocked(_limit);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    trimLocked(0);
+  }
+
+  void setLimit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _limit = bytes;
+    trimLocked(bytes);
+  }
+
+  size_t limit() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _limit;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    CachedPtr cached;
+    size_t bytes;
+  };
+
+  void trimLocked(size_t keep) {
+    while (_bytes > keep && !_lru.empty()) {
+      auto& last = _lru.back();
+      _bytes -= last.bytes;
+      _index.erase(last.key);
+      _lru.pop_back();
+    }
+  }
+
+  mutable std::mutex _mutex;
+  size_t _limit = size_t(64) << 20;
+  size_t _bytes = 0;
+  // Most recently used at the front.
+  std::list<Entry> _lru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+};
+
+MemoryTier& memoryTier() {
+  static MemoryTier tier;
+  return tier;
+}
+
+void memoize(const std::string& key, CachedPtr cached) {
+  size_t bytes = 0;
+  for (size_t size : cached->sizes) bytes += size;
+  memoryTier().insert(key, std::move(cached), bytes);
+}
+
+unsigned long currentProcessId() {
+#if defined(_WIN32)
+  return (unsigned long)_getpid();
+#else
+  return (unsigned long)getpid();
+#endif
+}
+
+int64_t millisecondsSinceEpoch() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Write @p path through a unique staging file in the same directory and a
+// rename, so readers in this or any other process see either the old file or
+// the complete new one, never a torn one. @p write produces the contents and
+// may throw to abandon the file.
+bool publishFile(const fs::path& path,
+                 const std::function<void(FileWrapper&)>& write) {
+  static std::atomic<uint64_t> sequence{0};
+  std::error_code ec;
+  fs::path staging = path;
+  staging += ".tmp-" + std::to_string(currentProcessId()) + "-" +
+             std::to_string(sequence++);
+  bool written = false;
+  try {
+    FileWrapper file;
+    file = fopen(staging.string().c_str(), "wb");
+    if (file.okay()) {
+      write(file);
+      file.close();
+      written = true;
+    }
+  } catch (const std::exception&) {
+    // Best effort: a failed write only costs a recompile next time.
+  }
+  if (written) fs::rename(staging, path, ec);
+  if (!written || ec) {
+    fs::remove(staging, ec);
+    return false;
+  }
+  return true;
+}
+
+bool publishFile(const fs::path& path, const void* bytes, size_t size) {
+  return publishFile(path,
+                     [&](FileWrapper& file) { file.write(bytes, size); });
+}
+
+// Append-only usage log for one cache directory, used when a byte budget is
+// set. Each fixed-size record either upserts an entry's file size and last
+// use time or removes it, so replaying the log rebuilds the LRU state without
+// listing the directory. Other processes append to the same file; the tail is
+// re-read before any eviction decision, and a compaction (which rewrites the
+// file under a new generation) triggers a full reload.
+class CacheIndex {
+ public:
+  explicit CacheIndex(fs::path dir)
+      : _dir(std::move(dir)), _path(_dir / "ghost-cache.index") {}
+
+  // Record a use of @p name. Touching the entry that is already the most
+  // recently used changes nothing and is not logged.
+  void touch(const std::string& name, uint64_t size) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    refresh();
+    auto it = _entries.find(name);
+    if (it != _entries.end() && it->second.size == size &&
+        it->second.time == _newest)
+      return;
+    // Strictly increasing, so uses within one clock tick keep their order.
+    append(name, size, std::max(millisecondsSinceEpoch(), _newest + 1));
+  }
+
+  // Evict least recently used entries until the directory is within
+  // @p budget bytes. Evicts down to 7/8 of the budget so that a cache at its
+  // limit does not evict on every save.
+  void enforce(uint64_t budget) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    refresh();
+    if (_total <= budget) return;
+    evictWhile([&](const Entry&) { return _total > budget / 8 * 7; });
+  }
+
+  // Remove entries last used before @p cutoff (ms since the epoch).
+  void purge(int64_t cutoff) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    refresh();
+    evictWhile([&](const Entry& e) { return e.time < cutoff; });
+  }
+
+  // Bytes of all tracked entries.
+  uint64_t totalBytes() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    refresh();
+    return _total;
+  }
+
+ private:
+  struct Entry {
+    uint64_t size;
+    int64_t time;
+  };
+
+  // On-disk layout: a header, then records appended in order. A record with
+  // size 0 removes the entry (a cache file is never empty).
+  struct Header {
+    char magic[8];
+    uint64_t generation;
+  };
+  struct Record {
+    char name[GHOST_DIGEST_FILENAME_LENGTH];
+    uint64_t size;
+    int64_t time;
+  };
+
+  template <typename Pred>
+  void evictWhile(Pred pred) {
+    std::vector<std::pair<int64_t, std::string>> order;
+    order.reserve(_entries.size());
+    for (auto& e : _entries) order.emplace_back(e.second.time, e.first);
+    std::sort(order.begin(), order.end());
+    std::error_code ec;
+    for (auto& o : order) {
+      auto it = _entries.find(o.second);
+      if (it == _entries.end()) continue;
+      if (!pred(it->second)) break;
+      fs::remove(_dir / o.second, ec);
+      append(o.second, 0, o.first);
+    }
+  }
+
+  void apply(const Record& r) {
+    std::string name(r.name, sizeof(r.name));
+    auto it = _entries.find(name);
+    if (it != _entries.end()) {
+      _total -= it->second.size;
+      _entries.erase(it);
+    }
+    if (r.size != 0) {
+      _entries[name] = Entry{r.size, r.time};
+      _total += r.size;
+      _newest = std::max(_newest, r.time);
+    }
+    _records++;
+  }
+
+  void append(const std::string& name, uint64_t size, int64_t time) {
+    Record r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.name, name.data(), std::min(name.size(), sizeof(r.name)));
+    r.size = size;
+    r.time = time;
+    apply(r);
+    if (_offset == 0 || _records > 2 * _entries.size() + 1024) {
+      compact();
+      return;
+    }
+    // _offset is left alone: the next refresh re-reads this record along
+    // with anything other processes appended before it, and re-applying an
+    // upsert or removal is harmless.
+    try {
+      FileWrapper file;
+      file = fopen(_path.string().c_str(), "ab");
+      file.write(&r, sizeof(r));
+    } catch (const std::exception&) {
+      // The index is advisory; losing a record only delays an eviction.
+    }
+  }
+
+  // Bring the in-memory state up to date with the log.
+  void refresh() {
+    FileWrapper file;
+    file = fopen(_path.string().c_str(), "rb");
+    if (!file.okay()) {
+      // No log yet, or the directory was wiped: start over from a listing.
+      reset();
+      rebuild();
+      return;
+    }
+    Header header;
+    try {
+      file.read(&header, sizeof(header));
+    } catch (const std::exception&) {
+      return;
+    }
+    if (memcmp(header.magic, kMagic, sizeof(header.magic)) != 0) return;
+    if (_offset == 0 || header.generation != _generation) {
+      reset();
+      _offset = sizeof(header);
+      _generation = header.generation;
+    }
+    Record r;
+    try {
+      file.seek(_offset);
+      for (;;) {
+        file.read(&r, sizeof(r));
+        apply(r);
+        _offset += sizeof(r);
+      }
+    } catch (const std::exception&) {
+      // End of log, or a record still being appended by another process.
+    }
+  }
+
+  void reset() {
+    _entries.clear();
+    _total = 0;
+    _newest = 0;
+    _records = 0;
+    _offset = 0;
+  }
+
+  // First use of a directory without a log: list it once and write a
+  // compacted log, so existing caches are adopted.
+  void rebuild() {
+    std::error_code ec;
+    if (!fs::is_directory(_dir, ec)) return;
+    for (const auto& e : fs::directory_iterator(_dir, ec)) {
+      std::string name = e.path().filename().string();
+      if (name.size() != GHOST_DIGEST_FILENAME_LENGTH) continue;
+      std::error_code ec2;
+      auto size = e.file_size(ec2);
+      if (ec2 || size == 0) continue;
+      auto mtime = fs::last_write_time(e.path(), ec2);
+      int64_t time = millisecondsSinceEpoch();
+      if (!ec2) {
+        time -= std::chrono::duration_cast<std::chrono::milliseconds>(
+                    fs::file_time_type::clock::now() - mtime)
+                    .count();
+      }
+      _entries[name] = Entry{uint64_t(size), time};
+      _total += size;
+      _newest = std::max(_newest, time);
+    }
+    compact();
+  }
+
+  // Rewrite the log with one record per live entry under a new generation.
+  void compact() {
+    Header header;
+    memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.generation =
+        (uint64_t(millisecondsSinceEpoch()) << 16) ^ currentProcessId() ^
+        (_generation + 1);
+    std::vector<unsigned char> image(sizeof(header) +
+                                     _entries.size() * sizeof(Record));
+    memcpy(image.data(), &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (auto& e : _entries) {
+      Record r;
+      memset(&r, 0, sizeof(r));
+      memcpy(r.name, e.first.data(), sizeof(r.name));
+      r.size = e.second.size;
+      r.time = e.second.time;
+      memcpy(image.data() + offset, &r, sizeof(r));
+      offset += sizeof(r);
+    }
+    std::error_code ec;
+    fs::create_directories(_dir, ec);
+    if (!publishFile(_path, image.data(), image.size())) return;
+    _generation = header.generation;
+    _offset = image.size();
+    _records = _entries.size();
+  }
+
+  static constexpr char kMagic[8] = {'G', 'H', 'S', 'T', 'I', 'D', 'X', '1'};
+
+  std::mutex _mutex;
+  fs::path _dir;
+  fs::path _path;
+  std::unordered_map<std::string, Entry> _entries;
+  uint64_t _total = 0;
+  // Last-use time of the most recently used entry.
+  int64_t _newest = 0;
+  uint64_t _offset = 0;
+  uint64_t _generation = 0;
+  // Records applied since the last compaction.
+  size_t _records = 0;
+};
+
+// Usage logs for every cache directory in use, by path.
+struct CacheIndexes {
+  std::mutex mutex;
+  std::unordered_map<std::string, std::unique_ptr<CacheIndex>> indexes;
+};
+
+CacheIndexes& cacheIndexes() {
+  static CacheIndexes indexes;
+  return indexes;
+}
+
+CacheIndex& cacheIndex(const fs::path& dir) {
+  auto& all = cacheIndexes();
+  std::lock_guard<std::mutex> lock(all.mutex);
+  auto& index = all.indexes[dir.string()];
+  if (!index) index.reset(new CacheIndex(dir));
+  return *index;
+}
+
+// Entry locks claimed in this process, by lock file path, so that a save of
+// a claimed entry can hold on to the lock until its file is published.
+struct HeldLocks {
+  std::mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<FileLock>> locks;
+};
+
+HeldLocks& heldLocks() {
+  static HeldLocks held;
+  return held;
+}
+
+std::shared_ptr<FileLock> findHeldLock(const std::string& path) {
+  auto& held = heldLocks();
+  std::lock_guard<std::mutex> lock(held.mutex);
+  auto it = held.locks.find(path);
+  return it != held.locks.end() ? it->second : nullptr;
+}
+
+fs::path lockPath(const fs::path& dir, const std::string& name) {
+  return dir / (name + ".lock");
+}
+
+// Counters for the whole process, and for the calling thread so that a
+// caller can tell what its own load did.
+struct StatsRegistry {
+  std::mutex mutex;
+  BinaryCache::Stats stats;
+};
+
+StatsRegistry& statsRegistry() {
+  static StatsRegistry registry;
+  return registry;
+}
+
+thread_local BinaryCache::Stats threadStats;
+
+template <typename Update>
+void countStats(Update update) {
+  update(threadStats);
+  auto& registry = statsRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  update(registry.stats);
+}
+
+// Cache files used through the memory tier since the writer last recorded
+// them in their directory's index, by path.
+struct PendingUses {
+  std::mutex mutex;
+  std::unordered_set<std::string> files;
+};
+
+PendingUses& pendingUses() {
+  static PendingUses pending;
+  return pending;
+}
+
+// Single background thread that runs cache file I/O (publishing entries and
+// maintaining the index) off the compiling and loading threads.
+class CacheWriter {
+ public:
+  ~CacheWriter() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_all();
+    if (_thread.joinable()) _thread.join();
+  }
+
+  void enqueue(std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(job));
+    if (!_thread.joinable()) _thread = std::thread([this] { run(); });
+    _wake.notify_all();
+  }
+
+  void flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this] { return _jobs.empty() && !_busy; });
+  }
+
+ private:
+  void run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+      _wake.wait(lock, [this] { return _stop || !_jobs.empty(); });
+      if (_jobs.empty()) return;
+      auto job = std::move(_jobs.front());
+      _jobs.pop_front();
+      _busy = true;
+      lock.unlock();
+      job();
+      // Drop the captures (an entry lock, say) before reporting idle.
+      job = nullptr;
+      lock.lock();
+      _busy = false;
+      if (_jobs.empty()) _idle.notify_all();
+    }
+  }
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _idle;
+  std::deque<std::function<void()>> _jobs;
+  std::thread _thread;
+  bool _busy = false;
+  bool _stop = false;
+};
+
+CacheWriter& cacheWriter() {
+  // Statics are destroyed in reverse order of construction. Constructing
+  // what the jobs use first keeps it alive for the drain at exit.
+  cacheIndexes();
+  heldLocks();
+  statsRegistry();
+  pendingUses();
+  static CacheWriter writer;
+  return writer;
+}
+
+// Record a use of the cache file @p name in @p dir. Uses queue up until the
+// writer gets to them, so repeated hits on a hot entry cost one index update
+// per writer pass rather than one job each.
+void recordUse(const fs::path& dir, const std::string& name) {
+  auto& pending = pendingUses();
+  {
+    std::lock_guard<std::mutex> lock(pending.mutex);
+    bool queued = !pending.files.empty();
+    pending.files.insert((dir / name).string());
+    if (queued) return;
+  }
+  cacheWriter().enqueue([]() {
+    std::unordered_set<std::string> files;
+    {
+      auto& pending = pendingUses();
+      std::lock_guard<std::mutex> lock(pending.mutex);
+      files.swap(pending.files);
+    }
+    for (auto& file : files) {
+      fs::path path = file;
+      std::error_code ec;
+      uint64_t size = fs::file_size(path, ec);
+      // Entries served from a pack, or evicted since, have no file to track.
+      if (ec) continue;
+      cacheIndex(path.parent_path()).touch(path.filename().string(), size);
+    }
+  });
+}
+
+uint64_t readU64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+enum class ParseResult { Ok, WrongDevice, Corrupt };
+
+// Validate one serialized entry (device digest, content digest, count,
+// count sizes, blobs) of @p size bytes at @p p and point @p entry at its
+// blobs. The structure is checked against the length before any blob is
+// touched, so a truncated or torn entry is rejected without hashing it.
+ParseResult parseEntry(const unsigned char* p, size_t size, size_t count,
+                       const uint8_t* deviceDigest, bool verify,
+                       BinaryCache::CachedBinaries& entry) {
+  size_t header = 2 * Digest::length + sizeof(uint64_t);
+  if (count == 0 || size < header) return ParseResult::Corrupt;
+  if (memcmp(deviceDigest, p, Digest::length) != 0)
+    return ParseResult::WrongDevice;
+  const unsigned char* contentDigest = p + Digest::length;
+  if (readU64(p + 2 * Digest::length) != count) return ParseResult::Corrupt;
+  if (size - header < count * sizeof(uint64_t)) return ParseResult::Corrupt;
+  header += count * sizeof(uint64_t);
+
+  entry.binaries.resize(count);
+  entry.sizes.resize(count);
+  size_t offset = header;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t v = readU64(p + 2 * Digest::length + (i + 1) * sizeof(uint64_t));
+    if (v > size - offset) return ParseResult::Corrupt;
+    entry.binaries[i] = p + offset;
+    entry.sizes[i] = size_t(v);
+    offset += size_t(v);
+  }
+  if (offset != size) return ParseResult::Corrupt;
+
+  if (verify) {
+    uint8_t digest[Digest::length];
+    Digest b;
+    for (size_t i = 0; i < count; i++) {
+      if (entry.sizes[i] > 0) b.update(entry.binaries[i], entry.sizes[i]);
+    }
+    b.get(digest);
+    if (memcmp(digest, contentDigest, sizeof(digest)) != 0)
+      return ParseResult::Corrupt;
+  }
+  return ParseResult::Ok;
+}
+
+// Count a rejected entry; returns whether @p result accepted it.
+bool accepted(ParseResult result, size_t size) {
+  switch (result) {
+    case ParseResult::Ok:
+      countStats([&](BinaryCache::Stats& s) {
+        s.hits++;
+        s.bytesRead += size;
+      });
+      return true;
+    case ParseResult::WrongDevice:
+      countStats([](BinaryCache::Stats& s) { s.deviceMismatches++; });
+      break;
+    case ParseResult::Corrupt:
+      countStats([](BinaryCache::Stats& s) { s.corruptEntries++; });
+      break;
+  }
+  return false;
+}
+
+// Pack archive: serialized entries (each padded to 8 bytes so blobs stay
+// word aligned in the mapping), then an index of fixed-size records sorted
+// by name, then a trailer. Packs are always written whole, so they hold no
+// dead space.
+struct PackRecord {
+  char name[GHOST_DIGEST_FILENAME_LENGTH];
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct PackTrailer {
+  char magic[8];
+  uint64_t indexOffset;
+  uint64_t count;
+};
+
+const char kPackMagic[8] = {'G', 'H', 'S', 'T', 'P', 'A', 'K', '1'};
+
+// A mapped pack archive.
+class PackArchive {
+ public:
+  bool open(const fs::path& path) {
+    if (!_file.open(path.string().c_str())) return false;
+    if (_file.size() < sizeof(PackTrailer)) return false;
+    memcpy(&_trailer, _file.data() + _file.size() - sizeof(PackTrailer),
+           sizeof(PackTrailer));
+    if (memcmp(_trailer.magic, kPackMagic, sizeof(kPackMagic)) != 0)
+      return false;
+    uint64_t indexBytes = _trailer.count * sizeof(PackRecord);
+    if (_trailer.count > _file.size() / sizeof(PackRecord) ||
+        _trailer.indexOffset + indexBytes + sizeof(PackTrailer) !=
+            _file.size())
+      return false;
+    return true;
+  }
+
+  size_t count() const { return size_t(_trailer.count); }
+
+  PackRecord record(size_t i) const {
+    PackRecord r;
+    memcpy(&r, _file.data() + _trailer.indexOffset + i * sizeof(r),
+           sizeof(r));
+    return r;
+  }
+
+  // Binary search of the mapped index; no allocation.
+  bool find(const std::string& name, const unsigned char*& p,
+            size_t& size) const {
+    size_t lo = 0, hi = count();
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      PackRecord r = record(mid);
+      int cmp = memcmp(r.name, name.data(), sizeof(r.name));
+      if (cmp == 0) {
+        if (r.offset > _trailer.indexOffset ||
+            r.size > _trailer.indexOffset - r.offset)
+          return false;
+        p = _file.data() + r.offset;
+        size = size_t(r.size);
+        return true;
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return false;
+  }
+
+  const unsigned char* data() const { return _file.data(); }
+  size_t size() const { return _file.size(); }
+
+ private:
+  MappedFile _file;
+  PackTrailer _trailer;
+};
+
+std::mutex& packMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Archives are mapped once per process. A failed open is remembered too, so
+// a missing pack costs one attempt rather than one per lookup.
+std::unordered_map<std::string, std::shared_ptr<PackArchive>>& packArchives() {
+  static std::unordered_map<std::string, std::shared_ptr<PackArchive>> packs;
+  return packs;
+}
+
+std::shared_ptr<PackArchive> packArchive(const fs::path& path) {
+  std::lock_guard<std::mutex> lock(packMutex());
+  auto it = packArchives().find(path.string());
+  if (it != packArchives().end()) return it->second;
+  auto pack = std::make_shared<PackArchive>();
+  if (!pack->open(path)) pack.reset();
+  packArchives()[path.string()] = pack;
+  return pack;
+}
+
+void forgetPackArchive(const fs::path& path) {
+  std::lock_guard<std::mutex> lock(packMutex());
+  packArchives().erase(path.string());
+}
+
+bool isEntryName(const std::string& name) {
+  if (name.size() != GHOST_DIGEST_FILENAME_LENGTH) return false;
+  for (char c : name) {
+    if (!isxdigit((unsigned char)c)) return false;
+  }
+  return true;
+}
+}  // namespace
+
 std::string CompilerOptions::buildFlags() const {
   std::ostringstream result;
   result << flags;
@@ -67,21 +806,17 @@ void CompilerOptions::updateDigest(Digest& d) const {
   }
 }
 
-bool BinaryCache::isEnabled() const { return !cachePath.empty(); }
+bool BinaryCache::isEnabled() const {
+  return !cachePath.empty() || !packPath.empty();
+}
 
 void BinaryCache::makeDigest(Digest& d, const implementation::Device& dev,
                              size_t count, const void* data, size_t length,
                              const CompilerOptions& options) {
-  for (size_t i = 0; i < count; i++) {
-    std::string vendor = dev.getAttribute(kDeviceVendor).asString();
-    std::string name = dev.getAttribute(kDeviceName).asString();
-    std::string driverVersion =
-        dev.getAttribute(kDeviceDriverVersion).asString();
-    d.update(vendor.c_str(), vendor.size());
-    d.update(name.c_str(), name.size());
-    if (!driverVersion.empty())
-      d.update(driverVersion.c_str(), driverVersion.size());
-  }
+  // Hashing the concatenated identity is byte-for-byte the same stream as
+  // hashing vendor, name and driver version separately, so keys are stable.
+  const std::string& id = dev.fingerprint().identity;
+  for (size_t i = 0; i < count; i++) d.update(id.data(), id.size());
   options.updateDigest(d);
   if (data) d.update(data, length);
 }
@@ -109,54 +844,157 @@ bool BinaryCache::purgeFiles(const fs::path& dirname, int days) {
 void BinaryCache::purgeBinaries(const implementation::Device& dev,
                                 int days) const {
   if (cachePath.empty()) return;
-  purgeFiles(cachePath, days);
+  flush();
+  clearMemoryCache();
+  if (maxCacheBytes == 0) {
+    purgeFiles(cachePath, days);
+    return;
+  }
+  cacheIndex(cachePath).purge(millisecondsSinceEpoch() -
+                              int64_t(days) * 24 * 60 * 60 * 1000);
+  cacheIndex(cachePath).enforce(maxCacheBytes);
+}
+
+uint64_t BinaryCache::getCacheSize() const {
+  if (cachePath.empty() || maxCacheBytes == 0) return 0;
+  flush();
+  return cacheIndex(cachePath).totalBytes();
+}
+
+void BinaryCache::setMemoryCacheLimit(size_t bytes) {
+  memoryTier().setLimit(bytes);
+}
+
+size_t BinaryCache::getMemoryCacheLimit() { return memoryTier().limit(); }
+
+size_t BinaryCache::getMemoryCacheSize() { return memoryTier().size(); }
+
+void BinaryCache::clearMemoryCache() { memoryTier().clear(); }
+
+BinaryCache::Stats BinaryCache::getStats() {
+  auto& registry = statsRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  return registry.stats;
+}
+
+BinaryCache::Stats BinaryCache::getThreadStats() { return threadStats; }
+
+void BinaryCache::resetStats() {
+  auto& registry = statsRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.stats = Stats();
+}
+
+void BinaryCache::recordLibraryLoad(double seconds, bool fromCache) {
+  countStats([&](Stats& s) {
+    if (fromCache) {
+      s.cacheLoads++;
+      s.cacheLoadSeconds += seconds;
+    } else {
+      s.compiles++;
+      s.compileSeconds += seconds;
+    }
+  });
 }
 
 bool BinaryCache::loadBinaries(
     std::vector<std::vector<unsigned char>>& binaries,
     std::vector<size_t>& sizes, const implementation::Device& dev,
     const void* data, size_t length, const CompilerOptions& options) const {
-  if (cachePath.empty()) return false;
-  size_t count = (size_t)dev.getAttribute(kDeviceCount).asInt();
-  Digest f, d;
-  makeDigest(d, dev, count, nullptr, 0, CompilerOptions());
-  makeDigest(f, dev, count, data, length, options);
-  fs::path filePath =
-      cachePath / f.get().substr(0, GHOST_DIGEST_FILENAME_LENGTH);
-  FileWrapper file;
-  file = fopen(filePath.string().c_str(), "rb");
-  if (!file.okay()) return false;
-
-  uint8_t digest1[Digest::length];
-  uint8_t digest2[Digest::length];
-  d.get(digest1);
-  file.read(digest2, sizeof(digest2));
-  if (memcmp(digest1, digest2, sizeof(digest1)) != 0) return false;
-  file.read(digest2, sizeof(digest2));
+  CachedBinaries cached;
+  if (!loadBinaries(cached, dev, data, length, options)) return false;
+  binaries.resize(cached.binaries.size());
+  for (size_t i = 0; i < cached.binaries.size(); i++) {
+    binaries[i].assign(cached.binaries[i],
+                       cached.binaries[i] + cached.sizes[i]);
+  }
+  sizes = cached.sizes;
+  return true;
+}
 
-  uint64_t v;
-  size_t i;
-  file.read(&v, sizeof(v));
-  if (v == 0 || v != count) return false;
-  binaries.resize(size_t(v));
-  sizes.resize(size_t(v));
-  for (i = 0; i < sizes.size(); i++) {
-    file.read(&v, sizeof(v));
-    sizes[i] = size_t(v);
+bool BinaryCache::loadBinaries(CachedBinaries& cached,
+                               const implementation::Device& dev,
+                               const void* data, size_t length,
+                               const CompilerOptions& options) const {
+  return lookup(cached, dev, data, length, options, true);
+}
+
+bool BinaryCache::reloadBinaries(CachedBinaries& cached,
+                                 const implementation::Device& dev,
+                                 const void* data, size_t length,
+                                 const CompilerOptions& options) const {
+  if (!lookup(cached, dev, data, length, options, false)) return false;
+  countStats([](Stats& s) {
+    if (s.misses > 0) s.misses--;
+  });
+  return true;
+}
+
+bool BinaryCache::lookup(CachedBinaries& cached,
+                         const implementation::Device& dev, const void* data,
+                         size_t length, const CompilerOptions& options,
+                         bool countMiss) const {
+  if (!isEnabled()) return false;
+  auto& fingerprint = dev.fingerprint();
+  size_t count = fingerprint.count;
+  Digest f;
+  makeDigest(f, dev, count, data, length, options);
+  std::string key = f.get();
+  if (auto resident = memoryTier().find(key)) {
+    if (resident->sizes.size() != count) {
+      if (countMiss) countStats([](Stats& s) { s.misses++; });
+      return false;
+    }
+    countStats([](Stats& s) {
+      s.hits++;
+      s.memoryHits++;
+    });
+    // Keep the entry's file recent in the index, or eviction would pick the
+    // hottest entries first.
+    if (maxCacheBytes != 0 && !cachePath.empty()) {
+      recordUse(cachePath, key.substr(0, GHOST_DIGEST_FILENAME_LENGTH));
+    }
+    cached = *resident;
+    return true;
   }
-  for (i = 0; i < sizes.size(); i++) {
-    if (sizes[i] > 0) {
-      binaries[i].resize(sizes[i]);
-      file.read(&binaries[i][0], sizes[i]);
+  const uint8_t* deviceDigest = fingerprint.digest;
+  std::string name = key.substr(0, GHOST_DIGEST_FILENAME_LENGTH);
+  auto entry = std::make_shared<CachedBinaries>();
+
+  if (!packPath.empty()) {
+    if (auto pack = packArchive(packPath)) {
+      const unsigned char* p;
+      size_t size;
+      if (pack->find(name, p, size) &&
+          accepted(parseEntry(p, size, count, deviceDigest, verifyContents,
+                              *entry),
+                   size)) {
+        entry->owner = std::move(pack);
+        memoize(key, entry);
+        cached = *entry;
+        return true;
+      }
     }
   }
 
-  Digest b;
-  for (i = 0; i < sizes.size(); i++) {
-    if (!binaries[i].empty()) b.update(&binaries[i][0], binaries[i].size());
+  auto file = std::make_shared<MappedFile>();
+  if (cachePath.empty() || !file->open((cachePath / name).string().c_str()) ||
+      !accepted(parseEntry(file->data(), file->size(), count, deviceDigest,
+                           verifyContents, *entry),
+                file->size())) {
+    if (countMiss) countStats([](Stats& s) { s.misses++; });
+    return false;
+  }
+
+  if (maxCacheBytes != 0) {
+    fs::path dir = cachePath;
+    uint64_t size = file->size();
+    cacheWriter().enqueue(
+        [dir, name, size]() { cacheIndex(dir).touch(name, size); });
   }
-  b.get(digest1);
-  if (memcmp(digest1, digest2, sizeof(digest1)) != 0) return false;
+  entry->owner = std::move(file);
+  memoize(key, entry);
+  cached = *entry;
   return true;
 }
 
@@ -166,38 +1004,244 @@ void BinaryCache::saveBinaries(const implementation::Device& dev,
                                const void* data, size_t length,
                                const CompilerOptions& options) const {
   if (cachePath.empty()) return;
-  Digest f, d;
-  makeDigest(d, dev, binaries.size(), nullptr, 0, CompilerOptions());
+  Digest f, b;
   makeDigest(f, dev, binaries.size(), data, length, options);
-  size_t i;
+  std::string key = f.get();
+  size_t i, count = binaries.size();
+
+  // Serialize the whole file once. The background writer and the memory
+  // tier share the image, so the caller's buffers may go away on return.
+  size_t header = 2 * Digest::length + (count + 1) * sizeof(uint64_t);
+  size_t total = 0;
+  for (i = 0; i < count; i++) total += sizes[i];
+  auto image = std::make_shared<std::vector<unsigned char>>(header + total);
+  unsigned char* p = image->data();
+  auto& fingerprint = dev.fingerprint();
+  if (count == fingerprint.count) {
+    memcpy(p, fingerprint.digest, Digest::length);
+  } else {
+    Digest d;
+    makeDigest(d, dev, count, nullptr, 0, CompilerOptions());
+    d.get(p);
+  }
+  for (i = 0; i < count; i++) b.update(binaries[i], sizes[i]);
+  b.get(p + Digest::length);
+  uint64_t v = (uint64_t)count;
+  memcpy(p + 2 * Digest::length, &v, sizeof(v));
+  auto entry = std::make_shared<CachedBinaries>();
+  size_t offset = header;
+  for (i = 0; i < count; i++) {
+    v = (uint64_t)sizes[i];
+    memcpy(p + 2 * Digest::length + (i + 1) * sizeof(v), &v, sizeof(v));
+    if (sizes[i] > 0) memcpy(p + offset, binaries[i], sizes[i]);
+    entry->binaries.push_back(p + offset);
+    entry->sizes.push_back(sizes[i]);
+    offset += sizes[i];
+  }
+  entry->owner = image;
+  memoize(key, std::move(entry));
+
+  fs::path dir = cachePath;
+  std::string name = key.substr(0, GHOST_DIGEST_FILENAME_LENGTH);
+  uint64_t budget = maxCacheBytes;
+  // If this process has claimed the entry, the claim lasts until the file
+  // is in place, however soon the caller releases it.
+  auto claim = findHeldLock(lockPath(dir, name).string());
+  cacheWriter().enqueue([dir, name, budget, image, claim]() {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!publishFile(dir / name, image->data(), image->size())) {
+      countStats([](Stats& s) { s.writeFailures++; });
+      return;
+    }
+    countStats([&](Stats& s) { s.bytesWritten += image->size(); });
+    if (budget == 0) return;
+    auto& index = cacheIndex(dir);
+    index.touch(name, image->size());
+    index.enforce(budget);
+  });
+}
+
+void BinaryCache::flush() { cacheWriter().flush(); }
 
-  fs::path filePath =
-      cachePath / f.get().substr(0, GHOST_DIGEST_FILENAME_LENGTH);
+BinaryCache::EntryLock::EntryLock(EntryLock&& other) noexcept
+    : _path(std::move(other._path)), _lock(std::move(other._lock)) {}
+
+BinaryCache::EntryLock& BinaryCache::EntryLock::operator=(
+    EntryLock&& other) noexcept {
+  if (this != &other) {
+    release();
+    _path = std::move(other._path);
+    _lock = std::move(other._lock);
+  }
+  return *this;
+}
+
+BinaryCache::EntryLock::~EntryLock() { release(); }
+
+void BinaryCache::EntryLock::release() {
+  if (!_lock) return;
+  {
+    auto& held = heldLocks();
+    std::lock_guard<std::mutex> lock(held.mutex);
+    auto it = held.locks.find(_path);
+    if (it != held.locks.end() && it->second == _lock) held.locks.erase(it);
+  }
+  _lock.reset();
+  _path.clear();
+}
+
+BinaryCache::EntryLock BinaryCache::lockEntry(
+    const implementation::Device& dev, const void* data, size_t length,
+    const CompilerOptions& options) const {
+  EntryLock claim;
+  if (cachePath.empty() || lockTimeout == 0) return claim;
+  Digest f;
+  makeDigest(f, dev, dev.fingerprint().count, data, length, options);
+  std::string name = f.get().substr(0, GHOST_DIGEST_FILENAME_LENGTH);
   std::error_code ec;
   fs::create_directories(cachePath, ec);
-  FileWrapper file;
-  file = fopen(filePath.string().c_str(), "wb");
-  if (file.okay()) {
-    uint8_t digest[Digest::length];
-    d.get(digest);
-    file.write(digest, sizeof(digest));
-    Digest b;
-    for (i = 0; i < binaries.size(); i++) {
-      b.update(binaries[i], sizes[i]);
-    }
-    b.get(digest);
-    file.write(digest, sizeof(digest));
+  std::string path = lockPath(cachePath, name).string();
+
+  // Poll with backoff: compiles take tens of milliseconds to seconds, so a
+  // short first sleep catches quick ones without spinning on slow ones.
+  auto lock = std::make_shared<FileLock>();
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(lockTimeout);
+  std::chrono::steady_clock::duration delay = std::chrono::milliseconds(1);
+  for (;;) {
+    auto result = lock->tryLock(path.c_str());
+    if (result == FileLock::Result::Locked) break;
+    // An unwritable cache directory cannot be shared; don't wait on it.
+    if (result == FileLock::Result::Failed) return claim;
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) return claim;
+    std::this_thread::sleep_for(std::min(delay, deadline - now));
+    delay = std::min<std::chrono::steady_clock::duration>(
+        delay * 2, std::chrono::milliseconds(50));
+  }
+  {
+    auto& held = heldLocks();
+    std::lock_guard<std::mutex> guard(held.mutex);
+    held.locks[path] = lock;
+  }
+  claim._path = std::move(path);
+  claim._lock = std::move(lock);
+  return claim;
+}
 
-    uint64_t v;
-    v = (uint64_t)sizes.size();
-    file.write(&v, sizeof(v));
-    for (i = 0; i < sizes.size(); i++) {
-      v = (uint64_t)sizes[i];
-      file.write(&v, sizeof(v));
+namespace {
+// Entries to write into a pack: either a record of the existing archive or
+// a file from the cache directory.
+struct PackSource {
+  std::string name;
+  const PackRecord* record;
+  fs::path file;
+};
+
+// Write @p sources to @p file, followed by an index and a trailer. Returns
+// how many sources were written; cache files that can no longer be opened
+// are skipped.
+size_t writePack(FileWrapper& file, const PackArchive* archive,
+                 const std::vector<PackSource>& sources) {
+  static const unsigned char zeros[8] = {};
+  std::vector<PackRecord> records;
+  records.reserve(sources.size());
+  uint64_t offset = 0;
+  size_t written = 0;
+  for (auto& src : sources) {
+    const unsigned char* p;
+    size_t size;
+    MappedFile mapped;
+    if (src.record) {
+      p = archive->data() + src.record->offset;
+      size = size_t(src.record->size);
+    } else {
+      if (!mapped.open(src.file.string().c_str())) continue;
+      p = mapped.data();
+      size = mapped.size();
     }
-    for (i = 0; i < binaries.size(); i++) {
-      file.write(binaries[i], sizes[i]);
+    PackRecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.name, src.name.data(), sizeof(r.name));
+    r.offset = offset;
+    r.size = size;
+    records.push_back(r);
+    file.write(p, size);
+    size_t pad = size_t((8 - size % 8) % 8);
+    if (pad) file.write(zeros, pad);
+    offset += size + pad;
+    written++;
+  }
+  std::sort(records.begin(), records.end(),
+            [](const PackRecord& a, const PackRecord& b) {
+              return memcmp(a.name, b.name, sizeof(a.name)) < 0;
+            });
+  PackTrailer trailer;
+  memcpy(trailer.magic, kPackMagic, sizeof(kPackMagic));
+  trailer.indexOffset = offset;
+  trailer.count = records.size();
+  if (!records.empty())
+    file.write(records.data(), records.size() * sizeof(PackRecord));
+  file.write(&trailer, sizeof(trailer));
+  return written;
+}
+
+// Rewrite @p path with the live entries of @p archive (if any) plus @p extra,
+// storing in @p added how many of @p extra made it in.
+bool rewritePack(const fs::path& path, const PackArchive* archive,
+                 const std::vector<PackSource>& extra,
+                 size_t* added = nullptr) {
+  std::vector<PackRecord> live;
+  if (archive) {
+    for (size_t i = 0; i < archive->count(); i++)
+      live.push_back(archive->record(i));
+  }
+  std::vector<PackSource> sources;
+  for (auto& r : live) {
+    sources.push_back(
+        PackSource{std::string(r.name, sizeof(r.name)), &r, fs::path()});
+  }
+  sources.insert(sources.end(), extra.begin(), extra.end());
+  size_t written = 0;
+  bool ok = publishFile(path, [&](FileWrapper& file) {
+    written = writePack(file, archive, sources) - live.size();
+  });
+  if (added) *added = ok ? written : 0;
+  return ok;
+}
+}  // namespace
+
+size_t BinaryCache::packCache(const fs::path& pack, const fs::path& dir) {
+  flush();
+  forgetPackArchive(pack);
+  std::unique_ptr<PackArchive> archive(new PackArchive);
+  if (!archive->open(pack)) archive.reset();
+
+  std::unordered_set<std::string> known;
+  if (archive) {
+    for (size_t i = 0; i < archive->count(); i++) {
+      PackRecord r = archive->record(i);
+      known.insert(std::string(r.name, sizeof(r.name)));
     }
   }
+  std::vector<PackSource> added;
+  std::error_code ec;
+  for (const auto& e : fs::directory_iterator(dir, ec)) {
+    std::string name = e.path().filename().string();
+    if (!isEntryName(name) || known.count(name)) continue;
+    added.push_back(PackSource{name, nullptr, e.path()});
+  }
+  std::sort(added.begin(), added.end(),
+            [](const PackSource& a, const PackSource& b) {
+              return a.name < b.name;
+            });
+  if (added.empty()) return 0;
+
+  // Rewritten whole through a staged copy, so readers never see a torn
+  // archive and no dead space builds up.
+  size_t written = 0;
+  rewritePack(pack, archive.get(), added, &written);
+  return written;
 }
 }  // namespace ghost
@@ -0,0 +1,233 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include <ghost/caching_allocator.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+namespace ghost {
+
+namespace {
+// Smallest size class. Keeps tiny argument/constant buffers from each
+// occupying their own bucket.
+const size_t kMinBlockBytes = 256;
+}  // namespace
+
+bool CachingAllocator::Key::operator<(const Key& rhs) const {
+  return std::tie(kind, access, hint, bytes) <
+         std::tie(rhs.kind, rhs.access, rhs.hint, rhs.bytes);
+}
+
+CachingAllocator::CachingAllocator(std::shared_ptr<Allocator> upstream)
+    : _upstream(std::move(upstream)) {}
+
+CachingAllocator::CachingAllocator(std::shared_ptr<Allocator> upstream,
+                                   const Options& options)
+    : _upstream(std::move(upstream)), _options(options) {}
+
+CachingAllocator::~CachingAllocator() { trim(0); }
+
+size_t CachingAllocator::sizeClass(size_t bytes) {
+  if (bytes <= kMinBlockBytes) return kMinBlockBytes;
+  // For p/2 < bytes <= p, round up to a multiple of p/8: four classes per
+  // power of two.
+  size_t p = kMinBlockBytes;
+  while (p < bytes && p <= (std::numeric_limits<size_t>::max() >> 1)) {
+    p <<= 1;
+  }
+  size_t step = p / 8;
+  return (bytes + step - 1) / step * step;
+}
+
+void* CachingAllocator::allocateBuffer(size_t bytes,
+                                       const BufferOptions& opts) {
+  return allocate(Kind::Buffer, bytes, opts);
+}
+
+void CachingAllocator::freeBuffer(void* handle, size_t bytes) {
+  if (release(Kind::Buffer, handle)) return;
+  if (_upstream) _upstream->freeBuffer(handle, bytes);
+}
+
+void* CachingAllocator::allocateMappedBuffer(size_t bytes,
+                                             const BufferOptions& opts) {
+  return allocate(Kind::MappedBuffer, bytes, opts);
+}
+
+void CachingAllocator::freeMappedBuffer(void* handle, size_t bytes) {
+  if (release(Kind::MappedBuffer, handle)) return;
+  if (_upstream) _upstream->freeMappedBuffer(handle, bytes);
+}
+
+void* CachingAllocator::allocateImage(const ImageDescription& descr) {
+  return _upstream ? _upstream->allocateImage(descr) : nullptr;
+}
+
+void CachingAllocator::freeImage(void* handle, const ImageDescription& descr) {
+  if (_upstream) _upstream->freeImage(handle, descr);
+}
+
+void* CachingAllocator::allocateHostMemory(size_t bytes) {
+  return allocate(Kind::Host, bytes, BufferOptions());
+}
+
+void CachingAllocator::freeHostMemory(void* ptr) {
+  if (release(Kind::Host, ptr)) return;
+  // Not ours: Ghost routes every host free through the installed allocator.
+  if (_upstream) {
+    _upstream->freeHostMemory(ptr);
+  } else if (ptr) {
+    ::free(ptr);
+  }
+}
+
+void* CachingAllocator::allocate(Kind kind, size_t bytes,
+                                 const BufferOptions& opts) {
+  // Heap pointers are only buffer handles on the CPU backend, and we cannot
+  // tell which device we are installed on.
+  if (!_upstream && kind != Kind::Host) return nullptr;
+  size_t cls = sizeClass(bytes);
+  Key key{kind, opts.access, opts.hint,
+          cls <= _options.maxBlockBytes ? cls : bytes};
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _buckets.find(key);
+    if (it != _buckets.end() && !it->second.empty()) {
+      auto parked = it->second.back();
+      it->second.pop_back();
+      void* handle = parked->handle;
+      _lru.erase(parked);
+      _live[handle] = key;
+      _stats.hits++;
+      _stats.cachedBytes -= key.bytes;
+      _stats.allocatedBytes += key.bytes;
+      return handle;
+    }
+  }
+  void* handle = allocateUpstream(key, opts);
+  if (!handle) {
+    // Upstream may be out of memory because of what we are holding: give
+    // everything back and try once more before declining.
+    trim(0);
+    handle = allocateUpstream(key, opts);
+    if (!handle) return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  _live[handle] = key;
+  _stats.misses++;
+  _stats.allocatedBytes += key.bytes;
+  notePeak();
+  return handle;
+}
+
+bool CachingAllocator::release(Kind kind, void* handle) {
+  std::vector<Parked> evicted;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _live.find(handle);
+    if (it == _live.end() || it->second.kind != kind) return false;
+    Key key = it->second;
+    _live.erase(it);
+    _stats.allocatedBytes -= key.bytes;
+    if (key.bytes > _options.maxBlockBytes ||
+        key.bytes > _options.maxCachedBytes) {
+      evicted.push_back(Parked{key, handle});
+    } else {
+      _lru.push_front(Parked{key, handle});
+      _buckets[key].push_back(_lru.begin());
+      _stats.cachedBytes += key.bytes;
+      trimLocked(_options.maxCachedBytes, evicted);
+    }
+    _stats.releases += evicted.size();
+  }
+  for (auto& p : evicted) freeUpstream(p.key, p.handle);
+  return true;
+}
+
+void* CachingAllocator::allocateUpstream(const Key& key,
+                                         const BufferOptions& opts) {
+  if (!_upstream) return ::malloc(key.bytes);
+  switch (key.kind) {
+    case Kind::Buffer:
+      return _upstream->allocateBuffer(key.bytes, opts);
+    case Kind::MappedBuffer:
+      return _upstream->allocateMappedBuffer(key.bytes, opts);
+    case Kind::Host:
+      return _upstream->allocateHostMemory(key.bytes);
+  }
+  return nullptr;
+}
+
+void CachingAllocator::freeUpstream(const Key& key, void* handle) {
+  if (!_upstream) {
+    ::free(handle);
+    return;
+  }
+  switch (key.kind) {
+    case Kind::Buffer:
+      _upstream->freeBuffer(handle, key.bytes);
+      break;
+    case Kind::MappedBuffer:
+      _upstream->freeMappedBuffer(handle, key.bytes);
+      break;
+    case Kind::Host:
+      _upstream->freeHostMemory(handle);
+      break;
+  }
+}
+
+void CachingAllocator::trimLocked(size_t keepBytes,
+                                  std::vector<Parked>& evicted) {
+  while (_stats.cachedBytes > keepBytes && !_lru.empty()) {
+    auto last = std::prev(_lru.end());
+    auto& bucket = _buckets[last->key];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), last));
+    _stats.cachedBytes -= last->key.bytes;
+    evicted.push_back(*last);
+    _lru.erase(last);
+  }
+}
+
+void CachingAllocator::trim(size_t keepBytes) {
+  std::vector<Parked> evicted;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    trimLocked(keepBytes, evicted);
+    _stats.releases += evicted.size();
+  }
+  for (auto& p : evicted) freeUpstream(p.key, p.handle);
+}
+
+CachingAllocator::Stats CachingAllocator::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void CachingAllocator::setMaxCachedBytes(size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _options.maxCachedBytes = bytes;
+  }
+  trim(bytes);
+}
+
+void CachingAllocator::notePeak() {
+  _stats.peakBytes =
+      std::max(_stats.peakBytes, _stats.allocatedBytes + _stats.cachedBytes);
+}
+
+}  // namespace ghost
@@ -16,6 +16,7 @@
 #include <ghost/cpu/device.h>
 #include <ghost/cpu/impl_device.h>
 #include <ghost/cpu/impl_function.h>
+#include <ghost/io.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -42,8 +43,17 @@
 #endif
 #endif
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
 #include <limits>
+#include <stdexcept>
 #include <string>
 
 namespace {
@@ -288,6 +298,20 @@ void BufferCPU::fill(const ghost::Encoder& s, size_t offset, size_t size,
   }
 }
 
+// CPU buffers are host memory: read and write the allocation directly
+// rather than bouncing through the staging ring.
+void BufferCPU::readFromFile(const ghost::Stream&, FileWrapper& file,
+                             size_t dstOffset, size_t bytes) {
+  if (bytes > 0) file.read(static_cast<uint8_t*>(ptr) + dstOffset, bytes);
+}
+
+void BufferCPU::writeToFile(const ghost::Stream&, FileWrapper& file,
+                            size_t srcOffset, size_t bytes) const {
+  if (bytes > 0) {
+    file.write(static_cast<const uint8_t*>(ptr) + srcOffset, bytes);
+  }
+}
+
 std::shared_ptr<Buffer> BufferCPU::createSubBuffer(
     const std::shared_ptr<Buffer>& self, size_t offset, size_t size) {
   return std::make_shared<SubBufferCPU>(
@@ -320,6 +344,99 @@ void* MappedBufferCPU::map(const ghost::Encoder& s, Access, bool sync) {
 
 void MappedBufferCPU::unmap(const ghost::Encoder&) {}
 
+namespace {
+SharedMemoryBufferCPU::Handle createSharedMemory(size_t bytes) {
+#if defined(_WIN32)
+  uint64_t size = std::max<uint64_t>(bytes, 1);
+  HANDLE h = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                (DWORD)(size >> 32), (DWORD)size, nullptr);
+  if (!h) throw std::runtime_error("CreateFileMapping failed");
+  return h;
+#else
+#if defined(__linux__)
+  int fd = memfd_create("ghost", MFD_CLOEXEC);
+#else
+  // No memfd: create a uniquely named object and unlink it immediately so it
+  // is only reachable through the descriptor, like an anonymous memfd.
+  static std::atomic<unsigned> counter{0};
+  std::string name =
+      "/ghost-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) shm_unlink(name.c_str());
+#endif
+  if (fd < 0) throw std::runtime_error("cannot create shared memory");
+  if (ftruncate(fd, (off_t)bytes) != 0) {
+    ::close(fd);
+    throw std::runtime_error("cannot size shared memory");
+  }
+  return fd;
+#endif
+}
+}  // namespace
+
+SharedMemoryBufferCPU::SharedMemoryBufferCPU(const DeviceCPU& dev,
+                                             size_t bytes)
+    : BufferCPU(nullptr, bytes), handle(createSharedMemory(bytes)) {
+  (void)dev;
+  map();
+}
+
+SharedMemoryBufferCPU::SharedMemoryBufferCPU(Handle imported, size_t bytes)
+    : BufferCPU(nullptr, bytes), handle(imported) {
+#if !defined(_WIN32)
+  struct stat st;
+  if (fstat(handle, &st) != 0 || (uint64_t)st.st_size < bytes) {
+    ::close(handle);
+    throw std::runtime_error("shared memory handle is smaller than buffer");
+  }
+#endif
+  map();
+}
+
+SharedMemoryBufferCPU::~SharedMemoryBufferCPU() {
+#if defined(_WIN32)
+  if (ptr) UnmapViewOfFile(ptr);
+  CloseHandle(handle);
+#else
+  if (ptr) munmap(ptr, _size);
+  ::close(handle);
+#endif
+  ptr = nullptr;
+}
+
+SharedMemoryBufferCPU::Handle SharedMemoryBufferCPU::exportHandle() const {
+#if defined(_WIN32)
+  HANDLE dup = nullptr;
+  if (!DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &dup,
+                       0, TRUE, DUPLICATE_SAME_ACCESS)) {
+    throw std::runtime_error("DuplicateHandle failed");
+  }
+  return dup;
+#else
+  int dup = fcntl(handle, F_DUPFD_CLOEXEC, 0);
+  if (dup < 0) throw std::runtime_error("cannot duplicate shared memory");
+  return dup;
+#endif
+}
+
+void SharedMemoryBufferCPU::map() {
+  if (_size == 0) return;
+#if defined(_WIN32)
+  ptr = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, _size);
+  if (!ptr) {
+    CloseHandle(handle);
+    throw std::runtime_error("MapViewOfFile failed");
+  }
+#else
+  void* p = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+  if (p == MAP_FAILED) {
+    ::close(handle);
+    throw std::runtime_error("cannot map shared memory");
+  }
+  ptr = p;
+#endif
+}
+
 SubBufferCPU::SubBufferCPU(std::shared_ptr<Buffer> parent, void* ptr_,
                            size_t bytes)
     : BufferCPU(ptr_, bytes), _parent(parent) {}
@@ -502,6 +619,21 @@ DeviceCPU::DeviceCPU(std::shared_ptr<ghost::ThreadPool> p)
     : cores(getNumberOfCores()),
       pool(p ? p : ghost::ThreadPool::createDefault()) {}
 
+DeviceCPU::~DeviceCPU() {
+  clearPrecompiled();
+  detachNativeAllocator();
+}
+
+void* DeviceCPU::allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                      bool mapped) const {
+  return ::malloc(bytes);
+}
+
+void DeviceCPU::freeNativeBuffer(void* handle, size_t bytes,
+                                 bool mapped) const {
+  ::free(handle);
+}
+
 ghost::Library DeviceCPU::loadLibraryFromText(const std::string& text,
                                               const CompilerOptions& options,
                                               bool retainBinary) const {
@@ -706,6 +838,30 @@ void DeviceCPU::setThreadPool(std::shared_ptr<ghost::ThreadPool> pool) {
   setDefaultStream(std::make_shared<implementation::StreamCPU>(cpu->pool));
 }
 
+Buffer DeviceCPU::allocateSharedMemoryBuffer(size_t bytes) const {
+  auto cpu = static_cast<implementation::DeviceCPU*>(impl().get());
+  auto ptr =
+      std::make_shared<implementation::SharedMemoryBufferCPU>(*cpu, bytes);
+  return ghost::Buffer(ptr);
+}
+
+DeviceCPU::SharedMemoryHandle DeviceCPU::exportSharedMemoryBuffer(
+    const Buffer& buffer) const {
+  auto shm = dynamic_cast<implementation::SharedMemoryBufferCPU*>(
+      buffer.impl().get());
+  if (!shm) {
+    throw std::invalid_argument("buffer is not a shared-memory buffer");
+  }
+  return shm->exportHandle();
+}
+
+Buffer DeviceCPU::importSharedMemoryBuffer(SharedMemoryHandle handle,
+                                           size_t bytes) const {
+  auto ptr =
+      std::make_shared<implementation::SharedMemoryBufferCPU>(handle, bytes);
+  return ghost::Buffer(ptr);
+}
+
 Library DeviceCPU::loadLibraryFromFunctions(
     const std::vector<
         std::pair<std::string, implementation::FunctionCPU::Type>>& functions) {
@@ -1732,8 +1732,13 @@ DeviceCUDA::DeviceCUDA(int deviceOrdinal) {
 
 DeviceCUDA::~DeviceCUDA() {
   try {
+    // Unclaimed precompiled modules must unload while the context exists.
+    clearPrecompiled();
     // Destroy any parked texture objects before the context goes away.
     reapDeferredTextures(/*waitAll=*/true);
+    // Cached buffers and pinned staging blocks need the context to be freed.
+    detachNativeAllocator();
+    trimHostMemoryPool();
     // Need to clear context before we can destroy it.
     if (context.get() && CU_CurrentContext::get() == context.get())
       CU_CurrentContext::pop();
@@ -1741,6 +1746,39 @@ DeviceCUDA::~DeviceCUDA() {
   }
 }
 
+void* DeviceCUDA::allocatePinnedMemory(size_t bytes) const {
+  void* ptr = nullptr;
+  if (cuMemAllocHost(&ptr, bytes) != CUDA_SUCCESS) return nullptr;
+  return ptr;
+}
+
+void DeviceCUDA::freePinnedMemory(void* ptr) const { cuMemFreeHost(ptr); }
+
+void* DeviceCUDA::allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                       bool mapped) const {
+  if (mapped) {
+    unsigned int flags = CU_MEMHOSTALLOC_DEVICEMAP;
+    if (opts.access == Access::WriteOnly) {
+      flags |= CU_MEMHOSTALLOC_WRITECOMBINED;
+    }
+    void* ptr = nullptr;
+    if (cuMemHostAlloc(&ptr, bytes, flags) != CUDA_SUCCESS) return nullptr;
+    return ptr;
+  }
+  CUdeviceptr devPtr;
+  if (cuMemAlloc(&devPtr, bytes) != CUDA_SUCCESS) return nullptr;
+  return reinterpret_cast<void*>(static_cast<uintptr_t>(devPtr));
+}
+
+void DeviceCUDA::freeNativeBuffer(void* handle, size_t bytes,
+                                  bool mapped) const {
+  if (mapped) {
+    cuMemFreeHost(handle);
+  } else {
+    cuMemFree(static_cast<CUdeviceptr>(reinterpret_cast<uintptr_t>(handle)));
+  }
+}
+
 void DeviceCUDA::deferTextureRelease(
     std::vector<TexturePtr>&& textures,
     const std::vector<CUstream>& streams) const {
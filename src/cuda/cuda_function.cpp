@@ -369,6 +369,17 @@ void LibraryCUDA::loadFromText(const std::string& text,
   } catch (...) {
   }
   if (program.get() != nullptr) return;
+  // Another process may be compiling the same program. Wait for it, then
+  // look again before compiling it here too.
+  auto claim = _dev.binaryCache().lockEntry(_dev, text.c_str(), text.size(),
+                                            options);
+  if (claim) {
+    try {
+      loadFromCache(text.c_str(), text.size(), options, true);
+    } catch (...) {
+    }
+    if (program.get() != nullptr) return;
+  }
 
   // Build header arrays from options.headers for NVRTC.
   std::vector<const char*> headerSources, headerNames;
@@ -461,6 +472,15 @@ void LibraryCUDA::loadFromData(const void* data, size_t len,
   } catch (...) {
   }
   if (program.get() != nullptr) return;
+  // Claim the entry and look again, as in loadFromText.
+  auto claim = _dev.binaryCache().lockEntry(_dev, data, len, options);
+  if (claim) {
+    try {
+      loadFromCache(data, len, options, true);
+    } catch (...) {
+    }
+    if (program.get() != nullptr) return;
+  }
 
   CUjit_option jitOptions[6];
   void* optionVals[6];
@@ -526,12 +546,13 @@ void LibraryCUDA::loadFromBinary(void* binary) {
 }
 
 void LibraryCUDA::loadFromCache(const void* data, size_t length,
-                                const CompilerOptions& options) {
-  std::vector<std::vector<unsigned char>> binaries;
-  std::vector<size_t> sizes;
-  if (_dev.binaryCache().loadBinaries(binaries, sizes, _dev, data, length,
-                                      options)) {
-    loadFromBinary(&binaries[0][0]);
+                                const CompilerOptions& options, bool claimed) {
+  // Once the entry is claimed, look again without counting a second miss.
+  auto& cache = _dev.binaryCache();
+  BinaryCache::CachedBinaries cached;
+  if (claimed ? cache.reloadBinaries(cached, _dev, data, length, options)
+              : cache.loadBinaries(cached, _dev, data, length, options)) {
+    loadFromBinary(const_cast<unsigned char*>(cached.binaries[0]));
   }
 }
 
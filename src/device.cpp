@@ -13,13 +13,25 @@
 // the License.
 
 #include <ghost/allocator.h>
+#include <ghost/caching_allocator.h>
 #include <ghost/command_buffer.h>
 #include <ghost/device.h>
+#include <ghost/digest.h>
 #include <ghost/exception.h>
+#include <ghost/io.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace ghost {
 namespace implementation {
@@ -84,30 +96,482 @@ void Buffer::fill(const ghost::Encoder&, size_t, size_t, const void*, size_t) {
   throw ghost::unsupported_error();
 }
 
+namespace {
+// Staging ring for Buffer::readFromFile / writeToFile. Three 4 MiB chunks
+// keep one chunk on disk, one in transfer and one free without holding
+// more than a few megabytes of host memory per call.
+const size_t kFileChunkBytes = 4 << 20;
+const size_t kFileChunkCount = 3;
+
+struct FileChunk {
+  std::shared_ptr<uint8_t> data;
+  std::shared_ptr<Event> done;
+  size_t offset = 0;
+  size_t bytes = 0;
+};
+
+std::shared_ptr<uint8_t> allocateFileChunk(size_t bytes) {
+  return std::shared_ptr<uint8_t>(new uint8_t[bytes],
+                                  std::default_delete<uint8_t[]>());
+}
+
+// Record an event after the chunk's transfer. Backends without events fall
+// back to draining the stream before the chunk is reused.
+void recordFileChunk(Stream* stream, FileChunk& chunk) {
+  try {
+    chunk.done = stream->record();
+  } catch (const ghost::unsupported_error&) {
+    chunk.done = nullptr;
+    stream->sync();
+  }
+}
+
+void waitFileChunk(FileChunk& chunk) {
+  if (chunk.done) {
+    chunk.done->wait();
+    chunk.done = nullptr;
+  }
+}
+}  // namespace
+
+void Buffer::readFromFile(const ghost::Stream& s, FileWrapper& file,
+                          size_t dstOffset, size_t bytes) {
+  auto stream = static_cast<Stream*>(s.impl().get());
+  size_t chunkBytes = std::min(bytes, kFileChunkBytes);
+  FileChunk ring[kFileChunkCount];
+  size_t index = 0;
+  for (size_t offset = 0; offset < bytes; offset += chunkBytes, index++) {
+    FileChunk& chunk = ring[index % kFileChunkCount];
+    waitFileChunk(chunk);
+    if (!chunk.data) chunk.data = allocateFileChunk(chunkBytes);
+    size_t n = std::min(chunkBytes, bytes - offset);
+    file.read(chunk.data.get(), n);
+    copy(s, HostBytes::wrap(chunk.data, chunk.data.get()), dstOffset + offset,
+         n);
+    recordFileChunk(stream, chunk);
+  }
+}
+
+void Buffer::writeToFile(const ghost::Stream& s, FileWrapper& file,
+                         size_t srcOffset, size_t bytes) const {
+  auto stream = static_cast<Stream*>(s.impl().get());
+  size_t chunkBytes = std::min(bytes, kFileChunkBytes);
+  FileChunk ring[kFileChunkCount];
+  size_t issued = 0;
+  size_t written = 0;
+  // Keep the ring full of readbacks; write out the oldest chunk whenever a
+  // slot is needed or nothing is left to issue.
+  while (written < bytes) {
+    FileChunk& next = ring[(issued / chunkBytes) % kFileChunkCount];
+    if (issued < bytes && next.bytes == 0) {
+      if (!next.data) next.data = allocateFileChunk(chunkBytes);
+      next.offset = issued;
+      next.bytes = std::min(chunkBytes, bytes - issued);
+      copyTo(s, HostBytes::wrap(next.data, next.data.get()),
+             srcOffset + issued, next.bytes);
+      recordFileChunk(stream, next);
+      issued += next.bytes;
+      continue;
+    }
+    FileChunk& oldest = ring[(written / chunkBytes) % kFileChunkCount];
+    waitFileChunk(oldest);
+    file.write(oldest.data.get(), oldest.bytes);
+    written += oldest.bytes;
+    oldest.bytes = 0;
+  }
+}
+
 ghost::Library Device::loadLibraryFromFile(
     const std::filesystem::path& filename) const {
   throw ghost::unsupported_error();
 }
 
+// Staging pool behind allocateHostMemory. Blocks are rounded to
+// CachingAllocator size classes and parked on free, so a steady upload loop
+// pins each block once instead of per transfer.
+struct Device::HostMemoryPool {
+  std::mutex mutex;
+  size_t maxCachedBytes = size_t(64) << 20;
+  size_t cachedBytes = 0;
+  std::unordered_map<void*, size_t> live;
+  std::multimap<size_t, void*> parked;
+};
+
+// Upstream for a CachingAllocator that creates handles the way the device's
+// own allocation path does. Host memory comes from the heap, as a device
+// with no allocator would use for unknown pointers. The lock keeps a handle
+// from being created or freed while the device detaches.
+class Device::NativeAllocator : public Allocator {
+ public:
+  explicit NativeAllocator(const Device* device) : _device(device) {}
+
+  virtual void* allocateBuffer(size_t bytes,
+                               const BufferOptions& opts) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _device ? _device->allocateNativeBuffer(bytes, opts, false)
+                   : nullptr;
+  }
+
+  virtual void freeBuffer(void* handle, size_t bytes) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_device) _device->freeNativeBuffer(handle, bytes, false);
+  }
+
+  virtual void* allocateMappedBuffer(size_t bytes,
+                                     const BufferOptions& opts) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _device ? _device->allocateNativeBuffer(bytes, opts, true)
+                   : nullptr;
+  }
+
+  virtual void freeMappedBuffer(void* handle, size_t bytes) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_device) _device->freeNativeBuffer(handle, bytes, true);
+  }
+
+  virtual void* allocateHostMemory(size_t bytes) override {
+    return ::malloc(bytes);
+  }
+
+  virtual void freeHostMemory(void* ptr) override { ::free(ptr); }
+
+  void detach() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _device = nullptr;
+  }
+
+ private:
+  std::mutex _mutex;
+  const Device* _device;
+};
+
+// Libraries built by ghost::Device::precompile, waiting for the load call
+// with matching inputs.
+struct Device::PrecompiledLibraries {
+  struct Worker {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> done;
+  };
+
+  std::mutex mutex;
+  std::unordered_map<std::string, std::shared_future<ghost::Library>> parked;
+  std::vector<Worker> workers;
+  std::atomic<bool> stopping{false};
+};
+
+Device::Device()
+    : _poolSize(0),
+      _hostPool(std::make_shared<HostMemoryPool>()),
+      _precompiled(std::make_shared<PrecompiledLibraries>()),
+      _nativeAllocator(std::make_shared<NativeAllocator>(this)) {}
+
+Device::~Device() {
+  // Backends have already stopped the workers; this only catches any left.
+  clearPrecompiled();
+  detachNativeAllocator();
+  // Backends that override allocatePinnedMemory have already trimmed; what
+  // remains came from the default malloc path.
+  for (auto& p : _hostPool->parked) ::free(p.second);
+}
+
+void* Device::allocatePinnedMemory(size_t bytes) const {
+  return ::malloc(bytes);
+}
+
+void Device::freePinnedMemory(void* ptr) const { ::free(ptr); }
+
+void* Device::allocateNativeBuffer(size_t bytes, const BufferOptions& opts,
+                                   bool mapped) const {
+  return nullptr;
+}
+
+void Device::freeNativeBuffer(void* handle, size_t bytes, bool mapped) const {}
+
+std::shared_ptr<ghost::Allocator> Device::nativeAllocator() const {
+  return _nativeAllocator;
+}
+
+void Device::detachNativeAllocator() const {
+  // Arena blocks and parked blocks may be this device's native handles:
+  // release them while the backend can still free them.
+  std::atomic_store(&_transientArena, std::shared_ptr<TransientArena>());
+  if (auto* caching = dynamic_cast<CachingAllocator*>(_allocator.get())) {
+    caching->trim();
+  }
+  _nativeAllocator->detach();
+}
+
 void* Device::allocateHostMemory(size_t bytes) const {
   if (_allocator) {
     if (void* p = _allocator->allocateHostMemory(bytes)) return p;
+    // The allocator sees every free, including this block's, and is only
+    // required to hand unknown pointers to ::free.
+    return ::malloc(bytes);
   }
-  return ::malloc(bytes);
+  size_t cls = CachingAllocator::sizeClass(bytes);
+  {
+    std::lock_guard<std::mutex> lock(_hostPool->mutex);
+    auto it = _hostPool->parked.find(cls);
+    if (it != _hostPool->parked.end()) {
+      void* p = it->second;
+      _hostPool->parked.erase(it);
+      _hostPool->cachedBytes -= cls;
+      _hostPool->live[p] = cls;
+      return p;
+    }
+  }
+  void* p = allocatePinnedMemory(cls);
+  if (!p) {
+    trimHostMemoryPool();
+    p = allocatePinnedMemory(cls);
+    if (!p) return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(_hostPool->mutex);
+  _hostPool->live[p] = cls;
+  return p;
 }
 
 void Device::freeHostMemory(void* ptr) const {
-  if (_allocator) {
+  bool pooled = false;
+  if (ptr) {
+    // Pool blocks go back through freePinnedMemory even if an allocator was
+    // installed since: they may be pinned driver memory, not heap.
+    std::lock_guard<std::mutex> lock(_hostPool->mutex);
+    auto it = _hostPool->live.find(ptr);
+    if (it != _hostPool->live.end()) {
+      pooled = true;
+      size_t cls = it->second;
+      _hostPool->live.erase(it);
+      // Allocations bypass the pool while an allocator is installed.
+      if (!_allocator &&
+          _hostPool->cachedBytes + cls <= _hostPool->maxCachedBytes) {
+        _hostPool->parked.emplace(cls, ptr);
+        _hostPool->cachedBytes += cls;
+        return;
+      }
+    }
+  }
+  if (pooled) {
+    freePinnedMemory(ptr);
+  } else if (_allocator) {
     _allocator->freeHostMemory(ptr);
-    return;
+  } else {
+    ::free(ptr);
+  }
+}
+
+void Device::trimHostMemoryPool(size_t keepBytes) const {
+  std::vector<void*> released;
+  {
+    std::lock_guard<std::mutex> lock(_hostPool->mutex);
+    // Largest classes first: they free the most memory per driver call.
+    while (_hostPool->cachedBytes > keepBytes && !_hostPool->parked.empty()) {
+      auto last = std::prev(_hostPool->parked.end());
+      _hostPool->cachedBytes -= last->first;
+      released.push_back(last->second);
+      _hostPool->parked.erase(last);
+    }
+  }
+  for (void* p : released) freePinnedMemory(p);
+}
+
+void Device::setHostMemoryPoolLimit(size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(_hostPool->mutex);
+    _hostPool->maxCachedBytes = bytes;
   }
-  if (ptr) ::free(ptr);
+  trimHostMemoryPool(bytes);
 }
 
 size_t Device::getMemoryPoolSize() const { return _poolSize; }
 
 void Device::setMemoryPoolSize(size_t bytes) { _poolSize = bytes; }
 
+struct Device::TransientArena {
+  struct Block {
+    std::shared_ptr<Buffer> buffer;
+    size_t size;
+    size_t used;
+  };
+
+  std::mutex mutex;
+  size_t blockBytes = 0;
+  size_t alignment = 0;
+  bool unsupported = false;
+  std::vector<Block> blocks;
+  size_t current = 0;
+};
+
+ghost::Buffer Device::allocateTransientBuffer(size_t bytes,
+                                              const BufferOptions& opts) const {
+  auto arena = std::atomic_load(&_transientArena);
+  // Blocks are read-write; other access modes get their own allocation so
+  // the backend sees the requested flags.
+  if (!arena || bytes == 0 || opts.access != Access::ReadWrite) {
+    return allocateBuffer(bytes, opts);
+  }
+  std::lock_guard<std::mutex> lock(arena->mutex);
+  if (arena->blockBytes == 0 || arena->unsupported) {
+    return allocateBuffer(bytes, opts);
+  }
+  if (arena->alignment == 0) {
+    auto a = getAttribute(kDeviceBufferAlignment).asUInt64();
+    arena->alignment = a > 0 ? static_cast<size_t>(a) : 1;
+  }
+  size_t align = arena->alignment;
+  size_t need = (bytes + align - 1) / align * align;
+  // Blocks are filled in order; after a reset the same blocks are walked
+  // again from the first, so a steady-state frame never allocates.
+  while (arena->current < arena->blocks.size() &&
+         arena->blocks[arena->current].used + need >
+             arena->blocks[arena->current].size) {
+    arena->current++;
+  }
+  if (arena->current == arena->blocks.size()) {
+    size_t size = std::max(arena->blockBytes, need);
+    auto block = allocateBuffer(size, BufferOptions(AllocHint::Persistent));
+    arena->blocks.push_back({block.impl(), size, 0});
+  }
+  auto& block = arena->blocks[arena->current];
+  std::shared_ptr<Buffer> sub;
+  try {
+    sub = block.buffer->createSubBuffer(block.buffer, block.used, bytes);
+  } catch (const ghost::unsupported_error&) {
+    arena->unsupported = true;
+    arena->blocks.clear();
+    arena->current = 0;
+    return allocateBuffer(bytes, opts);
+  }
+  block.used += need;
+  return ghost::Buffer(sub);
+}
+
+void Device::setTransientArenaSize(size_t blockBytes) {
+  auto arena = std::make_shared<TransientArena>();
+  arena->blockBytes = blockBytes;
+  std::atomic_store(&_transientArena,
+                    blockBytes > 0 ? arena : std::shared_ptr<TransientArena>());
+}
+
+size_t Device::getTransientArenaSize() const {
+  auto arena = std::atomic_load(&_transientArena);
+  return arena ? arena->blockBytes : 0;
+}
+
+void Device::resetTransientArena() {
+  auto arena = std::atomic_load(&_transientArena);
+  if (!arena) return;
+  std::lock_guard<std::mutex> lock(arena->mutex);
+  for (auto& block : arena->blocks) block.used = 0;
+  arena->current = 0;
+}
+
+bool Device::parkPrecompiled(const std::string& key,
+                             std::shared_future<ghost::Library>& lib) const {
+  std::lock_guard<std::mutex> lock(_precompiled->mutex);
+  auto result = _precompiled->parked.emplace(key, lib);
+  if (!result.second) lib = result.first->second;
+  return result.second;
+}
+
+bool Device::takePrecompiled(const std::string& key,
+                             std::shared_future<ghost::Library>& lib) const {
+  std::lock_guard<std::mutex> lock(_precompiled->mutex);
+  auto it = _precompiled->parked.find(key);
+  if (it == _precompiled->parked.end()) return false;
+  lib = std::move(it->second);
+  _precompiled->parked.erase(it);
+  return true;
+}
+
+bool Device::hasPrecompiled() const {
+  std::lock_guard<std::mutex> lock(_precompiled->mutex);
+  return !_precompiled->parked.empty();
+}
+
+void Device::startPrecompileWorkers(size_t count,
+                                    const std::function<void()>& worker) const {
+  std::vector<PrecompiledLibraries::Worker> finished;
+  {
+    std::lock_guard<std::mutex> lock(_precompiled->mutex);
+    // Reap workers from earlier batches so the list does not grow.
+    auto& workers = _precompiled->workers;
+    for (auto it = workers.begin(); it != workers.end();) {
+      if (*it->done) {
+        finished.push_back(std::move(*it));
+        it = workers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      auto done = std::make_shared<std::atomic<bool>>(false);
+      workers.push_back({std::thread([worker, done] {
+                           worker();
+                           *done = true;
+                         }),
+                         done});
+    }
+  }
+  for (auto& w : finished) w.thread.join();
+}
+
+bool Device::precompileStopping() const { return _precompiled->stopping; }
+
+void Device::clearPrecompiled() const {
+  std::vector<PrecompiledLibraries::Worker> workers;
+  {
+    std::lock_guard<std::mutex> lock(_precompiled->mutex);
+    _precompiled->stopping = true;
+    workers.swap(_precompiled->workers);
+  }
+  for (auto& w : workers) {
+    // Never join the calling thread, should the last reference to the
+    // device be dropped on a worker.
+    if (w.thread.get_id() == std::this_thread::get_id()) {
+      w.thread.detach();
+    } else {
+      w.thread.join();
+    }
+  }
+  std::unordered_map<std::string, std::shared_future<ghost::Library>> parked;
+  {
+    std::lock_guard<std::mutex> lock(_precompiled->mutex);
+    parked.swap(_precompiled->parked);
+  }
+  // Libraries are released here, outside the lock.
+}
+
+std::string Device::precompileKey(const void* data, size_t len, bool binary,
+                                  const CompilerOptions& options,
+                                  bool retainBinary) {
+  Digest d;
+  const char flags[2] = {binary ? 'b' : 't', retainBinary ? 'r' : '-'};
+  d.update(flags, sizeof(flags));
+  options.updateDigest(d);
+  d.update("\0", 1);
+  if (len > 0) d.update(data, len);
+  return d.get();
+}
+
+const Device::Fingerprint& Device::fingerprint() const {
+  static_assert(sizeof(Fingerprint::digest) == Digest::length,
+                "fingerprint digest size");
+  std::call_once(_fingerprintOnce, [this] {
+    _fingerprint.count = (size_t)getAttribute(kDeviceCount).asInt();
+    std::string& id = _fingerprint.identity;
+    id = getAttribute(kDeviceVendor).asString();
+    id += getAttribute(kDeviceName).asString();
+    id += getAttribute(kDeviceDriverVersion).asString();
+    Digest d;
+    for (size_t i = 0; i < _fingerprint.count; i++) {
+      d.update(id.data(), id.size());
+    }
+    d.get(_fingerprint.digest);
+  });
+  return _fingerprint;
+}
+
 size_t Device::imageAlignment(const ImageDescription&) const {
   auto attr = getAttribute(kDeviceMaxImageAlignment);
   auto v = attr.asUInt64();
@@ -286,6 +750,27 @@ void Buffer::fill(const Encoder& s, size_t offset, size_t size,
     _impl->fill(s, offset, size, pattern, patternSize);
 }
 
+void Buffer::readFromFile(const Stream& s, const std::filesystem::path& path,
+                          size_t dstOffset, size_t bytes, uint64_t fileOffset) {
+  FileWrapper file;
+  file = fopen(path.string().c_str(), "rb");
+  if (!file.okay()) {
+    throw std::runtime_error("cannot open " + path.string());
+  }
+  if (fileOffset > 0) file.seek(fileOffset);
+  _impl->readFromFile(s, file, dstOffset, bytes);
+}
+
+void Buffer::writeToFile(const Stream& s, const std::filesystem::path& path,
+                         size_t srcOffset, size_t bytes) const {
+  FileWrapper file;
+  file = fopen(path.string().c_str(), "wb");
+  if (!file.okay()) {
+    throw std::runtime_error("cannot create " + path.string());
+  }
+  _impl->writeToFile(s, file, srcOffset, bytes);
+}
+
 Buffer Buffer::createSubBuffer(size_t offset, size_t size) {
   return Buffer(_impl->createSubBuffer(_impl, offset, size));
 }
@@ -433,20 +918,127 @@ void Device::purgeBinaries(int days) {
   binaryCache().purgeBinaries(*_impl, days);
 }
 
+Library Device::timedLoad(const std::function<Library()>& load) {
+  auto before = BinaryCache::getThreadStats();
+  auto start = std::chrono::steady_clock::now();
+  Library lib = load();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  // A compile may follow a miss, but nothing compiles after a hit.
+  bool fromCache = BinaryCache::getThreadStats().hits > before.hits;
+  lib._impl->loadSeconds = seconds;
+  lib._impl->loadedFromCache = fromCache;
+  BinaryCache::recordLibraryLoad(seconds, fromCache);
+  return lib;
+}
+
 Library Device::loadLibraryFromFile(const std::filesystem::path& filename) {
-  return _impl->loadLibraryFromFile(filename);
+  return timedLoad([&] { return _impl->loadLibraryFromFile(filename); });
 }
 
 Library Device::loadLibraryFromText(const std::string& text,
                                     const CompilerOptions& options,
                                     bool retainBinary) const {
-  return _impl->loadLibraryFromText(text, options, retainBinary);
+  std::shared_future<Library> parked;
+  if (_impl->hasPrecompiled() &&
+      _impl->takePrecompiled(
+          implementation::Device::precompileKey(
+              text.data(), text.size(), false, options, retainBinary),
+          parked))
+    return parked.get();
+  return timedLoad(
+      [&] { return _impl->loadLibraryFromText(text, options, retainBinary); });
 }
 
 Library Device::loadLibraryFromData(const void* data, size_t len,
                                     const CompilerOptions& options,
                                     bool retainBinary) const {
-  return _impl->loadLibraryFromData(data, len, options, retainBinary);
+  std::shared_future<Library> parked;
+  if (len > 0 && _impl->hasPrecompiled() &&
+      _impl->takePrecompiled(implementation::Device::precompileKey(
+                                 data, len, true, options, retainBinary),
+                             parked))
+    return parked.get();
+  return timedLoad([&] {
+    return _impl->loadLibraryFromData(data, len, options, retainBinary);
+  });
+}
+
+std::vector<std::shared_future<Library>> Device::precompile(
+    const std::vector<PrecompileEntry>& manifest, size_t workers) const {
+  struct Job {
+    PrecompileEntry entry;
+    std::promise<Library> promise;
+  };
+  struct Batch {
+    // Not owning: the device joins its workers before it is destroyed.
+    implementation::Device* impl;
+    std::vector<Job> jobs;
+    std::atomic<size_t> next{0};
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->impl = _impl.get();
+
+  std::vector<std::shared_future<Library>> futures;
+  futures.reserve(manifest.size());
+  for (auto& e : manifest) {
+    bool binary = !e.binary.empty();
+    std::string key = implementation::Device::precompileKey(
+        binary ? (const void*)e.binary.data() : (const void*)e.source.data(),
+        binary ? e.binary.size() : e.source.size(), binary, e.options,
+        e.retainBinary);
+    Job job;
+    std::shared_future<Library> future = job.promise.get_future().share();
+    // A program that is already parked (or repeated in this manifest)
+    // shares the existing build.
+    if (_impl->parkPrecompiled(key, future)) {
+      job.entry = e;
+      batch->jobs.push_back(std::move(job));
+    }
+    futures.push_back(std::move(future));
+  }
+  if (batch->jobs.empty()) return futures;
+
+  size_t count = workers ? workers : std::thread::hardware_concurrency();
+  count = std::max<size_t>(1, std::min(count, batch->jobs.size()));
+  _impl->startPrecompileWorkers(count, [batch] {
+    void* prev = nullptr;
+    bool active = false;
+    try {
+      batch->impl->activate(&prev);
+      active = true;
+    } catch (...) {
+      // Builds below report the failure through their futures.
+    }
+    for (;;) {
+      size_t i = batch->next++;
+      if (i >= batch->jobs.size()) break;
+      Job& job = batch->jobs[i];
+      auto& e = job.entry;
+      if (batch->impl->precompileStopping()) {
+        job.promise.set_exception(std::make_exception_ptr(std::runtime_error(
+            "Device destroyed before precompile finished")));
+        continue;
+      }
+      try {
+        Library lib = timedLoad([&] {
+          return e.binary.empty()
+                     ? batch->impl->loadLibraryFromText(e.source, e.options,
+                                                        e.retainBinary)
+                     : batch->impl->loadLibraryFromData(
+                           e.binary.data(), e.binary.size(), e.options,
+                           e.retainBinary);
+        });
+        for (auto& name : e.functions) lib.lookupFunction(name);
+        job.promise.set_value(lib);
+      } catch (...) {
+        job.promise.set_exception(std::current_exception());
+      }
+    }
+    if (active) batch->impl->deactivate(prev);
+  });
+  return futures;
 }
 
 void Device::activate(void** prevOut) {
@@ -476,16 +1068,48 @@ void* Device::allocateHostMemory(size_t bytes) const {
 
 void Device::freeHostMemory(void* ptr) const { _impl->freeHostMemory(ptr); }
 
+HostBytes Device::allocateHostBytes(size_t bytes) const {
+  void* p = _impl->allocateHostMemory(bytes);
+  if (!p) throw std::bad_alloc();
+  // The deleter holds the device so the block can always go back to its pool,
+  // even if the last reference is dropped by a backend after a DMA completes.
+  auto impl = _impl;
+  return HostBytes::adopt(p, [impl](void* q) { impl->freeHostMemory(q); });
+}
+
+void Device::trimHostMemoryPool() const { _impl->trimHostMemoryPool(); }
+
+void Device::setHostMemoryPoolLimit(size_t bytes) const {
+  _impl->setHostMemoryPoolLimit(bytes);
+}
+
 void Device::setAllocator(std::shared_ptr<Allocator> a) const {
   _impl->setAllocator(std::move(a));
 }
 
 Allocator* Device::allocator() const { return _impl->allocator(); }
 
+std::shared_ptr<Allocator> Device::nativeAllocator() const {
+  return _impl->nativeAllocator();
+}
+
 Buffer Device::allocateBuffer(size_t bytes, BufferOptions opts) const {
+  if (opts.hint == AllocHint::Transient) {
+    return _impl->allocateTransientBuffer(bytes, opts);
+  }
   return _impl->allocateBuffer(bytes, opts);
 }
 
+void Device::setTransientArenaSize(size_t blockBytes) const {
+  _impl->setTransientArenaSize(blockBytes);
+}
+
+size_t Device::getTransientArenaSize() const {
+  return _impl->getTransientArenaSize();
+}
+
+void Device::resetTransientArena() const { _impl->resetTransientArena(); }
+
 MappedBuffer Device::allocateMappedBuffer(size_t bytes,
                                           BufferOptions opts) const {
   return _impl->allocateMappedBuffer(bytes, opts);
@@ -18,9 +18,18 @@
 #include "sha256.h"
 
 namespace ghost {
+namespace {
+// The CPU is queried once; every digest then uses the fastest block function
+// it supports.
+sha256_blocks_fn blockFunction() {
+  static const sha256_blocks_fn blocks = sha256_blocks_select();
+  return blocks;
+}
+}  // namespace
+
 Digest::Digest() {
   data = new sha256();
-  sha256_init(reinterpret_cast<sha256*>(data));
+  sha256_init_blocks(reinterpret_cast<sha256*>(data), blockFunction());
 }
 
 Digest::~Digest() { delete reinterpret_cast<sha256*>(data); }
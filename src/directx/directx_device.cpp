@@ -860,6 +860,16 @@ MappedBufferDirectX::MappedBufferDirectX(const DeviceDirectX& dev, size_t bytes,
   checkHR(resource->Map(0, &readRange, &mappedPtr));
 }
 
+MappedBufferDirectX::MappedBufferDirectX(ComPtr<ID3D12Resource> res,
+                                         size_t bytes)
+    : BufferDirectX(res, bytes, D3D12_RESOURCE_STATE_GENERIC_READ),
+      mappedPtr(nullptr) {
+  if (_heapType == D3D12_HEAP_TYPE_READBACK)
+    currentState = D3D12_RESOURCE_STATE_COPY_DEST;
+  D3D12_RANGE readRange = {0, 0};
+  checkHR(resource->Map(0, &readRange, &mappedPtr));
+}
+
 MappedBufferDirectX::~MappedBufferDirectX() {
   if (mappedPtr && resource) {
     resource->Unmap(0, nullptr);
@@ -1380,7 +1390,10 @@ DeviceDirectX::DeviceDirectX(const GpuInfo& info) : _adapterDesc{} {
   checkHR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)));
 }
 
-DeviceDirectX::~DeviceDirectX() {}
+DeviceDirectX::~DeviceDirectX() {
+  clearPrecompiled();
+  detachNativeAllocator();
+}
 
 ComPtr<ID3D12Resource> DeviceDirectX::createCommittedBuffer(
     size_t bytes, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_FLAGS flags,
@@ -1406,6 +1419,36 @@ ComPtr<ID3D12Resource> DeviceDirectX::createCommittedBuffer(
   return resource;
 }
 
+void* DeviceDirectX::allocateNativeBuffer(size_t bytes,
+                                          const BufferOptions& opts,
+                                          bool mapped) const {
+  // Same heaps as BufferDirectX and MappedBufferDirectX.
+  D3D12_HEAP_TYPE heapType = D3D12_HEAP_TYPE_DEFAULT;
+  D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+  D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON;
+  if (mapped || opts.hint == AllocHint::Staging) {
+    if (opts.access == Access::WriteOnly) {
+      heapType = D3D12_HEAP_TYPE_READBACK;
+      initialState = D3D12_RESOURCE_STATE_COPY_DEST;
+    } else {
+      heapType = D3D12_HEAP_TYPE_UPLOAD;
+      initialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+    }
+    flags = D3D12_RESOURCE_FLAG_NONE;
+  }
+  try {
+    return createCommittedBuffer(bytes, heapType, flags, initialState)
+        .Detach();
+  } catch (const std::runtime_error&) {
+    return nullptr;
+  }
+}
+
+void DeviceDirectX::freeNativeBuffer(void* handle, size_t bytes,
+                                     bool mapped) const {
+  static_cast<ID3D12Resource*>(handle)->Release();
+}
+
 DXGI_FORMAT DeviceDirectX::getImageFormat(const ImageDescription& descr) const {
   return ::ghost::implementation::getFormat(descr);
 }
@@ -1457,13 +1500,13 @@ ghost::Buffer DeviceDirectX::allocateBuffer(size_t bytes,
 
 ghost::MappedBuffer DeviceDirectX::allocateMappedBuffer(
     size_t bytes, const BufferOptions& opts) const {
-  // DirectX MappedBuffer has no separate "external" constructor today; default
-  // path. External allocator path can be added later — would need a ctor that
-  // accepts an ID3D12Resource and persistently maps it.
   if (auto* a = allocator()) {
     if (void* handle = a->allocateMappedBuffer(bytes, opts)) {
-      // Defensive: hand the handle straight back since we have no ctor path.
-      a->freeMappedBuffer(handle, bytes);
+      ComPtr<ID3D12Resource> res;
+      res.Attach(static_cast<ID3D12Resource*>(handle));
+      auto ptr = std::make_shared<MappedBufferDirectX>(res, bytes);
+      ptr->setAllocator(a);
+      return ghost::MappedBuffer(ptr);
     }
   }
   return ghost::MappedBuffer(
@@ -420,7 +420,8 @@ void LibraryDirectX::saveToCache(const void* data, size_t length,
 
 void LibraryDirectX::loadFromData(const void* data, size_t len,
                                   const CompilerOptions& options) {
-  // Try cache first
+  // Try cache first. A miss only copies the bytecode, so unlike the CUDA
+  // and OpenCL backends there is no compile worth a lockEntry claim.
   loadFromCache(data, len, options);
   if (_bytecode.empty()) {
     _bytecode.resize(len);
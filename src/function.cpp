@@ -17,11 +17,87 @@
 #include <ghost/exception.h>
 #include <ghost/function.h>
 
+#include <exception>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <unordered_set>
+#include <utility>
 
 namespace ghost {
 namespace implementation {
+std::shared_ptr<Function> Library::findFunction(
+    const std::string& name) const {
+  return findFunction(name, nullptr);
+}
+
+std::shared_ptr<Function> Library::findFunction(
+    const std::string* interned) const {
+  std::shared_future<std::shared_ptr<Function>> pending;
+  {
+    std::lock_guard<std::mutex> lock(_functionCacheMutex);
+    auto it = _internedFunctions.find(interned);
+    if (it != _internedFunctions.end() &&
+        it->second.writeDefault == writeDefault) {
+      pending = it->second.function;
+    }
+  }
+  if (pending.valid()) return pending.get();
+  return findFunction(*interned, interned);
+}
+
+std::shared_ptr<Function> Library::findFunction(
+    const std::string& name, const std::string* interned) const {
+  std::promise<std::shared_ptr<Function>> promise;
+  std::shared_future<std::shared_ptr<Function>> pending;
+  WriteDefault policy;
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(_functionCacheMutex);
+    policy = writeDefault;
+    CachedFunction& entry = _functions[name];
+    if (!entry.function.valid() || entry.writeDefault != policy) {
+      entry.function = promise.get_future().share();
+      entry.writeDefault = policy;
+      entry.id = ++_functionCacheId;
+    } else {
+      pending = entry.function;
+    }
+    id = entry.id;
+    if (interned) _internedFunctions[interned] = entry;
+  }
+  if (pending.valid()) return pending.get();
+
+  // Looked up without the lock; callers for the same name wait on the future.
+  std::shared_ptr<Function> fn;
+  try {
+    fn = lookupFunction(name).impl();
+    fn->writeDefault = policy;
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+    std::lock_guard<std::mutex> lock(_functionCacheMutex);
+    auto it = _functions.find(name);
+    if (it != _functions.end() && it->second.id == id) _functions.erase(it);
+    for (auto i = _internedFunctions.begin(); i != _internedFunctions.end();) {
+      if (i->second.id == id)
+        i = _internedFunctions.erase(i);
+      else
+        ++i;
+    }
+    throw;
+  }
+  promise.set_value(fn);
+  return fn;
+}
+
+void Library::clearFunctionCache() {
+  std::lock_guard<std::mutex> lock(_functionCacheMutex);
+  _functions.clear();
+  _internedFunctions.clear();
+}
+
 ghost::Function Library::specializeFunction(
     const std::string& name, const std::vector<Attribute>& args) const {
   throw ghost::unsupported_error();
@@ -55,6 +131,11 @@ void Function::executeIndirect(const ghost::Encoder& s,
   execute(s, la, args);
 }
 
+std::shared_ptr<DispatchState> Function::bind(
+    const std::vector<Attribute>& args) {
+  return nullptr;
+}
+
 uint32_t Function::preferredSubgroupSize() const {
   return (uint32_t)getAttribute(kFunctionThreadWidth).asInt();
 }
@@ -64,6 +145,16 @@ void Function::setAttribute(FunctionAttributeId what, const Attribute& value) {
 }
 }  // namespace implementation
 
+namespace {
+const std::string* intern(const std::string& name) {
+  static std::mutex mutex;
+  // Never destroyed, so static FunctionNames stay valid during exit.
+  static auto* names = new std::unordered_set<std::string>();
+  std::lock_guard<std::mutex> lock(mutex);
+  return &*names->insert(name).first;
+}
+}  // namespace
+
 Function::Function(std::shared_ptr<implementation::Function> impl)
     : _impl(impl) {}
 
@@ -72,10 +163,10 @@ Function::BoundFunction::BoundFunction(
     const LaunchArgs& launchArgs, const Encoder& encoder)
     : _impl(impl), _launchArgs(launchArgs), _encoder(encoder) {}
 
-void Function::BoundFunction::dispatch(const std::vector<Attribute>& args) {
+void Function::BoundFunction::dispatch(std::vector<Attribute>&& args) {
   auto* cb = _encoder.impl()->asCommandBuffer();
   if (cb)
-    cb->dispatch(_impl, _launchArgs, args);
+    cb->dispatch(_impl, _launchArgs, std::move(args));
   else
     _impl->execute(_encoder, _launchArgs, args);
 }
@@ -89,6 +180,85 @@ void Function::execute(const Encoder& s, const LaunchArgs& launchArgs,
     _impl->execute(s, launchArgs, args);
 }
 
+struct Dispatch::State {
+  State(const Function& function, const LaunchArgs& launchArgs,
+        std::vector<Attribute>&& args)
+      : function(function), launchArgs(launchArgs), args(std::move(args)) {}
+
+  Function function;
+  LaunchArgs launchArgs;
+  // Never resized after binding: backend state may point into it.
+  std::vector<Attribute> args;
+  std::optional<size_t> writeCount;
+  // Declared last so it is destroyed before the function it was built from.
+  std::shared_ptr<implementation::DispatchState> native;
+};
+
+Dispatch::Dispatch(const Function& function, const LaunchArgs& launchArgs,
+                   std::vector<Attribute> args)
+    : _state(std::make_shared<State>(function, launchArgs, std::move(args))) {
+  _state->native = function.impl()->bind(_state->args);
+}
+
+const LaunchArgs& Dispatch::launchArgs() const { return _state->launchArgs; }
+
+Dispatch& Dispatch::launchArgs(const LaunchArgs& launchArgs) {
+  _state->launchArgs = launchArgs;
+  return *this;
+}
+
+size_t Dispatch::size() const { return _state->args.size(); }
+
+const Attribute& Dispatch::arg(size_t index) const {
+  return _state->args.at(index);
+}
+
+Dispatch& Dispatch::set(size_t index, const Attribute& value) {
+  auto& args = _state->args;
+  if (index >= args.size()) {
+    throw std::out_of_range("Dispatch: argument " + std::to_string(index) +
+                            " is not bound");
+  }
+  if (value.type() != args[index].type()) {
+    throw std::invalid_argument("Dispatch: argument " +
+                                std::to_string(index) +
+                                " cannot change type");
+  }
+  args[index] = value;
+  Attribute& a = args[index];
+  if (_state->writeCount && !a.access() &&
+      (a.type() == Attribute::Type_Buffer ||
+       a.type() == Attribute::Type_Image)) {
+    size_t resourceIndex = 0;
+    for (size_t k = 0; k < index; k++) {
+      if (args[k].type() == Attribute::Type_Buffer ||
+          args[k].type() == Attribute::Type_Image)
+        ++resourceIndex;
+    }
+    a.access(resourceIndex < *_state->writeCount ? Access::WriteOnly
+                                                 : Access::ReadOnly);
+  }
+  if (_state->native) _state->native->argChanged(args, index);
+  return *this;
+}
+
+Dispatch& Dispatch::writes(size_t n) {
+  _state->writeCount = n;
+  implementation::Function::stampWrites(_state->args, n);
+  return *this;
+}
+
+void Dispatch::enqueue(const Encoder& encoder) {
+  const auto& impl = _state->function.impl();
+  auto* cb = encoder.impl()->asCommandBuffer();
+  if (cb)
+    cb->dispatch(impl, _state->launchArgs, _state->args);
+  else if (_state->native)
+    _state->native->enqueue(encoder, _state->launchArgs, _state->args);
+  else
+    impl->execute(encoder, _state->launchArgs, _state->args);
+}
+
 Attribute Function::getAttribute(FunctionAttributeId what) const {
   return _impl->getAttribute(what);
 }
@@ -103,14 +273,26 @@ uint32_t Function::preferredSubgroupSize() const {
 
 Library::Library(std::shared_ptr<implementation::Library> impl) : _impl(impl) {}
 
+FunctionName::FunctionName(const std::string& name) : _name(intern(name)) {}
+
+FunctionName::FunctionName(const char* name) : _name(intern(name)) {}
+
 Function Library::lookupFunction(const std::string& name) const {
-  Function fn = _impl->lookupFunction(name);
-  return _stamp(fn);
+  Function fn(_impl->findFunction(name));
+  fn._parent = _impl;
+  return fn;
+}
+
+Function Library::lookupFunction(const FunctionName& name) const {
+  Function fn(_impl->findFunction(name._name));
+  fn._parent = _impl;
+  return fn;
 }
 
 void Library::setGlobals(
     const std::vector<std::pair<std::string, Attribute>>& globals) {
   _impl->setGlobals(globals);
+  _impl->clearFunctionCache();
 }
 
 std::vector<uint8_t> Library::getBinary() const { return _impl->getBinary(); }
@@ -0,0 +1,151 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include <ghost/io.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ghost {
+
+MappedFile::MappedFile() : _data(nullptr), _size(0) {}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const char* path) {
+  close();
+#if defined(_WIN32)
+  HANDLE file =
+      CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  // The view keeps the file open; neither handle is needed past this point.
+  CloseHandle(file);
+  if (!mapping) return false;
+  void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!p) return false;
+  _data = static_cast<const unsigned char*>(p);
+  _size = size_t(size.QuadPart);
+#else
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds its own reference to the file.
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+  _data = static_cast<const unsigned char*>(p);
+  _size = size_t(st.st_size);
+#endif
+  return true;
+}
+
+void MappedFile::close() {
+  if (!_data) return;
+#if defined(_WIN32)
+  UnmapViewOfFile(_data);
+#else
+  munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+  _data = nullptr;
+  _size = 0;
+}
+
+FileLock::FileLock() : _handle(-1) {}
+
+FileLock::~FileLock() { unlock(); }
+
+FileLock::Result FileLock::tryLock(const char* path) {
+  unlock();
+#if defined(_WIN32)
+  // Every opener shares delete access, so the file disappears once the last
+  // handle closes; the holder's is the one that matters.
+  HANDLE file = CreateFileA(
+      path, GENERIC_READ | GENERIC_WRITE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return Result::Failed;
+  OVERLAPPED overlapped = {};
+  if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0,
+                  1, 0, &overlapped)) {
+    CloseHandle(file);
+    return Result::Busy;
+  }
+  _handle = reinterpret_cast<intptr_t>(file);
+#else
+  for (;;) {
+    int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) return Result::Failed;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      bool busy = errno == EWOULDBLOCK;
+      ::close(fd);
+      return busy ? Result::Busy : Result::Failed;
+    }
+    // The previous holder unlinks the file before releasing it, so the lock
+    // just taken may be on a file that is no longer at @p path. Only a lock
+    // on the file currently at the path counts; otherwise start over.
+    struct stat held, current;
+    if (fstat(fd, &held) == 0 && stat(path, &current) == 0 &&
+        held.st_dev == current.st_dev && held.st_ino == current.st_ino) {
+      _handle = fd;
+      break;
+    }
+    ::close(fd);
+  }
+#endif
+  _path = path;
+  return Result::Locked;
+}
+
+void FileLock::unlock() {
+  if (_handle == -1) return;
+#if defined(_WIN32)
+  CloseHandle(reinterpret_cast<HANDLE>(_handle));
+#else
+  // Unlink while still holding the lock, so a waiter that opened the old
+  // file notices and retries on a fresh one.
+  ::unlink(_path.c_str());
+  ::close(int(_handle));
+#endif
+  _handle = -1;
+  _path.clear();
+}
+
+}  // namespace ghost
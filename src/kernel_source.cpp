@@ -15,18 +15,27 @@
 #include <ghost/exception.h>
 #include <ghost/kernel_source.h>
 
+#include <algorithm>
+#include <functional>
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace ghost {
 
+namespace {
+// Nominal footprint of a variant specialized from a shared base library.
+const size_t kSpecializedVariantBytes = 4096;
+}  // namespace
+
 KernelSource::KernelSource(const std::string& text,
                            const CompilerOptions& baseOptions, bool useDefines)
     : _mode(Mode::Text),
       _forceDefines(useDefines),
       _text(text),
-      _baseOptions(baseOptions),
-      _baseLibrary(nullptr) {}
+      _baseOptions(baseOptions) {}
 
 KernelSource::KernelSource(const void* data, size_t len,
                            const CompilerOptions& baseOptions)
@@ -34,67 +43,66 @@ KernelSource::KernelSource(const void* data, size_t len,
       _forceDefines(false),
       _binaryData(static_cast<const uint8_t*>(data),
                   static_cast<const uint8_t*>(data) + len),
-      _baseOptions(baseOptions),
-      _baseLibrary(nullptr) {}
+      _baseOptions(baseOptions) {}
 
-std::string KernelSource::makeKey(
-    const std::string& functionName,
-    const std::vector<std::pair<std::string, Attribute>>& constants) {
-  std::ostringstream key;
-  key << functionName;
-  for (auto& c : constants) {
-    key << ':' << c.first << '=';
-    auto& attr = c.second;
-    switch (attr.type()) {
-      case Attribute::Type_Float:
-        key << std::setprecision(9) << attr.asFloat() << 'f';
-        break;
-      case Attribute::Type_Int:
-        key << attr.asInt();
-        break;
-      case Attribute::Type_UInt:
-        key << attr.asUInt() << 'u';
-        break;
-      case Attribute::Type_Bool:
-        key << (attr.asBool() ? '1' : '0');
-        break;
-      default:
-        key << "?";
-        break;
-    }
-  }
-  return key.str();
-}
+namespace {
 
-static void appendAttrToKey(std::ostringstream& key, const Attribute& attr) {
+// Key layout: a mode byte ('N' named, 'P' positional), the function name
+// and a NUL, then per constant its name and a NUL (named only), its type
+// tag and its 32-bit value, which is what every backend compiles. Each
+// constant is self-delimiting, so no separators or indices are needed.
+void packAttribute(std::string& bytes, const Attribute& attr) {
+  bytes.push_back(static_cast<char>(attr.type()));
   switch (attr.type()) {
-    case Attribute::Type_Float:
-      key << std::setprecision(9) << attr.asFloat() << 'f';
+    case Attribute::Type_Float: {
+      float v = attr.asFloat();
+      bytes.append(reinterpret_cast<const char*>(&v), sizeof(v));
       break;
-    case Attribute::Type_Int:
-      key << attr.asInt();
+    }
+    case Attribute::Type_Int: {
+      int32_t v = attr.asInt();
+      bytes.append(reinterpret_cast<const char*>(&v), sizeof(v));
       break;
-    case Attribute::Type_UInt:
-      key << attr.asUInt() << 'u';
+    }
+    case Attribute::Type_UInt: {
+      uint32_t v = attr.asUInt();
+      bytes.append(reinterpret_cast<const char*>(&v), sizeof(v));
       break;
+    }
     case Attribute::Type_Bool:
-      key << (attr.asBool() ? '1' : '0');
+      bytes.push_back(attr.asBool() ? 1 : 0);
       break;
     default:
-      key << "?";
       break;
   }
 }
 
-std::string KernelSource::makeKey(const std::string& functionName,
-                                  const std::vector<Attribute>& constants) {
-  std::ostringstream key;
-  key << functionName;
-  for (size_t i = 0; i < constants.size(); i++) {
-    key << ':' << i << '=';
-    appendAttrToKey(key, constants[i]);
+}  // namespace
+
+void KernelSource::makeKey(
+    const std::string& functionName,
+    const std::vector<std::pair<std::string, Attribute>>& constants,
+    VariantKey& key) {
+  key.bytes.clear();
+  key.bytes.push_back('N');
+  key.bytes.append(functionName.c_str(), functionName.size() + 1);
+  for (auto& c : constants) {
+    key.bytes.append(c.first.c_str(), c.first.size() + 1);
+    packAttribute(key.bytes, c.second);
+  }
+  key.hash = std::hash<std::string>()(key.bytes);
+}
+
+void KernelSource::makeKey(const std::string& functionName,
+                           const std::vector<Attribute>& constants,
+                           VariantKey& key) {
+  key.bytes.clear();
+  key.bytes.push_back('P');
+  key.bytes.append(functionName.c_str(), functionName.size() + 1);
+  for (auto& c : constants) {
+    packAttribute(key.bytes, c);
   }
-  return key.str();
+  key.hash = std::hash<std::string>()(key.bytes);
 }
 
 void KernelSource::constantsToDefines(
@@ -141,10 +149,213 @@ std::vector<Attribute> KernelSource::constantsToPositional(
   return result;
 }
 
+std::shared_ptr<KernelSource::DeviceState> KernelSource::stateFor(
+    const Device& device) {
+  const implementation::Device* id = device.impl().get();
+  {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _devices.find(id);
+    if (it != _devices.end() && !it->second->device.expired()) {
+      return it->second;
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  auto it = _devices.find(id);
+  if (it != _devices.end() && !it->second->device.expired()) {
+    return it->second;
+  }
+  // New device, or one reusing a destroyed device's address. Drop state
+  // for destroyed devices while we are here.
+  for (auto jt = _devices.begin(); jt != _devices.end();) {
+    if (jt->second->device.expired()) {
+      jt = _devices.erase(jt);
+    } else {
+      ++jt;
+    }
+  }
+  auto state = std::make_shared<DeviceState>();
+  state->id = id;
+  state->device = device.impl();
+  _devices[id] = state;
+  return state;
+}
+
+void KernelSource::resolveStrategy(Device& device, DeviceState& state) {
+  if (state.capabilityChecked.load(std::memory_order_acquire)) return;
+  // Compiles of other variants wait here only until the base library is
+  // built; a failed build leaves the strategy unresolved for a retry.
+  std::lock_guard<std::mutex> lock(state.strategyMutex);
+  if (state.capabilityChecked.load(std::memory_order_relaxed)) return;
+  bool useSpecialization = false;
+  if (_mode == Mode::Text) {
+    if (_forceDefines) {
+      // Caller explicitly requested -D defines for all backends.
+    } else if (device.getAttribute(kDeviceSupportsProgramConstants).asBool()) {
+      // Metal / Vulkan: compile once, specialize per variant.
+      useSpecialization = true;
+      state.baseLibrary = device.loadLibraryFromText(_text, _baseOptions);
+      state.hasBaseLibrary = true;
+    } else if (device.getAttribute(kDeviceSupportsProgramGlobals).asBool()) {
+      // CUDA: compile once, reuse binary per variant with setGlobals.
+      Library base = device.loadLibraryFromText(_text, _baseOptions, true);
+      state.baseBinary = base.getBinary();
+      state.baseLibrary = base;
+      state.hasBaseLibrary = true;
+    }
+    // Otherwise (OpenCL / other): compile per variant with -D defines.
+  } else {
+    useSpecialization =
+        device.getAttribute(kDeviceSupportsProgramConstants).asBool();
+    if (useSpecialization) {
+      // Metal metallib / Vulkan SPIR-V: load once, specialize per
+      // variant.
+      state.baseLibrary = device.loadLibraryFromData(
+          _binaryData.data(), _binaryData.size(), _baseOptions);
+      state.hasBaseLibrary = true;
+    }
+  }
+  state.useSpecialization = useSpecialization;
+  state.capabilityChecked.store(true, std::memory_order_release);
+}
+
+template <typename Build>
+Function KernelSource::getOrBuild(DeviceState& state, const VariantKey& key,
+                                  Build&& build) {
+  std::shared_future<Function> pending;
+  // Fast path: cached or in flight, under a shared lock.
+  {
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = state.cache.find(key);
+    if (it != state.cache.end()) {
+      it->second.lastUse.store(++_useClock, std::memory_order_relaxed);
+      pending = it->second.function;
+    }
+  }
+  if (pending.valid()) return pending.get();
+
+  // Own the key: the caller's may be scratch storage.
+  VariantKey owned = key;
+  std::promise<Function> promise;
+  {
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    auto it = state.cache.find(owned);
+    if (it != state.cache.end()) {
+      pending = it->second.function;
+    } else {
+      CacheEntry& entry = state.cache[owned];
+      entry.function = promise.get_future().share();
+      entry.lastUse.store(++_useClock, std::memory_order_relaxed);
+    }
+  }
+  if (pending.valid()) return pending.get();
+
+  // This thread builds the variant, without holding the lock.
+  Function fn(nullptr);
+  size_t bytes = 0;
+  try {
+    fn = build(bytes);
+  } catch (...) {
+    // Current waiters get the error; later callers try again.
+    promise.set_exception(std::current_exception());
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    state.cache.erase(owned);
+    throw;
+  }
+  promise.set_value(fn);
+
+  std::vector<std::shared_future<Function>> evicted;
+  {
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    auto it = state.cache.find(owned);
+    if (it != state.cache.end()) {
+      it->second.bytes = bytes;
+      it->second.ready = true;
+      state.cacheBytes += bytes;
+      trimLocked(state, &it->second, evicted);
+    }
+  }
+  // Evicted variants are released here, outside the lock.
+  return fn;
+}
+
+void KernelSource::trimLocked(
+    DeviceState& state, const CacheEntry* keep,
+    std::vector<std::shared_future<Function>>& evicted) {
+  const size_t maxVariants = _limits.maxVariants;
+  const size_t maxBytes = _limits.maxBytes;
+  auto over = [&] {
+    return (maxVariants != 0 && state.cache.size() > maxVariants) ||
+           (maxBytes != 0 && state.cacheBytes > maxBytes);
+  };
+  if (!over()) return;
+
+  // One pass collects the finished variants; a min-heap on last use then
+  // yields victims oldest first. Variants still compiling have waiters and
+  // are never evicted. lastUse cannot change while the exclusive lock is
+  // held.
+  using Candidate = std::pair<uint64_t, decltype(state.cache.begin())>;
+  std::vector<Candidate> candidates;
+  candidates.reserve(state.cache.size());
+  for (auto it = state.cache.begin(); it != state.cache.end(); ++it) {
+    if (!it->second.ready || &it->second == keep) continue;
+    candidates.emplace_back(
+        it->second.lastUse.load(std::memory_order_relaxed), it);
+  }
+  auto newer = [](const Candidate& a, const Candidate& b) {
+    return a.first > b.first;
+  };
+  std::make_heap(candidates.begin(), candidates.end(), newer);
+  while (over() && !candidates.empty()) {
+    std::pop_heap(candidates.begin(), candidates.end(), newer);
+    auto victim = candidates.back().second;
+    candidates.pop_back();
+    state.cacheBytes -= victim->second.bytes;
+    evicted.push_back(std::move(victim->second.function));
+    state.cache.erase(victim);
+  }
+}
+
+size_t KernelSource::estimateBytes(const DeviceState& state,
+                                   bool hasConstants) const {
+  // Variants specialized from the shared base library own only a pipeline
+  // object; the others own a library built from the whole source or binary.
+  if (state.useSpecialization || (!hasConstants && state.hasBaseLibrary)) {
+    return kSpecializedVariantBytes;
+  }
+  if (_mode == Mode::Text) {
+    return state.baseBinary.empty() ? _text.size() : state.baseBinary.size();
+  }
+  return _binaryData.size();
+}
+
+void KernelSource::setCacheLimits(const CacheLimits& limits) {
+  std::vector<std::shared_future<Function>> evicted;
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  _limits = limits;
+  for (auto& d : _devices) {
+    trimLocked(*d.second, nullptr, evicted);
+  }
+  // The lock is released before the evicted variants.
+}
+
+KernelSource::CacheLimits KernelSource::cacheLimits() const {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _limits;
+}
+
+size_t KernelSource::cachedVariants() const {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  size_t count = 0;
+  for (auto& d : _devices) {
+    count += d.second->cache.size();
+  }
+  return count;
+}
+
 // Text mode: OpenCL C, Metal Shading Language, CUDA NVRTC.
 //
-// Strategy selection (first call only) — chosen from device capability
-// attributes so no speculative compile is ever performed:
+// Strategy selection (first call per device) — chosen from device
+// capability attributes so no speculative compile is ever performed:
 //   1. kDeviceSupportsProgramConstants (Metal, Vulkan): compile once,
 //      specialize per variant via function/spec constants.
 //   2. kDeviceSupportsProgramGlobals (CUDA): compile once with
@@ -154,57 +365,38 @@ std::vector<Attribute> KernelSource::constantsToPositional(
 //
 // Strategy 3 is also used when useDefines=true is passed to the constructor.
 Function KernelSource::getFunctionFromText(
-    Device& device, const std::string& functionName,
+    Device& device, DeviceState& state, const std::string& functionName,
     const std::vector<std::pair<std::string, Attribute>>& constants) {
-  if (!_capabilityChecked) {
-    _capabilityChecked = true;
-    if (_forceDefines) {
-      // Caller explicitly requested -D defines for all backends.
-      _useSpecialization = false;
-    } else if (device.getAttribute(kDeviceSupportsProgramConstants).asBool()) {
-      // Metal / Vulkan: compile once, specialize per variant.
-      _useSpecialization = true;
-      _baseLibrary = device.loadLibraryFromText(_text, _baseOptions);
-      _hasBaseLibrary = true;
-    } else if (device.getAttribute(kDeviceSupportsProgramGlobals).asBool()) {
-      // CUDA: compile once, reuse binary per variant with setGlobals.
-      Library base = device.loadLibraryFromText(_text, _baseOptions, true);
-      _binaryData = base.getBinary();
-      _useSpecialization = false;
-      _baseLibrary = base;
-      _hasBaseLibrary = true;
-    } else {
-      // OpenCL / other: compile per variant with -D defines.
-      _useSpecialization = false;
-    }
-  }
+  resolveStrategy(device, state);
 
   // Path 1: specialization (Metal, Vulkan).
-  if (_useSpecialization && _hasBaseLibrary) {
+  if (state.useSpecialization && state.hasBaseLibrary) {
     if (constants.empty()) {
-      return _baseLibrary.lookupFunction(functionName);
+      return state.baseLibrary.lookupFunction(functionName);
     }
     try {
-      return _baseLibrary.lookupSpecializedFunction(functionName, constants);
+      return state.baseLibrary.lookupSpecializedFunction(functionName,
+                                                         constants);
     } catch (const ghost::unsupported_error&) {
       // Named not supported; try positional (Vulkan).
     }
     try {
       const std::vector<Attribute> positional =
           constantsToPositional(constants);
-      return _baseLibrary.lookupSpecializedFunction(functionName, positional);
+      return state.baseLibrary.lookupSpecializedFunction(functionName,
+                                                         positional);
     } catch (const ghost::unsupported_error&) {
-      _useSpecialization = false;
+      state.useSpecialization = false;
     }
   }
 
   // Path 2: binary reuse + setGlobals (CUDA).
-  if (!_binaryData.empty()) {
-    if (constants.empty() && _hasBaseLibrary) {
-      return _baseLibrary.lookupFunction(functionName);
+  if (!state.baseBinary.empty()) {
+    if (constants.empty() && state.hasBaseLibrary) {
+      return state.baseLibrary.lookupFunction(functionName);
     }
-    Library lib = device.loadLibraryFromData(_binaryData.data(),
-                                             _binaryData.size(), _baseOptions);
+    Library lib = device.loadLibraryFromData(
+        state.baseBinary.data(), state.baseBinary.size(), _baseOptions);
     if (!constants.empty()) {
       lib.setGlobals(constants);
     }
@@ -220,28 +412,18 @@ Function KernelSource::getFunctionFromText(
 
 // Binary mode: Metal metallib, CUDA fatbin/PTX, Vulkan SPIR-V.
 Function KernelSource::getFunctionFromBinary(
-    Device& device, const std::string& functionName,
+    Device& device, DeviceState& state, const std::string& functionName,
     const std::vector<std::pair<std::string, Attribute>>& constants) {
-  if (!_capabilityChecked) {
-    _capabilityChecked = true;
-    _useSpecialization =
-        device.getAttribute(kDeviceSupportsProgramConstants).asBool();
-    if (_useSpecialization) {
-      // Metal metallib / Vulkan SPIR-V: load once, specialize per
-      // variant.
-      _baseLibrary = device.loadLibraryFromData(
-          _binaryData.data(), _binaryData.size(), _baseOptions);
-      _hasBaseLibrary = true;
-    }
-  }
+  resolveStrategy(device, state);
 
-  if (_useSpecialization && _hasBaseLibrary) {
+  if (state.useSpecialization && state.hasBaseLibrary) {
     if (constants.empty()) {
-      return _baseLibrary.lookupFunction(functionName);
+      return state.baseLibrary.lookupFunction(functionName);
     }
     // Try named specialization (Metal).
     try {
-      return _baseLibrary.lookupSpecializedFunction(functionName, constants);
+      return state.baseLibrary.lookupSpecializedFunction(functionName,
+                                                         constants);
     } catch (const ghost::unsupported_error&) {
       // Not supported as named; try positional (Vulkan).
     }
@@ -250,11 +432,12 @@ Function KernelSource::getFunctionFromBinary(
     try {
       const std::vector<Attribute> positional =
           constantsToPositional(constants);
-      return _baseLibrary.lookupSpecializedFunction(functionName, positional);
+      return state.baseLibrary.lookupSpecializedFunction(functionName,
+                                                         positional);
     } catch (const ghost::unsupported_error&) {
       // Shouldn't happen if kDeviceSupportsProgramConstants is true,
       // but fall through to setGlobals path just in case.
-      _useSpecialization = false;
+      state.useSpecialization = false;
     }
   }
 
@@ -269,89 +452,99 @@ Function KernelSource::getFunctionFromBinary(
   return lib.lookupFunction(functionName);
 }
 
-Function KernelSource::getFunction(
-    Device& device, const std::string& functionName,
+Function KernelSource::buildNamed(
+    Device& device, DeviceState& state, const std::string& functionName,
     const std::vector<std::pair<std::string, Attribute>>& constants) {
-  std::string key = makeKey(functionName, constants);
+  return (_mode == Mode::Text)
+             ? getFunctionFromText(device, state, functionName, constants)
+             : getFunctionFromBinary(device, state, functionName, constants);
+}
 
-  // Fast path: cache hit under shared lock.
-  {
-    std::shared_lock<std::shared_mutex> lock(_mutex);
-    auto it = _cache.find(key);
-    if (it != _cache.end()) {
-      return it->second;
-    }
+Function KernelSource::buildPositional(
+    Device& device, DeviceState& state, const std::string& functionName,
+    const std::vector<Attribute>& constants) {
+  resolveStrategy(device, state);
+  // Positional constants only make sense on specialization backends
+  // (Metal, Vulkan).
+  if (!state.useSpecialization || !state.hasBaseLibrary) {
+    throw ghost::unsupported_error();
   }
-
-  // Slow path: compile under exclusive lock.
-  std::unique_lock<std::shared_mutex> lock(_mutex);
-
-  // Double-check after acquiring exclusive lock.
-  auto it = _cache.find(key);
-  if (it != _cache.end()) {
-    return it->second;
+  if (constants.empty()) {
+    return state.baseLibrary.lookupFunction(functionName);
   }
+  return state.baseLibrary.lookupSpecializedFunction(functionName, constants);
+}
 
-  Function fn = (_mode == Mode::Text)
-                    ? getFunctionFromText(device, functionName, constants)
-                    : getFunctionFromBinary(device, functionName, constants);
-
-  _cache.emplace(key, fn);
-  return fn;
+Function KernelSource::getFunction(
+    Device& device, const std::string& functionName,
+    const std::vector<std::pair<std::string, Attribute>>& constants) {
+  // Reused per thread so that a cache hit does not allocate.
+  static thread_local VariantKey key;
+  makeKey(functionName, constants, key);
+  std::shared_ptr<DeviceState> state = stateFor(device);
+  return getOrBuild(*state, key, [&](size_t& bytes) {
+    Function fn = buildNamed(device, *state, functionName, constants);
+    bytes = estimateBytes(*state, !constants.empty());
+    return fn;
+  });
 }
 
 Function KernelSource::getSpecializedFunction(
     Device& device, const std::string& functionName,
     const std::vector<Attribute>& constants) {
-  std::string key = makeKey(functionName, constants);
-
-  // Fast path: cache hit under shared lock.
-  {
-    std::shared_lock<std::shared_mutex> lock(_mutex);
-    auto it = _cache.find(key);
-    if (it != _cache.end()) {
-      return it->second;
-    }
-  }
-
-  // Slow path: compile under exclusive lock.
-  std::unique_lock<std::shared_mutex> lock(_mutex);
+  static thread_local VariantKey key;
+  makeKey(functionName, constants, key);
+  std::shared_ptr<DeviceState> state = stateFor(device);
+  return getOrBuild(*state, key, [&](size_t& bytes) {
+    bytes = kSpecializedVariantBytes;
+    return buildPositional(device, *state, functionName, constants);
+  });
+}
 
-  auto it = _cache.find(key);
-  if (it != _cache.end()) {
-    return it->second;
-  }
+KernelSource::Variant KernelSource::variant(
+    Device& device, const std::string& functionName,
+    const std::vector<std::pair<std::string, Attribute>>& constants) {
+  Variant v;
+  v._source = this;
+  v._state = stateFor(device);
+  makeKey(functionName, constants, v._key);
+  v._functionName = functionName;
+  v._constants = constants;
+  return v;
+}
 
-  // Ensure base library exists. Positional constants only make sense on
-  // specialization backends (Metal, Vulkan).
-  if (!_capabilityChecked) {
-    _capabilityChecked = true;
-    _useSpecialization =
-        device.getAttribute(kDeviceSupportsProgramConstants).asBool();
-    if (_useSpecialization) {
-      if (_mode == Mode::Text) {
-        _baseLibrary = device.loadLibraryFromText(_text, _baseOptions);
-      } else {
-        _baseLibrary = device.loadLibraryFromData(
-            _binaryData.data(), _binaryData.size(), _baseOptions);
-      }
-      _hasBaseLibrary = true;
-    }
-  }
+KernelSource::Variant KernelSource::specializedVariant(
+    Device& device, const std::string& functionName,
+    const std::vector<Attribute>& constants) {
+  Variant v;
+  v._source = this;
+  v._state = stateFor(device);
+  makeKey(functionName, constants, v._key);
+  v._functionName = functionName;
+  v._positional = true;
+  v._positionalConstants = constants;
+  return v;
+}
 
-  if (!_hasBaseLibrary) {
-    throw ghost::unsupported_error();
+Function KernelSource::getFunction(Device& device, const Variant& variant) {
+  if (!variant.valid() || variant._source != this) {
+    throw std::invalid_argument("variant is not from this KernelSource");
   }
-
-  Function fn(nullptr);
-  if (constants.empty()) {
-    fn = _baseLibrary.lookupFunction(functionName);
-  } else {
-    fn = _baseLibrary.lookupSpecializedFunction(functionName, constants);
+  DeviceState& state = *variant._state;
+  if (state.id != device.impl().get() || state.device.expired()) {
+    throw std::invalid_argument("variant was resolved for another device");
   }
-
-  _cache.emplace(key, fn);
-  return fn;
+  return getOrBuild(state, variant._key, [&](size_t& bytes) {
+    if (variant._positional) {
+      bytes = kSpecializedVariantBytes;
+      return buildPositional(device, state, variant._functionName,
+                             variant._positionalConstants);
+    }
+    Function fn = buildNamed(device, state, variant._functionName,
+                             variant._constants);
+    bytes = estimateBytes(state, !variant._constants.empty());
+    return fn;
+  });
 }
 
 }  // namespace ghost
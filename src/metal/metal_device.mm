@@ -1380,6 +1380,11 @@ DeviceMetal::DeviceMetal(id<MTLDevice> device) {
   checkExists(queue);
 }
 
+DeviceMetal::~DeviceMetal() {
+  clearPrecompiled();
+  detachNativeAllocator();
+}
+
 ghost::Library DeviceMetal::loadLibraryFromText(const std::string &text,
                                                 const CompilerOptions &options,
                                                 bool retainBinary) const {
@@ -1490,6 +1495,27 @@ DeviceMetal::allocateMappedBuffer(size_t bytes,
   return ghost::MappedBuffer(ptr);
 }
 
+void *DeviceMetal::allocateNativeBuffer(size_t bytes, const BufferOptions &opts,
+                                        bool mapped) const {
+  // Built through the usual constructors so the resource options match.
+  try {
+    if (mapped) {
+      implementation::MappedBufferMetal buf(*this, bytes, opts);
+      return GHOST_OBJC_BRIDGE_RETAINED(void *, buf.mem.release());
+    }
+    implementation::BufferMetal buf(*this, bytes, opts);
+    return GHOST_OBJC_BRIDGE_RETAINED(void *, buf.mem.release());
+  } catch (const std::runtime_error &) {
+    return nullptr;
+  }
+}
+
+void DeviceMetal::freeNativeBuffer(void *handle, size_t bytes,
+                                   bool mapped) const {
+  id<MTLBuffer> buf = GHOST_OBJC_BRIDGE_TRANSFER(id<MTLBuffer>, handle);
+  objc::ptr<id<MTLBuffer>> release(buf, /*retainObject=*/true);
+}
+
 ghost::Image DeviceMetal::allocateImage(const ImageDescription &descr) const {
   if (heap) {
     objc::ptr<MTLTextureDescriptor *> textureDescriptor(
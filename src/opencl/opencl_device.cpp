@@ -1124,6 +1124,62 @@ DeviceOpenCL::DeviceOpenCL(cl_platform_id platform, cl_device_id device) {
   set_of(_extensions, getString(CL_DEVICE_EXTENSIONS));
 }
 
+DeviceOpenCL::~DeviceOpenCL() {
+  clearPrecompiled();
+  detachNativeAllocator();
+  trimHostMemoryPool();
+}
+
+void* DeviceOpenCL::allocateNativeBuffer(size_t bytes,
+                                         const BufferOptions& opts,
+                                         bool mapped) const {
+  cl_mem_flags flags = getMemFlags(opts.access);
+  if (mapped || opts.hint == AllocHint::Staging) {
+    flags |= CL_MEM_ALLOC_HOST_PTR;
+  }
+  cl_int err;
+  cl_mem mem = clCreateBuffer(context, flags, bytes, nullptr, &err);
+  return err == CL_SUCCESS ? (void*)mem : nullptr;
+}
+
+void DeviceOpenCL::freeNativeBuffer(void* handle, size_t bytes,
+                                    bool mapped) const {
+  clReleaseMemObject(reinterpret_cast<cl_mem>(handle));
+}
+
+void* DeviceOpenCL::allocatePinnedMemory(size_t bytes) const {
+  cl_int err;
+  cl_mem mem =
+      clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes,
+                     nullptr, &err);
+  if (err != CL_SUCCESS) return nullptr;
+  void* ptr =
+      clEnqueueMapBuffer(queue, mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0,
+                         bytes, 0, nullptr, nullptr, &err);
+  if (err != CL_SUCCESS) {
+    clReleaseMemObject(mem);
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(_pinnedMutex);
+  _pinned[ptr] = mem;
+  return ptr;
+}
+
+void DeviceOpenCL::freePinnedMemory(void* ptr) const {
+  cl_mem mem;
+  {
+    std::lock_guard<std::mutex> lock(_pinnedMutex);
+    auto it = _pinned.find(ptr);
+    if (it == _pinned.end()) return;
+    mem = it->second;
+    _pinned.erase(it);
+  }
+  // Nothing references a block once it is freed, so the unmap may complete
+  // asynchronously; the runtime defers the release until it has.
+  clEnqueueUnmapMemObject(queue, mem, ptr, 0, nullptr, nullptr);
+  clReleaseMemObject(mem);
+}
+
 ghost::Library DeviceOpenCL::loadLibraryFromText(const std::string& text,
                                                  const CompilerOptions& options,
                                                  bool retainBinary) const {
@@ -1459,7 +1515,9 @@ void ExecutableOpenCL::build(cl_command_queue queue) {
           using T = std::decay_t<decltype(cmd)>;
           if constexpr (std::is_same_v<T, DispatchCmd>) {
             auto* fn = static_cast<FunctionOpenCL*>(cmd.function.get());
-            fn->bindArgs(cmd.args);
+            // Recorded commands reference the kernel that owns fn->kernel.
+            auto instance = fn->acquire(true);
+            fn->bindArgs(*instance, cmd.args);
             size_t global[3], local[3];
             for (int i = 0; i < 3; i++) {
               global[i] = cmd.launchArgs.global_size()[i];
@@ -24,6 +24,7 @@
 #include <ghost/opencl/impl_device.h>
 #include <ghost/opencl/impl_function.h>
 
+#include <cstring>
 #include <fstream>
 #include <vector>
 
@@ -33,10 +34,13 @@ using namespace opencl;
 
 FunctionOpenCL::FunctionOpenCL(const DeviceOpenCL& dev,
                                opencl::ptr<cl_kernel> k)
-    : kernel(k), _dev(dev) {}
+    : kernel(k), _dev(dev) {
+  _instances.push_back(std::make_unique<Instance>());
+  _instances[0]->kernel = kernel;
+}
 
-void FunctionOpenCL::bindArgs(const std::vector<Attribute>& args) {
-  cl_int err;
+void FunctionOpenCL::bindArgs(Instance& instance,
+                              const std::vector<Attribute>& args) {
   cl_uint idx = 0;
   for (auto i = args.begin(); i != args.end(); ++i) {
     switch (i->type()) {
@@ -45,8 +49,7 @@ void FunctionOpenCL::bindArgs(const std::vector<Attribute>& args) {
         size_t count = i->count();
         // cl_float3 is the same as cl_float4
         if (count == 3) count = 4;
-        err = clSetKernelArg(kernel, idx++, sizeof(v[0]) * count, v);
-        checkError(err);
+        setArg(instance, idx++, sizeof(v[0]) * count, v);
         break;
       }
       case Attribute::Type_Int: {
@@ -54,8 +57,7 @@ void FunctionOpenCL::bindArgs(const std::vector<Attribute>& args) {
         size_t count = i->count();
         // cl_int3 is the same as cl_int4
         if (count == 3) count = 4;
-        err = clSetKernelArg(kernel, idx++, sizeof(v[0]) * count, v);
-        checkError(err);
+        setArg(instance, idx++, sizeof(v[0]) * count, v);
         break;
       }
       case Attribute::Type_UInt: {
@@ -63,8 +65,7 @@ void FunctionOpenCL::bindArgs(const std::vector<Attribute>& args) {
         size_t count = i->count();
         // cl_uint3 is the same as cl_uint4
         if (count == 3) count = 4;
-        err = clSetKernelArg(kernel, idx++, sizeof(v[0]) * count, v);
-        checkError(err);
+        setArg(instance, idx++, sizeof(v[0]) * count, v);
         break;
       }
       case Attribute::Type_Bool: {
@@ -72,42 +73,37 @@ void FunctionOpenCL::bindArgs(const std::vector<Attribute>& args) {
         size_t count = i->count();
         // cl_bool3 is the same as cl_bool4
         if (count == 3) count = 4;
-        err = clSetKernelArg(kernel, idx++, sizeof(v[0]) * count, v);
-        checkError(err);
+        setArg(instance, idx++, sizeof(v[0]) * count, v);
         break;
       }
       case Attribute::Type_Buffer: {
         auto opencl =
             static_cast<implementation::BufferOpenCL*>(i->bufferImpl().get());
         cl_mem v = opencl->mem.get();
-        err = clSetKernelArg(kernel, idx++, sizeof(v), &v);
-        checkError(err);
+        setArg(instance, idx++, sizeof(v), &v);
         break;
       }
       case Attribute::Type_Image: {
         auto opencl =
             static_cast<implementation::ImageOpenCL*>(i->imageImpl().get());
         cl_mem v = opencl->mem.get();
-        err = clSetKernelArg(kernel, idx++, sizeof(v), &v);
-        checkError(err);
+        setArg(instance, idx++, sizeof(v), &v);
         break;
       }
       case Attribute::Type_ArgumentBuffer: {
         auto ab = i->argumentBuffer();
         if (ab->isStruct()) {
-          err = clSetKernelArg(kernel, idx++, ab->size(), ab->data());
+          setArg(instance, idx++, ab->size(), ab->data());
         } else {
           auto ocl = static_cast<implementation::BufferOpenCL*>(
               ab->bufferImpl().get());
           cl_mem v = ocl->mem.get();
-          err = clSetKernelArg(kernel, idx++, sizeof(v), &v);
+          setArg(instance, idx++, sizeof(v), &v);
         }
-        checkError(err);
         break;
       }
       case Attribute::Type_LocalMem:
-        err = clSetKernelArg(kernel, idx++, (size_t)i->asUInt(), nullptr);
-        checkError(err);
+        setArg(instance, idx++, (size_t)i->asUInt(), nullptr);
         break;
       default:
         break;
@@ -118,8 +114,92 @@ void FunctionOpenCL::bindArgs(const std::vector<Attribute>& args) {
 void FunctionOpenCL::execute(const ghost::Encoder& s,
                              const LaunchArgs& launchArgs,
                              const std::vector<Attribute>& args) {
+  auto instance = acquire();
+  bindArgs(*instance, args);
+  enqueueKernel(*instance, s, launchArgs);
+}
+
+FunctionOpenCL::Lease FunctionOpenCL::acquire(bool primary) {
+  const auto self = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lock(_instancesMutex);
+  Instance* instance = nullptr;
+  if (primary) {
+    _instanceReleased.wait(lock, [&] { return !_instances[0]->busy; });
+    instance = _instances[0].get();
+  } else {
+    for (auto& i : _instances) {
+      if (i->busy) continue;
+      if (!instance || i->thread == self) instance = i.get();
+      if (i->thread == self) break;
+    }
+    if (!instance) {
+      // Every instance is in use by another thread: create one from the same
+      // program. It starts with no arguments set.
+      lock.unlock();
+      cl_program program;
+      checkError(clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program),
+                                 &program, nullptr));
+      size_t length;
+      checkError(clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, nullptr,
+                                 &length));
+      std::string name(length, '\0');
+      checkError(clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, length,
+                                 &name[0], nullptr));
+      cl_int err;
+      auto clone = std::make_unique<Instance>();
+      clone->kernel = opencl::ptr<cl_kernel>(
+          clCreateKernel(program, name.c_str(), &err));
+      checkError(err);
+      lock.lock();
+      _instances.push_back(std::move(clone));
+      instance = _instances.back().get();
+    }
+  }
+  instance->busy = true;
+  instance->thread = self;
+  return Lease(*this, *instance);
+}
+
+void FunctionOpenCL::release(Instance& instance) {
+  bool primary;
+  {
+    std::lock_guard<std::mutex> lock(_instancesMutex);
+    instance.busy = false;
+    primary = &instance == _instances[0].get();
+  }
+  if (primary) _instanceReleased.notify_all();
+}
+
+void FunctionOpenCL::setArg(Instance& instance, cl_uint index, size_t size,
+                            const void* value) {
+  if (index >= instance.args.size()) instance.args.resize(index + 1);
+  Instance::Arg& arg = instance.args[index];
+  // Local memory is identified by its size alone; other values are compared
+  // by their bytes, unless they are too large to shadow (struct arguments).
+  const bool local = value == nullptr;
+  const bool shadow = local || size <= sizeof(arg.bytes);
+  if (shadow && arg.valid && arg.local == local && arg.size == size &&
+      (local || std::memcmp(arg.bytes, value, size) == 0)) {
+    return;
+  }
+  arg.valid = false;
+  checkError(clSetKernelArg(instance.kernel, index, size, value));
+  if (shadow) {
+    arg.valid = true;
+    arg.local = local;
+    arg.size = size;
+    if (!local) std::memcpy(arg.bytes, value, size);
+  }
+}
+
+std::shared_ptr<DispatchState> FunctionOpenCL::bind(
+    const std::vector<Attribute>& args) {
+  return std::make_shared<DispatchStateOpenCL>(*this, args);
+}
+
+void FunctionOpenCL::enqueueKernel(Instance& instance, const ghost::Encoder& s,
+                                   const LaunchArgs& launchArgs) {
   cl_int err;
-  bindArgs(args);
   auto stream_impl = static_cast<implementation::StreamOpenCL*>(s.impl().get());
   if (launchArgs.requiredSubgroupSize() != 0) {
     uint32_t actual = preferredSubgroupSize();
@@ -138,13 +218,95 @@ void FunctionOpenCL::execute(const ghost::Encoder& s,
     local_size[i] = launchArgs.local_size()[i];
   }
   err = clEnqueueNDRangeKernel(
-      stream_impl->queue, kernel, (cl_uint)launchArgs.dims(), NULL, global_size,
+      stream_impl->queue, instance.kernel, (cl_uint)launchArgs.dims(), NULL,
+      global_size,
       launchArgs.is_local_defined() ? local_size : nullptr,
       stream_impl->events.size(), stream_impl->events, stream_impl->event());
   checkError(err);
   stream_impl->addEvent();
 }
 
+DispatchStateOpenCL::DispatchStateOpenCL(FunctionOpenCL& function,
+                                         const std::vector<Attribute>& args)
+    : _function(function), _slots(args.size()) {
+  cl_uint idx = 0;
+  for (size_t i = 0; i < args.size(); i++) {
+    fill(args[i], _slots[i]);
+    if (_slots[i].mapped) _slots[i].index = idx++;
+  }
+}
+
+void DispatchStateOpenCL::fill(const Attribute& a, Slot& slot) {
+  size_t count = a.count();
+  // cl_float3 etc. are the same size as their 4-element types.
+  if (count == 3) count = 4;
+  slot.mapped = true;
+  slot.mem = nullptr;
+  switch (a.type()) {
+    case Attribute::Type_Float:
+      slot.size = sizeof(float) * count;
+      slot.value = a.floatArray();
+      break;
+    case Attribute::Type_Int:
+      slot.size = sizeof(int32_t) * count;
+      slot.value = a.intArray();
+      break;
+    case Attribute::Type_UInt:
+      slot.size = sizeof(uint32_t) * count;
+      slot.value = a.uintArray();
+      break;
+    case Attribute::Type_Bool:
+      slot.size = sizeof(bool) * count;
+      slot.value = a.boolArray();
+      break;
+    case Attribute::Type_Buffer:
+      slot.mem = static_cast<BufferOpenCL*>(a.bufferImpl().get())->mem.get();
+      break;
+    case Attribute::Type_Image:
+      slot.mem = static_cast<ImageOpenCL*>(a.imageImpl().get())->mem.get();
+      break;
+    case Attribute::Type_ArgumentBuffer: {
+      auto ab = a.argumentBuffer();
+      if (ab->isStruct()) {
+        slot.size = ab->size();
+        slot.value = ab->data();
+      } else {
+        slot.mem =
+            static_cast<BufferOpenCL*>(ab->bufferImpl().get())->mem.get();
+      }
+      break;
+    }
+    case Attribute::Type_LocalMem:
+      slot.size = (size_t)a.asUInt();
+      slot.value = nullptr;
+      break;
+    default:
+      slot.mapped = false;
+      break;
+  }
+  if (slot.mem) {
+    slot.size = sizeof(cl_mem);
+    slot.value = &slot.mem;
+  }
+}
+
+void DispatchStateOpenCL::argChanged(const std::vector<Attribute>& args,
+                                     size_t index) {
+  fill(args[index], _slots[index]);
+}
+
+void DispatchStateOpenCL::enqueue(const ghost::Encoder& s,
+                                  const LaunchArgs& launchArgs,
+                                  const std::vector<Attribute>& args) {
+  auto instance = _function.acquire();
+  for (auto& slot : _slots) {
+    if (slot.mapped) {
+      FunctionOpenCL::setArg(*instance, slot.index, slot.size, slot.value);
+    }
+  }
+  _function.enqueueKernel(*instance, s, launchArgs);
+}
+
 Attribute FunctionOpenCL::getAttribute(FunctionAttributeId what) const {
   std::vector<cl_device_id> devices;
   cl_int err;
@@ -267,6 +429,17 @@ void LibraryOpenCL::loadFromText(const std::string& text,
   } catch (...) {
   }
   if (program.get() != nullptr) return;
+  // Another process may be compiling the same program. Wait for it, then
+  // look again before compiling it here too.
+  auto claim = _dev.binaryCache().lockEntry(_dev, text.c_str(), text.size(),
+                                            options);
+  if (claim) {
+    try {
+      loadFromCache(text.c_str(), text.size(), options, true);
+    } catch (...) {
+    }
+    if (program.get() != nullptr) return;
+  }
   const char* progtext = text.c_str();
   program = opencl::ptr<cl_program>(
       clCreateProgramWithSource(context, 1, &progtext, nullptr, &err));
@@ -297,6 +470,15 @@ void LibraryOpenCL::loadFromData(const void* data, size_t len,
   } catch (...) {
   }
   if (program.get() != nullptr) return;
+  // Claim the entry and look again, as in loadFromText.
+  auto claim = _dev.binaryCache().lockEntry(_dev, data, len, options);
+  if (claim) {
+    try {
+      loadFromCache(data, len, options, true);
+    } catch (...) {
+    }
+    if (program.get() != nullptr) return;
+  }
 
   if (isSpirvData(data, len)) {
     // SPIR-V / SPIR-IL — use clCreateProgramWithIL (requires CL 2.1+).
@@ -345,15 +527,14 @@ void LibraryOpenCL::loadFromBinaries(const size_t* lengths,
 }
 
 void LibraryOpenCL::loadFromCache(const void* data, size_t length,
-                                  const CompilerOptions& options) {
-  std::vector<std::vector<unsigned char>> binaries;
-  std::vector<size_t> sizes;
-  if (_dev.binaryCache().loadBinaries(binaries, sizes, _dev, data, length,
-                                      options)) {
-    std::vector<const unsigned char*> ptrs;
-    for (size_t i = 0; i < binaries.size(); i++)
-      ptrs.push_back(&binaries[i][0]);
-    loadFromBinaries(&sizes[0], &ptrs[0], options);
+                                  const CompilerOptions& options,
+                                  bool claimed) {
+  // Once the entry is claimed, look again without counting a second miss.
+  auto& cache = _dev.binaryCache();
+  BinaryCache::CachedBinaries cached;
+  if (claimed ? cache.reloadBinaries(cached, _dev, data, length, options)
+              : cache.loadBinaries(cached, _dev, data, length, options)) {
+    loadFromBinaries(&cached.sizes[0], &cached.binaries[0], options);
   }
 }
 
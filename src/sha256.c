@@ -1,6 +1,8 @@
 /* clang-format off */
 #include "sha256.h"
 
+#include <string.h>
+
 static inline uint32_t rotr(uint32_t x, int n){
     return (x >> n) | (x << (32 - n));
 }
@@ -13,6 +15,25 @@ static inline uint32_t step2(uint32_t a, uint32_t b, uint32_t c){
     return (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
 }
 
+const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
 static inline void update_w(uint32_t *w, int i, const uint8_t *buffer){
     int j;
     for (j = 0; j < 16; j++){
@@ -33,27 +54,8 @@ static inline void update_w(uint32_t *w, int i, const uint8_t *buffer){
     }
 }
 
-static void sha256_block(struct sha256 *sha){
-    uint32_t *state = sha->state;
-
-    static const uint32_t k[8 * 8] = {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
-        0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
-        0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
-        0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
-    };
+static void sha256_block(uint32_t *state, const uint8_t *data){
+    const uint32_t *k = sha256_k;
 
     uint32_t a = state[0];
     uint32_t b = state[1];
@@ -68,7 +70,7 @@ static void sha256_block(struct sha256 *sha){
 
     int i, j;
     for (i = 0; i < 64; i += 16){
-        update_w(w, i, sha->buffer);
+        update_w(w, i, data);
 
         for (j = 0; j < 16; j += 4){
             uint32_t temp;
@@ -97,6 +99,14 @@ static void sha256_block(struct sha256 *sha){
     state[7] += h;
 }
 
+void sha256_blocks_portable(uint32_t state[8], const uint8_t *data,
+                            size_t n_blocks){
+    while (n_blocks--){
+        sha256_block(state, data);
+        data += 64;
+    }
+}
+
 void sha256_init(struct sha256 *sha){
     sha->state[0] = 0x6a09e667;
     sha->state[1] = 0xbb67ae85;
@@ -108,6 +118,12 @@ void sha256_init(struct sha256 *sha){
     sha->state[7] = 0x5be0cd19;
     sha->n_bits = 0;
     sha->buffer_counter = 0;
+    sha->blocks = sha256_blocks_portable;
+}
+
+void sha256_init_blocks(struct sha256 *sha, sha256_blocks_fn blocks){
+    sha256_init(sha);
+    sha->blocks = blocks;
 }
 
 void sha256_append_byte(struct sha256 *sha, uint8_t byte){
@@ -116,16 +132,39 @@ void sha256_append_byte(struct sha256 *sha, uint8_t byte){
 
     if (sha->buffer_counter == 64){
         sha->buffer_counter = 0;
-        sha256_block(sha);
+        sha->blocks(sha->state, sha->buffer, 1);
     }
 }
 
 void sha256_append(struct sha256 *sha, const void *src, size_t n_bytes){
     const uint8_t *bytes = (const uint8_t*)src;
-    size_t i;
+    size_t n;
+
+    sha->n_bits += (uint64_t)n_bytes * 8;
+
+    /* Top up a partial block first. */
+    if (sha->buffer_counter != 0){
+        n = 64 - sha->buffer_counter;
+        if (n > n_bytes) n = n_bytes;
+        memcpy(sha->buffer + sha->buffer_counter, bytes, n);
+        sha->buffer_counter += (uint8_t)n;
+        bytes += n;
+        n_bytes -= n;
+        if (sha->buffer_counter < 64) return;
+        sha->buffer_counter = 0;
+        sha->blocks(sha->state, sha->buffer, 1);
+    }
 
-    for (i = 0; i < n_bytes; i++){
-        sha256_append_byte(sha, bytes[i]);
+    /* Whole blocks straight from the input, then buffer the tail. */
+    n = n_bytes / 64;
+    if (n != 0){
+        sha->blocks(sha->state, bytes, n);
+        bytes += n * 64;
+        n_bytes -= n * 64;
+    }
+    if (n_bytes != 0){
+        memcpy(sha->buffer, bytes, n_bytes);
+        sha->buffer_counter = (uint8_t)n_bytes;
     }
 }
 
@@ -23,15 +23,37 @@ void sha256_hex(const void *src, size_t n_bytes, char *dst_hex65);
 
 void sha256_bytes(const void *src, size_t n_bytes, void *dst_bytes32);
 
+/*
+ * Compress n_blocks consecutive 64-byte blocks into state.
+ */
+typedef void (*sha256_blocks_fn)(uint32_t state[8], const uint8_t *data,
+                                 size_t n_blocks);
+
 typedef struct sha256 {
     uint32_t state[8];
     uint8_t buffer[64];
     uint64_t n_bits;
     uint8_t buffer_counter;
+    sha256_blocks_fn blocks;
 } sha256;
 
+/* Round constants, shared with the hardware implementations. */
+extern const uint32_t sha256_k[64];
+
+/* Portable block function, used unless another is installed. */
+void sha256_blocks_portable(uint32_t state[8], const uint8_t *data,
+                            size_t n_blocks);
+
+/*
+ * Fastest block function this CPU supports: SHA-NI on x86, the ARMv8
+ * crypto extension on AArch64, or the portable one. Queries the CPU on
+ * every call, so callers should cache the result.
+ */
+sha256_blocks_fn sha256_blocks_select(void);
+
 /* Functions to compute streaming SHA-256 checksums. */
 void sha256_init(struct sha256 *sha);
+void sha256_init_blocks(struct sha256 *sha, sha256_blocks_fn blocks);
 void sha256_append(struct sha256 *sha, const void *data, size_t n_bytes);
 void sha256_finalize_hex(struct sha256 *sha, char *dst_hex65);
 void sha256_finalize_bytes(struct sha256 *sha, void *dst_bytes32);
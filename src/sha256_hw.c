@@ -0,0 +1,192 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+// SHA-256 block functions using the x86 SHA extensions (SHA-NI) and the ARMv8
+// crypto extension. Each is compiled for its instruction set with a target
+// attribute rather than a global compiler flag, so the rest of the library
+// still runs on CPUs without it; sha256_blocks_select() checks the CPU before
+// handing one out.
+
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define SHA256_HW_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SHA256_HW_ARM 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+#endif
+
+#if defined(SHA256_HW_X86)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHA256_TARGET_X86 __attribute__((target("sha,sse4.1")))
+#else
+#define SHA256_TARGET_X86
+#endif
+
+// State is kept as ABEF/CDGH for sha256rnds2. Each iteration of the round
+// loop does four rounds; the schedule for group i + 4 is computed in place
+// of group i once that group's rounds are done.
+SHA256_TARGET_X86
+static void sha256_blocks_x86(uint32_t state[8], const uint8_t* data,
+                              size_t n_blocks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+  __m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);  // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1B);  // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);  // CDGH
+
+  while (n_blocks--) {
+    __m128i abef = state0, cdgh = state1;
+    __m128i msg[4];
+    int i;
+    for (i = 0; i < 4; i++) {
+      msg[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i*)(data + 16 * i)), mask);
+    }
+    for (i = 0; i < 16; i++) {
+      __m128i wk = _mm_add_epi32(
+          msg[i & 3], _mm_loadu_si128((const __m128i*)&sha256_k[4 * i]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+      state0 = _mm_sha256rnds2_epu32(state0, state1,
+                                     _mm_shuffle_epi32(wk, 0x0E));
+      if (i < 12) {
+        __m128i w = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+        w = _mm_add_epi32(
+            w, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+        msg[i & 3] = _mm_sha256msg2_epu32(w, msg[(i + 3) & 3]);
+      }
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    data += 64;
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);  // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);  // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);  // HGFE
+  _mm_storeu_si128((__m128i*)&state[0], state0);
+  _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+static int sha256_cpu_has_x86(void) {
+  unsigned int ebx7, ecx1;
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuid(r, 0);
+  if (r[0] < 7) return 0;
+  __cpuidex(r, 7, 0);
+  ebx7 = (unsigned int)r[1];
+  __cpuid(r, 1);
+  ecx1 = (unsigned int)r[2];
+#else
+  unsigned int a, b, c, d;
+  if (__get_cpuid_max(0, 0) < 7) return 0;
+  __cpuid_count(7, 0, a, b, c, d);
+  ebx7 = b;
+  __cpuid(1, a, b, c, d);
+  ecx1 = c;
+#endif
+  // SHA (leaf 7 EBX bit 29), SSSE3 (leaf 1 ECX bit 9), SSE4.1 (bit 19).
+  return (ebx7 & (1u << 29)) && (ecx1 & (1u << 9)) && (ecx1 & (1u << 19));
+}
+
+#elif defined(SHA256_HW_ARM)
+
+#if defined(__clang__)
+#define SHA256_TARGET_ARM __attribute__((target("crypto")))
+#elif defined(__GNUC__)
+#define SHA256_TARGET_ARM __attribute__((target("+crypto")))
+#else
+#define SHA256_TARGET_ARM
+#endif
+
+// State is kept as ABCD/EFGH; four rounds per iteration, with the schedule
+// for group i + 4 computed in place of group i.
+SHA256_TARGET_ARM
+static void sha256_blocks_arm(uint32_t state[8], const uint8_t* data,
+                              size_t n_blocks) {
+  uint32x4_t state0 = vld1q_u32(&state[0]);
+  uint32x4_t state1 = vld1q_u32(&state[4]);
+
+  while (n_blocks--) {
+    uint32x4_t abcd = state0, efgh = state1;
+    uint32x4_t msg[4];
+    int i;
+    for (i = 0; i < 4; i++) {
+      msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    }
+    for (i = 0; i < 16; i++) {
+      uint32x4_t wk = vaddq_u32(msg[i & 3], vld1q_u32(&sha256_k[4 * i]));
+      uint32x4_t prev = state0;
+      state0 = vsha256hq_u32(state0, state1, wk);
+      state1 = vsha256h2q_u32(state1, prev, wk);
+      if (i < 12) {
+        msg[i & 3] = vsha256su1q_u32(
+            vsha256su0q_u32(msg[i & 3], msg[(i + 1) & 3]), msg[(i + 2) & 3],
+            msg[(i + 3) & 3]);
+      }
+    }
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+    data += 64;
+  }
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+
+static int sha256_cpu_has_arm(void) {
+#if defined(__APPLE__)
+  // Every Apple AArch64 CPU implements the SHA-256 instructions.
+  return 1;
+#elif defined(__linux__)
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#elif defined(_WIN32)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) !=
+         0;
+#else
+  return 0;
+#endif
+}
+
+#endif
+
+sha256_blocks_fn sha256_blocks_select(void) {
+#if defined(SHA256_HW_X86)
+  if (sha256_cpu_has_x86()) return sha256_blocks_x86;
+#elif defined(SHA256_HW_ARM)
+  if (sha256_cpu_has_arm()) return sha256_blocks_arm;
+#endif
+  return sha256_blocks_portable;
+}
@@ -497,6 +497,8 @@ void SubBufferVulkan::copyTo(const ghost::Encoder& s, void* dst,
 
 MappedBufferVulkan::~MappedBufferVulkan() {
   if (_allocator) {
+    // The allocator may hand the memory out again, and adopting it maps it.
+    if (mappedPtr) vkUnmapMemory(memory.device(), memory);
     buffer.release();
     memory.release();
     _allocator->freeMappedBuffer(_externalHandle, _size);
@@ -1713,6 +1715,10 @@ DeviceVulkan::DeviceVulkan(const GpuInfo& info)
 }
 
 DeviceVulkan::~DeviceVulkan() {
+  // Unclaimed precompiled libraries hold shader modules on this device.
+  clearPrecompiled();
+  // So do buffers parked by a caching allocator.
+  detachNativeAllocator();
   if (device != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(device);
     // Children that hold a vk::ptr referencing this device must be
@@ -1916,6 +1922,47 @@ std::shared_ptr<CommandBuffer> DeviceVulkan::createCommandBuffer(
   return std::make_shared<CommandBufferVulkan>(*this, options);
 }
 
+void* DeviceVulkan::allocateNativeBuffer(size_t bytes,
+                                         const BufferOptions& opts,
+                                         bool mapped) const {
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  if (mapped) {
+    memProps |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (opts.access == Access::WriteOnly) {
+      memProps |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+  } else if (opts.hint == AllocHint::Staging) {
+    memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (opts.access == Access::WriteOnly) {
+      memProps |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+  }
+  vk::ptr<VkBuffer> buffer(device);
+  vk::ptr<VkDeviceMemory> memory(device);
+  try {
+    createBuffer(bytes, usage, memProps, buffer, memory);
+  } catch (const std::exception&) {
+    return nullptr;
+  }
+  auto* handle = new ghost::VulkanBufferHandle;
+  handle->buffer = buffer.release();
+  handle->memory = memory.release();
+  return handle;
+}
+
+void DeviceVulkan::freeNativeBuffer(void* handle, size_t bytes,
+                                    bool mapped) const {
+  auto* h = static_cast<ghost::VulkanBufferHandle*>(handle);
+  vkDestroyBuffer(device, h->buffer, nullptr);
+  vkFreeMemory(device, h->memory, nullptr);
+  delete h;
+}
+
 ghost::Buffer DeviceVulkan::allocateBuffer(size_t bytes,
                                            const BufferOptions& opts) const {
   if (auto* a = allocator()) {
@@ -663,18 +663,19 @@ void LibraryVulkan::loadFromCache(const void* data, size_t length,
   auto& cache = _dev.binaryCache();
   if (!cache.isEnabled()) return;
 
-  std::vector<std::vector<unsigned char>> binaries;
-  std::vector<size_t> sizes;
-  if (cache.loadBinaries(binaries, sizes, _dev, data, length, options)) {
-    if (!binaries.empty() && !binaries[0].empty()) {
+  BinaryCache::CachedBinaries cached;
+  if (cache.loadBinaries(cached, _dev, data, length, options)) {
+    if (!cached.binaries.empty() && cached.sizes[0] > 0) {
+      // Mapped cache entries are page aligned and the blob follows a header
+      // of whole 64-bit words, so pCode meets SPIR-V's 4-byte alignment.
       VkShaderModuleCreateInfo createInfo = {};
       createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-      createInfo.codeSize = binaries[0].size();
-      createInfo.pCode = reinterpret_cast<const uint32_t*>(binaries[0].data());
+      createInfo.codeSize = cached.sizes[0];
+      createInfo.pCode = reinterpret_cast<const uint32_t*>(cached.binaries[0]);
 
       if (vkCreateShaderModule(_dev.device, &createInfo, nullptr, &_module) ==
           VK_SUCCESS) {
-        ghost::vk::reflectSpirv(binaries[0].data(), binaries[0].size(),
+        ghost::vk::reflectSpirv(cached.binaries[0], cached.sizes[0],
                                 _reflection);
         return;
       }
@@ -1,4 +1,5 @@
 #include <ghost/allocator.h>
+#include <ghost/caching_allocator.h>
 
 #include <atomic>
 #include <cstdlib>
@@ -256,6 +257,22 @@ TEST_F(CPUAllocatorTest, HostMemoryFallsBackWhenAllocatorDeclines) {
   EXPECT_EQ(a->freeHostMemCalls.load(), 1);
 }
 
+TEST_F(CPUAllocatorTest, PoolBlockFreedAfterSetAllocator) {
+  // Allocated from the device's pinned pool before the allocator existed, so
+  // it must not be handed to the allocator.
+  void* p = device().allocateHostMemory(256);
+  ASSERT_NE(p, nullptr);
+  auto a = std::make_shared<HostMemoryAllocator>();
+  device().setAllocator(a);
+  device().freeHostMemory(p);
+  EXPECT_EQ(a->freeCalls.load(), 0);
+
+  void* q = device().allocateHostMemory(256);
+  EXPECT_EQ(a->allocCalls.load(), 1);
+  device().freeHostMemory(q);
+  EXPECT_EQ(a->freeCalls.load(), 1);
+}
+
 // ===========================================================================
 // SharedBuffer / SharedImage wrap tests (CPU)
 // ===========================================================================
@@ -317,6 +334,197 @@ TEST_F(CPUAllocatorTest, WrapImageRoundTrip) {
     EXPECT_FLOAT_EQ(out[i], static_cast<float>(i)) << "i=" << i;
 }
 
+// ===========================================================================
+// CachingAllocator (CPU: HeapAllocator supplies native buffer handles)
+// ===========================================================================
+
+TEST_F(CPUAllocatorTest, CachingAllocatorSizeClasses) {
+  EXPECT_EQ(CachingAllocator::sizeClass(1), 256u);
+  EXPECT_EQ(CachingAllocator::sizeClass(256), 256u);
+  EXPECT_EQ(CachingAllocator::sizeClass(257), 320u);
+  EXPECT_EQ(CachingAllocator::sizeClass(1000), 1024u);
+  EXPECT_EQ(CachingAllocator::sizeClass(1025), 1280u);
+  for (size_t n : {300u, 5000u, 70000u, 1234567u}) {
+    size_t cls = CachingAllocator::sizeClass(n);
+    EXPECT_GE(cls, n);
+    EXPECT_LE(cls, n + n / 4) << "slack above 25% for " << n;
+  }
+}
+
+TEST_F(CPUAllocatorTest, CachingAllocatorReusesFreedBuffer) {
+  auto a =
+      std::make_shared<CachingAllocator>(std::make_shared<HeapAllocator>());
+  device().setAllocator(a);
+
+  const size_t N = 1000;
+  const void* first = nullptr;
+  {
+    auto buf = device().allocateBuffer(N * sizeof(float));
+    first = static_cast<implementation::BufferCPU*>(buf.impl().get())->ptr;
+  }
+  auto s = a->stats();
+  EXPECT_EQ(s.misses, 1u);
+  EXPECT_EQ(s.allocatedBytes, 0u);
+  EXPECT_EQ(s.cachedBytes, CachingAllocator::sizeClass(N * sizeof(float)));
+
+  // A slightly different size in the same class reuses the parked block.
+  auto buf = device().allocateBuffer(N * sizeof(float) - 12);
+  EXPECT_EQ(static_cast<implementation::BufferCPU*>(buf.impl().get())->ptr,
+            first);
+  s = a->stats();
+  EXPECT_EQ(s.hits, 1u);
+  EXPECT_EQ(s.cachedBytes, 0u);
+
+  std::vector<float> input(N - 3), output(N - 3, 0.0f);
+  for (size_t i = 0; i < input.size(); i++) input[i] = i * 0.5f;
+  buf.copy(stream(), input.data(), input.size() * sizeof(float));
+  buf.copyTo(stream(), output.data(), output.size() * sizeof(float));
+  EXPECT_EQ(output, input);
+}
+
+TEST_F(CPUAllocatorTest, CachingAllocatorOverNativeAllocator) {
+  auto a = std::make_shared<CachingAllocator>(device().nativeAllocator());
+  device().setAllocator(a);
+
+  const void* first = nullptr;
+  {
+    auto buf = device().allocateBuffer(4096);
+    first = static_cast<implementation::BufferCPU*>(buf.impl().get())->ptr;
+  }
+  auto buf = device().allocateBuffer(4096);
+  EXPECT_EQ(static_cast<implementation::BufferCPU*>(buf.impl().get())->ptr,
+            first);
+  EXPECT_EQ(a->stats().hits, 1u);
+  EXPECT_EQ(a->stats().misses, 1u);
+}
+
+TEST_F(CPUAllocatorTest, NativeAllocatorDeclinesAfterDevice) {
+  std::shared_ptr<Allocator> native;
+  {
+    DeviceCPU other;
+    native = other.nativeAllocator();
+    void* handle = native->allocateBuffer(256, BufferOptions());
+    ASSERT_NE(handle, nullptr);
+    native->freeBuffer(handle, 256);
+  }
+  EXPECT_EQ(native->allocateBuffer(256, BufferOptions()), nullptr);
+  EXPECT_EQ(native->allocateMappedBuffer(256, BufferOptions()), nullptr);
+}
+
+TEST_F(CPUAllocatorTest, CachingAllocatorKeepsOptionsApart) {
+  auto a =
+      std::make_shared<CachingAllocator>(std::make_shared<HeapAllocator>());
+  device().setAllocator(a);
+
+  { auto buf = device().allocateBuffer(4096, Access::ReadOnly); }
+  { auto buf = device().allocateBuffer(4096, Access::WriteOnly); }
+  { auto buf = device().allocateMappedBuffer(4096); }
+  EXPECT_EQ(a->stats().hits, 0u);
+  EXPECT_EQ(a->stats().misses, 3u);
+
+  { auto buf = device().allocateBuffer(4096, Access::ReadOnly); }
+  EXPECT_EQ(a->stats().hits, 1u);
+}
+
+TEST_F(CPUAllocatorTest, CachingAllocatorHighWaterAndTrim) {
+  CachingAllocator::Options opts;
+  opts.maxCachedBytes = 8192;
+  auto a = std::make_shared<CachingAllocator>(
+      std::make_shared<HeapAllocator>(), opts);
+  device().setAllocator(a);
+
+  {
+    auto b1 = device().allocateBuffer(4096);
+    auto b2 = device().allocateBuffer(4096);
+    auto b3 = device().allocateBuffer(4096);
+    EXPECT_EQ(a->stats().peakBytes, 3 * 4096u);
+  }
+  // Three 4 KiB blocks freed against an 8 KiB limit: one goes upstream.
+  auto s = a->stats();
+  EXPECT_EQ(s.cachedBytes, 8192u);
+  EXPECT_EQ(s.releases, 1u);
+
+  a->trim(4096);
+  EXPECT_EQ(a->stats().cachedBytes, 4096u);
+  a->trim();
+  EXPECT_EQ(a->stats().cachedBytes, 0u);
+  EXPECT_EQ(a->stats().releases, 3u);
+}
+
+TEST_F(CPUAllocatorTest, CachingAllocatorHostMemory) {
+  auto a = std::make_shared<CachingAllocator>();
+  device().setAllocator(a);
+
+  void* p = device().allocateHostMemory(100);
+  memset(p, 0xCC, 100);
+  device().freeHostMemory(p);
+  void* q = device().allocateHostMemory(200);
+  EXPECT_EQ(q, p);
+  device().freeHostMemory(q);
+  EXPECT_EQ(a->stats().hits, 1u);
+
+  // Pointers the cache did not hand out are returned to the heap.
+  device().freeHostMemory(::malloc(16));
+}
+
+TEST_F(CPUAllocatorTest, CachingAllocatorWrapsUpstream) {
+  auto upstream = std::make_shared<HostMemoryAllocator>();
+  auto a = std::make_shared<CachingAllocator>(upstream);
+  device().setAllocator(a);
+
+  for (int i = 0; i < 4; i++) {
+    void* p = device().allocateHostMemory(64);
+    device().freeHostMemory(p);
+  }
+  EXPECT_EQ(upstream->allocCalls.load(), 1);
+  EXPECT_EQ(upstream->freeCalls.load(), 0);
+  a->trim();
+  EXPECT_EQ(upstream->freeCalls.load(), 1);
+}
+
+// ===========================================================================
+// CachingAllocator on every backend
+// ===========================================================================
+
+class CachingAllocatorTest : public GhostTest {
+ protected:
+  void TearDown() override {
+    if (!testing::Test::IsSkipped()) device().setAllocator(nullptr);
+    GhostTest::TearDown();
+  }
+};
+
+TEST_P(CachingAllocatorTest, DefaultDeclinesBuffers) {
+  // With no upstream, buffers must come from the device itself: a heap
+  // pointer is not a native handle outside the CPU backend.
+  auto a = std::make_shared<CachingAllocator>();
+  device().setAllocator(a);
+
+  const size_t N = 1000;
+  std::vector<float> input(N), output(N, 0.0f);
+  for (size_t i = 0; i < N; i++) input[i] = i * 0.25f;
+  {
+    auto buf = device().allocateBuffer(N * sizeof(float));
+    buf.copy(stream(), input.data(), N * sizeof(float));
+    buf.copyTo(stream(), output.data(), N * sizeof(float));
+    stream().sync();
+    EXPECT_EQ(output, input);
+    auto mapped = device().allocateMappedBuffer(4096);
+    EXPECT_EQ(mapped.size(), 4096u);
+  }
+  auto s = a->stats();
+  EXPECT_EQ(s.misses, 0u);
+  EXPECT_EQ(s.cachedBytes, 0u);
+
+  // Host memory still goes through the heap.
+  void* p = device().allocateHostMemory(100);
+  ASSERT_NE(p, nullptr);
+  memset(p, 0xCC, 100);
+  device().freeHostMemory(p);
+}
+
+GHOST_INSTANTIATE_BACKEND_TESTS(CachingAllocatorTest);
+
 // Note: backend-specific allocator tests (Metal, etc.) live in their own
 // translation units (e.g. test_allocator_metal.mm) because they need
 // backend-only headers (Objective-C, Vulkan, D3D12, ...).
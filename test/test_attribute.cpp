@@ -145,6 +145,36 @@ TEST(AttributeTest, ImagePointer) {
   EXPECT_EQ(a.imageImpl(), nullptr);
 }
 
+TEST(AttributeTest, CopyMoveAndReassign) {
+  Attribute s("text");
+  Attribute copy(s);
+  Attribute moved(std::move(s));
+  EXPECT_EQ(copy.asString(), "text");
+  EXPECT_EQ(moved.asString(), "text");
+  // Accessors for another type return empty values.
+  EXPECT_EQ(copy.bufferImpl(), nullptr);
+  EXPECT_EQ(copy.argumentBuffer(), nullptr);
+
+  // Assigning over a string or resource releases it.
+  copy = Attribute(7);
+  EXPECT_EQ(copy.type(), Attribute::Type_Int);
+  EXPECT_EQ(copy.asInt(), 7);
+  EXPECT_TRUE(copy.asString().empty());
+  Buffer* bp = nullptr;
+  moved = Attribute(bp).access(Access::WriteOnly);
+  EXPECT_EQ(moved.type(), Attribute::Type_Buffer);
+  EXPECT_EQ(moved.access(), Access::WriteOnly);
+  moved.localMem(64);
+  EXPECT_EQ(moved.type(), Attribute::Type_LocalMem);
+  EXPECT_EQ(moved.asUInt(), 64u);
+
+  std::vector<Attribute> args{Attribute(1.5f), Attribute("x"), moved};
+  std::vector<Attribute> again = args;
+  EXPECT_FLOAT_EQ(again[0].asFloat(), 1.5f);
+  EXPECT_EQ(again[1].asString(), "x");
+  EXPECT_EQ(again[2].asUInt(), 64u);
+}
+
 // ---------------------------------------------------------------------------
 // LaunchArgs
 // ---------------------------------------------------------------------------
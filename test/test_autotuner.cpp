@@ -0,0 +1,177 @@
+// Copyright (c) 2025 Digital Anarchy, Inc. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this
+// file except in compliance with the License. You may obtain a copy of the
+// License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+// License for the specific language governing permissions and limitations under
+// the License.
+
+#include <ghost/autotuner.h>
+#include <ghost/cpu/impl_device.h>
+
+#include <filesystem>
+
+#include "ghost_test.h"
+
+using namespace ghost;
+using namespace ghost::test;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void cpu_noop(size_t, size_t, const std::vector<Attribute>&) {}
+
+void cpu_spin(size_t, size_t, const std::vector<Attribute>&) {
+  volatile int sink = 0;
+  for (int i = 0; i < 1000; i++) sink = sink + i;
+}
+
+}  // namespace
+
+// Tuning runs real dispatches, so it uses inline CPU kernels.
+class AutotunerTest : public GhostTest {
+ protected:
+  void SetUp() override {
+    GhostTest::SetUp();
+    if (testing::Test::IsSkipped()) return;
+    if (GetParam() != Backend::CPU) {
+      GTEST_SKIP() << "CPU-only test";
+    }
+    auto lib = cpuDevice().loadLibraryFromFunctions(
+        {{"noop", cpu_noop}, {"spin", cpu_spin}});
+    noop_ = lib.lookupFunction("noop");
+    spin_ = lib.lookupFunction("spin");
+    path_ = fs::temp_directory_path() /
+            ("ghost_autotune_test_" +
+             std::to_string(reinterpret_cast<uintptr_t>(this)) + ".txt");
+    std::error_code ec;
+    fs::remove(path_, ec);
+  }
+
+  void TearDown() override {
+    std::error_code ec;
+    fs::remove(path_, ec);
+    GhostTest::TearDown();
+  }
+
+  DeviceCPU& cpuDevice() { return static_cast<DeviceCPU&>(device()); }
+
+  Function noop_{nullptr};
+  Function spin_{nullptr};
+  fs::path path_;
+};
+
+TEST_P(AutotunerTest, CandidatesCoverGlobalSize) {
+  LaunchArgs la;
+  la.global_size(100);
+  auto candidates = Autotuner::localSizeCandidates(noop_, la);
+  ASSERT_FALSE(candidates.empty());
+  size_t largest = 0;
+  for (auto& c : candidates) {
+    EXPECT_EQ(c.dims(), 1u);
+    EXPECT_EQ(c.global_size()[0], 100u);
+    largest = std::max(largest, c.local_size()[0]);
+  }
+  // Stops at the first size that covers the whole range.
+  EXPECT_EQ(largest, 128u);
+
+  // The caller's own local size is always tried.
+  la.local_size(3);
+  candidates = Autotuner::localSizeCandidates(noop_, la);
+  EXPECT_EQ(candidates.front().local_size()[0], 3u);
+
+  LaunchArgs la2;
+  la2.global_size(64, 64);
+  for (auto& c : Autotuner::localSizeCandidates(noop_, la2)) {
+    EXPECT_EQ(c.dims(), 2u);
+    size_t threads = c.local_size()[0] * c.local_size()[1];
+    EXPECT_LE(threads, 1024u);
+    EXPECT_GE(threads, 256u);
+  }
+}
+
+TEST_P(AutotunerTest, StoredResultSkipsBenchmark) {
+  Stream s = stream();
+  Autotuner::Options options;
+  options.iterations = 2;
+  Autotuner tuner(options);
+  LaunchArgs la;
+  la.global_size(16);
+
+  auto first = tuner.tune(device(), s, "noop", noop_, la, {});
+  EXPECT_FALSE(first.cached);
+  EXPECT_TRUE(first.launchArgs.is_local_defined());
+  EXPECT_EQ(first.variant, 0u);
+
+  auto second = tuner.tune(device(), s, "noop", noop_, la, {});
+  EXPECT_TRUE(second.cached);
+  EXPECT_EQ(second.launchArgs.local_size()[0],
+            first.launchArgs.local_size()[0]);
+
+  // A different global size is tuned separately.
+  LaunchArgs other;
+  other.global_size(32);
+  Autotuner::Result result;
+  EXPECT_FALSE(tuner.find(device(), "noop", other, 1, result));
+
+  tuner.clear();
+  EXPECT_FALSE(tuner.find(device(), "noop", la, 1, result));
+}
+
+TEST_P(AutotunerTest, PicksAmongVariants) {
+  Stream s = stream();
+  Autotuner::Options options;
+  options.iterations = 3;
+  Autotuner tuner(options);
+  LaunchArgs la;
+  la.global_size(8).local_size(1);
+
+  auto result = tuner.tune(device(), s, "variants", {spin_, noop_}, la, {});
+  EXPECT_LT(result.variant, 2u);
+  EXPECT_GT(result.seconds, 0.0);
+
+  Autotuner::Result stored;
+  ASSERT_TRUE(tuner.find(device(), "variants", la, 2, stored));
+  EXPECT_EQ(stored.variant, result.variant);
+  // The variant count is part of the key.
+  EXPECT_FALSE(tuner.find(device(), "variants", la, 3, stored));
+}
+
+TEST_P(AutotunerTest, ResultsPersistAcrossInstances) {
+  Stream s = stream();
+  Autotuner::Options options;
+  options.path = path_;
+  options.iterations = 2;
+  LaunchArgs la;
+  la.global_size(64);
+
+  Autotuner::Result tuned;
+  {
+    Autotuner tuner(options);
+    tuned = tuner.tune(device(), s, "noop", noop_, la, {});
+  }
+  ASSERT_TRUE(fs::exists(path_));
+
+  Autotuner reloaded(options);
+  Autotuner::Result result;
+  ASSERT_TRUE(reloaded.find(device(), "noop", la, 1, result));
+  EXPECT_TRUE(result.cached);
+  EXPECT_EQ(result.launchArgs.local_size()[0],
+            tuned.launchArgs.local_size()[0]);
+
+  // Saving from an instance that never saw an entry keeps it in the file.
+  Autotuner other(options);
+  other.clear();
+  EXPECT_TRUE(other.save());
+  Autotuner again(options);
+  EXPECT_TRUE(again.find(device(), "noop", la, 1, result));
+}
+
+GHOST_INSTANTIATE_BACKEND_TESTS(AutotunerTest);
@@ -13,14 +13,21 @@
 // the License.
 
 #include <ghost/binary_cache.h>
+#include <ghost/digest.h>
 #include <ghost/implementation/impl_device.h>
 #include <ghost/implementation/impl_function.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "ghost_test.h"
+#include "sha256.h"
 
 using namespace ghost;
 using namespace ghost::test;
@@ -58,6 +65,8 @@ class ScopedCacheDir {
   }
 
   ~ScopedCacheDir() {
+    // Let queued saves land before deleting, or they would recreate the dir.
+    BinaryCache::flush();
     std::error_code ec;
     fs::remove_all(path_, ec);
   }
@@ -93,6 +102,33 @@ class ScopedCachePath {
   BinaryCache& cache_;
 };
 
+// Points a cache at a pack archive for the lifetime of the guard.
+class ScopedPackPath {
+ public:
+  ScopedPackPath(BinaryCache& cache, fs::path p) : cache_(cache) {
+    cache_.packPath = std::move(p);
+  }
+
+  ~ScopedPackPath() { cache_.packPath.clear(); }
+
+ private:
+  BinaryCache& cache_;
+};
+
+// Restores the process-wide in-memory tier budget on scope exit.
+class ScopedMemoryCacheLimit {
+ public:
+  explicit ScopedMemoryCacheLimit(size_t bytes)
+      : saved_(BinaryCache::getMemoryCacheLimit()) {
+    BinaryCache::setMemoryCacheLimit(bytes);
+  }
+
+  ~ScopedMemoryCacheLimit() { BinaryCache::setMemoryCacheLimit(saved_); }
+
+ private:
+  size_t saved_;
+};
+
 }  // namespace
 
 class BinaryCacheTest : public GhostTest {};
@@ -130,6 +166,7 @@ TEST_P(BinaryCacheTest, DiskRoundTrip) {
   CompilerOptions options;
 
   cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  BinaryCache::flush();
   EXPECT_EQ(dir.fileCount(), 1u) << "save should create exactly one cache file";
 
   std::vector<std::vector<unsigned char>> outBlobs;
@@ -174,6 +211,24 @@ TEST_P(BinaryCacheTest, LoadDifferentKeyMisses) {
       cache.loadBinaries(outBlobs, outSizes, dev, keyB, sizeof(keyB), options));
 }
 
+// The memoized fingerprint matches a fresh query and keys the same digest.
+TEST_P(BinaryCacheTest, FingerprintIsMemoized) {
+  auto& dev = *device().impl();
+  auto& fp = dev.fingerprint();
+  EXPECT_EQ(&fp, &dev.fingerprint());
+  EXPECT_EQ(fp.count,
+            static_cast<size_t>(dev.getAttribute(kDeviceCount).asInt()));
+  EXPECT_EQ(fp.identity, dev.getAttribute(kDeviceVendor).asString() +
+                             dev.getAttribute(kDeviceName).asString() +
+                             dev.getAttribute(kDeviceDriverVersion).asString());
+
+  Digest d;
+  BinaryCache::makeDigest(d, dev, fp.count, nullptr, 0, CompilerOptions());
+  uint8_t digest[Digest::length];
+  d.get(digest);
+  EXPECT_EQ(memcmp(digest, fp.digest, sizeof(digest)), 0);
+}
+
 // Loading from an empty cache returns false rather than crashing.
 TEST_P(BinaryCacheTest, LoadMissOnEmptyCache) {
   auto& dev = *device().impl();
@@ -188,8 +243,675 @@ TEST_P(BinaryCacheTest, LoadMissOnEmptyCache) {
                                   CompilerOptions()));
 }
 
+// A saved entry stays resident: a repeat load is served from memory even once
+// the file is gone, and purgeBinaries drops the resident copy as well.
+TEST_P(BinaryCacheTest, MemoryTierServesRepeatLoads) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+  ScopedMemoryCacheLimit limit(size_t(1) << 20);
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(300u + i, static_cast<unsigned char>(0x3C + i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  const char key[] = "memory-tier-key";
+  CompilerOptions options;
+  cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  BinaryCache::flush();
+  EXPECT_GT(BinaryCache::getMemoryCacheSize(), 0u);
+
+  std::error_code ec;
+  for (const auto& e : fs::directory_iterator(dir.path(), ec))
+    fs::remove(e.path(), ec);
+  ASSERT_EQ(dir.fileCount(), 0u);
+
+  std::vector<std::vector<unsigned char>> outBlobs;
+  std::vector<size_t> outSizes;
+  ASSERT_TRUE(
+      cache.loadBinaries(outBlobs, outSizes, dev, key, sizeof(key), options));
+  EXPECT_EQ(outBlobs, blobs);
+  EXPECT_EQ(outSizes, sizes);
+
+  cache.purgeBinaries(dev, 0);
+  EXPECT_EQ(BinaryCache::getMemoryCacheSize(), 0u);
+  EXPECT_FALSE(
+      cache.loadBinaries(outBlobs, outSizes, dev, key, sizeof(key), options));
+}
+
+// With a zero budget nothing is kept resident and every load reads the disk.
+TEST_P(BinaryCacheTest, MemoryTierDisabledReadsDisk) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+  ScopedMemoryCacheLimit limit(0);
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(700u + i, static_cast<unsigned char>(0xC3 ^ i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  const char key[] = "memory-tier-disabled-key";
+  CompilerOptions options;
+  cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  BinaryCache::flush();
+  EXPECT_EQ(BinaryCache::getMemoryCacheSize(), 0u);
+
+  std::vector<std::vector<unsigned char>> outBlobs;
+  std::vector<size_t> outSizes;
+  ASSERT_TRUE(
+      cache.loadBinaries(outBlobs, outSizes, dev, key, sizeof(key), options));
+  EXPECT_EQ(outBlobs, blobs);
+
+  std::error_code ec;
+  for (const auto& e : fs::directory_iterator(dir.path(), ec))
+    fs::remove(e.path(), ec);
+  EXPECT_FALSE(
+      cache.loadBinaries(outBlobs, outSizes, dev, key, sizeof(key), options));
+}
+
+// The zero-copy load maps the cache file; the views stay valid through the
+// owner even after the entry is dropped from memory and the file removed.
+TEST_P(BinaryCacheTest, MappedLoadKeepsViewsAlive) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].resize(4096u + i * 13u);
+    for (size_t j = 0; j < blobs[i].size(); j++)
+      blobs[i][j] = static_cast<unsigned char>((j * 17u + i) & 0xFF);
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  const char key[] = "mapped-load-key";
+  CompilerOptions options;
+  cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  BinaryCache::flush();
+  BinaryCache::clearMemoryCache();
+
+  BinaryCache::CachedBinaries cached;
+  ASSERT_TRUE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  ASSERT_EQ(cached.binaries.size(), static_cast<size_t>(count));
+  ASSERT_NE(cached.owner, nullptr);
+  BinaryCache::clearMemoryCache();
+#if !defined(_WIN32)
+  std::error_code ec;
+  for (const auto& e : fs::directory_iterator(dir.path(), ec))
+    fs::remove(e.path(), ec);
+#endif
+  for (int i = 0; i < count; i++) {
+    ASSERT_EQ(cached.sizes[i], sizes[i]);
+    EXPECT_EQ(std::vector<unsigned char>(cached.binaries[i],
+                                         cached.binaries[i] + sizes[i]),
+              blobs[i]);
+  }
+}
+
+// Structural checks reject a truncated file even with content hashing off;
+// a flipped blob byte is only caught when verifyContents is on.
+TEST_P(BinaryCacheTest, CorruptFilesAreRejected) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+  ScopedMemoryCacheLimit limit(0);
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(256u + i, static_cast<unsigned char>(0x55 + i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  const char key[] = "corrupt-file-key";
+  CompilerOptions options;
+  cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  BinaryCache::flush();
+  ASSERT_EQ(dir.fileCount(), 1u);
+  fs::path file = fs::directory_iterator(dir.path())->path();
+  auto fileSize = fs::file_size(file);
+
+  // Flip the last blob byte.
+  {
+    FILE* fp = fopen(file.string().c_str(), "r+b");
+    ASSERT_NE(fp, nullptr);
+    fseek(fp, -1, SEEK_END);
+    int c = fgetc(fp);
+    fseek(fp, -1, SEEK_END);
+    fputc(c ^ 0xFF, fp);
+    fclose(fp);
+  }
+  BinaryCache::CachedBinaries cached;
+  EXPECT_FALSE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  cache.verifyContents = false;
+  EXPECT_TRUE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  cached = BinaryCache::CachedBinaries();
+
+  fs::resize_file(file, fileSize - 1);
+  EXPECT_FALSE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  cache.verifyContents = true;
+}
+
+// Every lookup counts as one hit or one miss, and rejected entries are
+// counted by reason. Deltas of the calling thread's counters keep this
+// independent of other tests.
+TEST_P(BinaryCacheTest, StatsCountLookups) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(512u + i, static_cast<unsigned char>(0x31 + i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  const char key[] = "stats-key";
+  CompilerOptions options;
+  BinaryCache::CachedBinaries cached;
+  auto base = BinaryCache::getThreadStats();
+
+  EXPECT_FALSE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  auto stats = BinaryCache::getThreadStats();
+  EXPECT_EQ(stats.misses - base.misses, 1u);
+  EXPECT_EQ(stats.hits - base.hits, 0u);
+
+  auto written = BinaryCache::getStats().bytesWritten;
+  cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  BinaryCache::flush();
+  ASSERT_EQ(dir.fileCount(), 1u);
+  fs::path file = fs::directory_iterator(dir.path())->path();
+  auto fileSize = fs::file_size(file);
+  EXPECT_GE(BinaryCache::getStats().bytesWritten - written, fileSize);
+
+  EXPECT_TRUE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  stats = BinaryCache::getThreadStats();
+  EXPECT_EQ(stats.memoryHits - base.memoryHits, 1u);
+
+  BinaryCache::clearMemoryCache();
+  EXPECT_TRUE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  cached = BinaryCache::CachedBinaries();
+  stats = BinaryCache::getThreadStats();
+  EXPECT_EQ(stats.hits - base.hits, 2u);
+  EXPECT_EQ(stats.bytesRead - base.bytesRead, fileSize);
+
+  // Flip the last blob byte so the content hash fails.
+  {
+    FILE* fp = fopen(file.string().c_str(), "r+b");
+    ASSERT_NE(fp, nullptr);
+    fseek(fp, -1, SEEK_END);
+    int c = fgetc(fp);
+    fseek(fp, -1, SEEK_END);
+    fputc(c ^ 0xFF, fp);
+    fclose(fp);
+  }
+  BinaryCache::clearMemoryCache();
+  EXPECT_FALSE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  stats = BinaryCache::getThreadStats();
+  EXPECT_EQ(stats.corruptEntries - base.corruptEntries, 1u);
+  EXPECT_EQ(stats.misses - base.misses, 2u);
+  EXPECT_EQ(stats.deviceMismatches - base.deviceMismatches, 0u);
+}
+
+// The look after lockEntry belongs to the same lookup as the miss before
+// it: a second miss is not counted, and a hit replaces the first miss.
+TEST_P(BinaryCacheTest, ReloadAfterClaimCountsOneLookup) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(256u + i, static_cast<unsigned char>(0x41 + i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  const char key[] = "reload-key";
+  CompilerOptions options;
+  BinaryCache::CachedBinaries cached;
+  auto base = BinaryCache::getThreadStats();
+
+  EXPECT_FALSE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  EXPECT_FALSE(cache.reloadBinaries(cached, dev, key, sizeof(key), options));
+  auto stats = BinaryCache::getThreadStats();
+  EXPECT_EQ(stats.misses - base.misses, 1u);
+
+  base = BinaryCache::getThreadStats();
+  EXPECT_FALSE(cache.loadBinaries(cached, dev, key, sizeof(key), options));
+  cache.saveBinaries(dev, ptrs, sizes, key, sizeof(key), options);
+  EXPECT_TRUE(cache.reloadBinaries(cached, dev, key, sizeof(key), options));
+  stats = BinaryCache::getThreadStats();
+  EXPECT_EQ(stats.misses - base.misses, 0u);
+  EXPECT_EQ(stats.hits - base.hits, 1u);
+  BinaryCache::flush();
+}
+
+// Saves are published atomically by a background writer: the entry is
+// loadable straight away, and after flush() exactly the final file exists.
+TEST_P(BinaryCacheTest, AsyncSavePublishesAtomically) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(2048u + i, static_cast<unsigned char>(0x11 * (i + 1)));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  CompilerOptions options;
+  const int kEntries = 8;
+  for (int k = 0; k < kEntries; k++) {
+    std::string key = "async-save-" + std::to_string(k);
+    cache.saveBinaries(dev, ptrs, sizes, key.data(), key.size(), options);
+    std::vector<std::vector<unsigned char>> outBlobs;
+    std::vector<size_t> outSizes;
+    EXPECT_TRUE(cache.loadBinaries(outBlobs, outSizes, dev, key.data(),
+                                   key.size(), options));
+  }
+  BinaryCache::flush();
+  EXPECT_EQ(dir.fileCount(), static_cast<size_t>(kEntries));
+  for (const auto& e : fs::directory_iterator(dir.path())) {
+    EXPECT_EQ(e.path().filename().string().find(".tmp-"), std::string::npos)
+        << "staging file left behind: " << e.path();
+  }
+
+  // Every published file must load from disk on its own.
+  BinaryCache::clearMemoryCache();
+  for (int k = 0; k < kEntries; k++) {
+    std::string key = "async-save-" + std::to_string(k);
+    std::vector<std::vector<unsigned char>> outBlobs;
+    std::vector<size_t> outSizes;
+    ASSERT_TRUE(cache.loadBinaries(outBlobs, outSizes, dev, key.data(),
+                                   key.size(), options));
+    EXPECT_EQ(outBlobs, blobs);
+  }
+}
+
+// A claimed entry makes other claimants wait. The claim passes on only once
+// the holder's save is on disk, so the waiter finds the entry without the
+// in-memory tier, and no lock file is left behind.
+TEST_P(BinaryCacheTest, EntryLockMakesWaitersLoad) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+  ScopedMemoryCacheLimit noTier(0);
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(1024u + i, static_cast<unsigned char>(0x21 * (i + 1)));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  CompilerOptions options;
+  const std::string key = "entry-lock";
+
+  auto claim = cache.lockEntry(dev, key.data(), key.size(), options);
+  ASSERT_TRUE(claim);
+
+  BinaryCache impatient = cache;
+  impatient.lockTimeout = 20;
+  EXPECT_FALSE(impatient.lockEntry(dev, key.data(), key.size(), options));
+
+  bool waiterLoaded = false;
+  std::thread waiter([&] {
+    auto next = cache.lockEntry(dev, key.data(), key.size(), options);
+    if (!next) return;
+    std::vector<std::vector<unsigned char>> outBlobs;
+    std::vector<size_t> outSizes;
+    waiterLoaded = cache.loadBinaries(outBlobs, outSizes, dev, key.data(),
+                                      key.size(), options) &&
+                   outBlobs == blobs;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  cache.saveBinaries(dev, ptrs, sizes, key.data(), key.size(), options);
+  claim.release();
+  waiter.join();
+  EXPECT_TRUE(waiterLoaded);
+
+  BinaryCache::flush();
+  EXPECT_EQ(dir.fileCount(), 1u);
+}
+
+// With a byte budget, saves evict the least recently used entries. A disk
+// load counts as a use, so the entry loaded last survives over older saves.
+TEST_P(BinaryCacheTest, BudgetEvictsLeastRecentlyUsed) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+  ScopedMemoryCacheLimit limit(0);
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(1000u, static_cast<unsigned char>(i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  CompilerOptions options;
+  auto save = [&](const std::string& key) {
+    cache.saveBinaries(dev, ptrs, sizes, key.data(), key.size(), options);
+    BinaryCache::flush();
+  };
+  auto load = [&](const std::string& key) {
+    std::vector<std::vector<unsigned char>> outBlobs;
+    std::vector<size_t> outSizes;
+    return cache.loadBinaries(outBlobs, outSizes, dev, key.data(), key.size(),
+                              options);
+  };
+
+  // Measure one entry without a budget, then start over with one that holds
+  // three and a half entries.
+  save("budget-probe");
+  ASSERT_EQ(dir.fileCount(), 1u);
+  uint64_t entryBytes =
+      fs::file_size(fs::directory_iterator(dir.path())->path());
+  cache.purgeBinaries(dev, -1);
+  ASSERT_EQ(dir.fileCount(), 0u);
+  cache.maxCacheBytes = entryBytes * 7 / 2;
+
+  save("budget-a");
+  save("budget-b");
+  save("budget-c");
+  EXPECT_EQ(cache.getCacheSize(), 3 * entryBytes);
+  EXPECT_TRUE(load("budget-a"));
+  save("budget-d");
+
+  EXPECT_EQ(cache.getCacheSize(), 3 * entryBytes);
+  EXPECT_TRUE(load("budget-a"));
+  EXPECT_FALSE(load("budget-b"));
+  EXPECT_TRUE(load("budget-c"));
+  EXPECT_TRUE(load("budget-d"));
+  // Three entries plus the index; no directory listing needed to get here.
+  EXPECT_EQ(dir.fileCount(), 4u);
+
+  // Purging by age works from the index too.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  cache.purgeBinaries(dev, 0);
+  EXPECT_EQ(cache.getCacheSize(), 0u);
+  EXPECT_FALSE(load("budget-a"));
+  cache.maxCacheBytes = 0;
+}
+
+// Hits served by the memory tier count as uses too, so the budget does not
+// evict the hottest entries just because they never reach the disk path.
+TEST_P(BinaryCacheTest, BudgetCountsMemoryHitsAsUses) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+  BinaryCache::clearMemoryCache();
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(1000u, static_cast<unsigned char>(i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  CompilerOptions options;
+  auto save = [&](const std::string& key) {
+    cache.saveBinaries(dev, ptrs, sizes, key.data(), key.size(), options);
+    BinaryCache::flush();
+  };
+  auto load = [&](const std::string& key) {
+    BinaryCache::CachedBinaries cached;
+    return cache.loadBinaries(cached, dev, key.data(), key.size(), options);
+  };
+
+  save("memory-probe");
+  ASSERT_EQ(dir.fileCount(), 1u);
+  uint64_t entryBytes =
+      fs::file_size(fs::directory_iterator(dir.path())->path());
+  cache.purgeBinaries(dev, -1);
+  cache.maxCacheBytes = entryBytes * 7 / 2;
+
+  save("memory-a");
+  save("memory-b");
+  save("memory-c");
+  auto base = BinaryCache::getThreadStats();
+  EXPECT_TRUE(load("memory-a"));
+  EXPECT_EQ(BinaryCache::getThreadStats().memoryHits - base.memoryHits, 1u);
+  save("memory-d");
+
+  BinaryCache::clearMemoryCache();
+  EXPECT_TRUE(load("memory-a"));
+  EXPECT_FALSE(load("memory-b"));
+  cache.maxCacheBytes = 0;
+}
+
+// Setting a budget on a directory populated without one adopts its entries.
+TEST_P(BinaryCacheTest, BudgetAdoptsExistingEntries) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  auto& cache = device().binaryCache();
+  ScopedCachePath guard(cache, dir.path());
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].assign(640u, static_cast<unsigned char>(0xE0 + i));
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  CompilerOptions options;
+  for (int k = 0; k < 3; k++) {
+    std::string key = "adopt-" + std::to_string(k);
+    cache.saveBinaries(dev, ptrs, sizes, key.data(), key.size(), options);
+  }
+  BinaryCache::flush();
+  uint64_t total = 0;
+  for (const auto& e : fs::directory_iterator(dir.path()))
+    total += fs::file_size(e.path());
+
+  cache.maxCacheBytes = total * 2;
+  EXPECT_EQ(cache.getCacheSize(), total);
+  cache.maxCacheBytes = 0;
+}
+
+// Entries packed into an archive load from it alone, and appending then
+// compacting keeps every entry reachable.
+TEST_P(BinaryCacheTest, PackArchiveServesEntries) {
+  auto& dev = *device().impl();
+  int count = dev.getAttribute(kDeviceCount).asInt();
+  if (count < 1 || count > 64) GTEST_SKIP();
+
+  ScopedCacheDir dir(this);
+  ScopedCacheDir packDir(reinterpret_cast<const char*>(this) + 1);
+  auto& cache = device().binaryCache();
+  ScopedMemoryCacheLimit limit(0);
+
+  std::vector<std::vector<unsigned char>> blobs(count);
+  std::vector<unsigned char*> ptrs(count);
+  std::vector<size_t> sizes(count);
+  for (int i = 0; i < count; i++) {
+    blobs[i].resize(777u + i);
+    for (size_t j = 0; j < blobs[i].size(); j++)
+      blobs[i][j] = static_cast<unsigned char>((j * 13u + i) & 0xFF);
+    ptrs[i] = blobs[i].data();
+    sizes[i] = blobs[i].size();
+  }
+  CompilerOptions options;
+  auto key = [](int k) { return "pack-entry-" + std::to_string(k); };
+  auto load = [&](int k) {
+    std::string s = key(k);
+    BinaryCache::CachedBinaries cached;
+    if (!cache.loadBinaries(cached, dev, s.data(), s.size(), options))
+      return false;
+    for (int i = 0; i < count; i++) {
+      if (std::vector<unsigned char>(cached.binaries[i],
+                                     cached.binaries[i] + cached.sizes[i]) !=
+          blobs[i])
+        return false;
+    }
+    return true;
+  };
+  auto save = [&](int k) {
+    ScopedCachePath guard(cache, dir.path());
+    std::string s = key(k);
+    cache.saveBinaries(dev, ptrs, sizes, s.data(), s.size(), options);
+    BinaryCache::flush();
+  };
+
+  fs::create_directories(packDir.path());
+  fs::path pack = packDir.path() / "kernels.pack";
+  save(0);
+  save(1);
+  EXPECT_EQ(BinaryCache::packCache(pack, dir.path()), 2u);
+  EXPECT_EQ(BinaryCache::packCache(pack, dir.path()), 0u);
+  auto packedSize = fs::file_size(pack);
+
+  // A pack alone enables the cache and serves every entry.
+  {
+    ScopedPackPath packGuard(cache, pack);
+    EXPECT_TRUE(cache.isEnabled());
+    EXPECT_TRUE(load(0));
+    EXPECT_TRUE(load(1));
+    EXPECT_FALSE(load(2));
+  }
+
+  save(2);
+  // An entry that cannot be read is skipped and not counted.
+  fs::path unreadable =
+      dir.path() / std::string(GHOST_DIGEST_FILENAME_LENGTH, '0');
+  fclose(fopen(unreadable.string().c_str(), "wb"));
+  EXPECT_EQ(BinaryCache::packCache(pack, dir.path()), 1u);
+  EXPECT_GT(fs::file_size(pack), packedSize);
+
+  // Adding to a pack leaves no dead space: it matches a fresh pack of the
+  // same entries.
+  fs::path fresh = packDir.path() / "fresh.pack";
+  EXPECT_EQ(BinaryCache::packCache(fresh, dir.path()), 3u);
+  EXPECT_EQ(fs::file_size(fresh), fs::file_size(pack));
+
+  std::error_code ec;
+  fs::remove_all(dir.path(), ec);
+  ScopedPackPath packGuard(cache, pack);
+  for (int k = 0; k < 3; k++) EXPECT_TRUE(load(k)) << "entry " << k;
+}
+
 GHOST_INSTANTIATE_BACKEND_TESTS(BinaryCacheTest);
 
+// ---------------------------------------------------------------------------
+// Digest tests
+//
+// Digest picks a hardware block function (SHA-NI, ARMv8 crypto) at run time
+// when the CPU has one. Published vectors and a comparison with the portable
+// block function cover whichever path this machine takes.
+// ---------------------------------------------------------------------------
+
+namespace {
+std::string digestHex(const void* data, size_t len, size_t chunk) {
+  Digest d;
+  auto p = static_cast<const unsigned char*>(data);
+  while (len > 0) {
+    size_t n = std::min(chunk, len);
+    d.update(p, n);
+    p += n;
+    len -= n;
+  }
+  return d.get();
+}
+}  // namespace
+
+TEST(DigestTest, KnownVectors) {
+  EXPECT_EQ(digestHex("", 0, 1),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  EXPECT_EQ(digestHex("abc", 3, 3),
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  const char two[] =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  EXPECT_EQ(digestHex(two, sizeof(two) - 1, 64),
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+  std::string million(1000000, 'a');
+  EXPECT_EQ(digestHex(million.data(), million.size(), million.size()),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+// Any split of the input into updates gives the same digest as the portable
+// code hashing it in one go.
+TEST(DigestTest, MatchesPortableForAnySplit) {
+  std::vector<unsigned char> data(4099);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<unsigned char>(i * 131 + 7);
+
+  sha256 ref;
+  sha256_init_blocks(&ref, sha256_blocks_portable);
+  sha256_append(&ref, data.data(), data.size());
+  char hex[SHA256_HEX_SIZE];
+  sha256_finalize_hex(&ref, hex);
+
+  for (size_t chunk : {size_t(1), size_t(7), size_t(63), size_t(64),
+                       size_t(65), size_t(1000), data.size()}) {
+    EXPECT_EQ(digestHex(data.data(), data.size(), chunk), hex)
+        << "chunk " << chunk;
+  }
+}
+
 // ---------------------------------------------------------------------------
 // End-to-end: compiling with the cache enabled creates files and the second
 // compile produces a working kernel.
@@ -214,6 +936,7 @@ TEST_P(BinaryCacheKernelTest, CompilePopulatesCacheAndReuses) {
     auto fn = lib.lookupFunction("mult_const_f");
     EXPECT_NE(fn.impl().get(), nullptr);
   }
+  BinaryCache::flush();
   if (backend() == Backend::Metal) {
     EXPECT_EQ(dir.fileCount(), 0u) << "Metal should not write a binary cache";
   } else {
@@ -226,6 +949,9 @@ TEST_P(BinaryCacheKernelTest, CompilePopulatesCacheAndReuses) {
   auto lib2 = device().loadLibraryFromText(src);
   auto fn2 = lib2.lookupFunction("mult_const_f");
   ASSERT_NE(fn2.impl().get(), nullptr);
+  if (backend() != Backend::Metal) {
+    EXPECT_TRUE(lib2.loadedFromCache());
+  }
 
   const size_t N = 16;
   std::vector<float> input(N), output(N, 0.0f);
@@ -1,5 +1,12 @@
+#include <ghost/argument_buffer.h>
+
 #include "ghost_test.h"
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace ghost;
 using namespace ghost::test;
 
@@ -367,6 +374,47 @@ TEST_P(BufferTest, HostMemory) {
   device().freeHostMemory(ptr);
 }
 
+TEST_P(BufferTest, HostMemoryPoolRecycles) {
+  if (device().allocator()) GTEST_SKIP() << "allocator installed";
+  device().trimHostMemoryPool();
+  void* a = device().allocateHostMemory(5000);
+  ASSERT_NE(a, nullptr);
+  device().freeHostMemory(a);
+  // Same size class: the parked block comes back.
+  void* b = device().allocateHostMemory(4500);
+  EXPECT_EQ(b, a);
+  void* c = device().allocateHostMemory(4500);
+  EXPECT_NE(c, b);
+  device().freeHostMemory(b);
+  device().freeHostMemory(c);
+  device().trimHostMemoryPool();
+}
+
+TEST_P(BufferTest, HostBytesReturnToPool) {
+  if (device().allocator()) GTEST_SKIP() << "allocator installed";
+  device().trimHostMemoryPool();
+  const size_t N = 256;
+  auto buf = device().allocateBuffer(N * sizeof(float));
+  void* staging = nullptr;
+  {
+    auto bytes = device().allocateHostBytes(N * sizeof(float));
+    staging = bytes.data();
+    auto* f = static_cast<float*>(bytes.data());
+    for (size_t i = 0; i < N; i++) f[i] = static_cast<float>(i) * 0.25f;
+    buf.copy(stream(), std::move(bytes), 0, N * sizeof(float));
+  }
+  std::vector<float> out(N, 0.0f);
+  buf.copyTo(stream(), out.data(), N * sizeof(float));
+  stream().sync();
+  for (size_t i = 0; i < N; i++) {
+    EXPECT_FLOAT_EQ(out[i], static_cast<float>(i) * 0.25f) << "index " << i;
+  }
+  // The transfer has completed, so the block is back in the pool.
+  void* again = device().allocateHostMemory(N * sizeof(float));
+  EXPECT_EQ(again, staging);
+  device().freeHostMemory(again);
+}
+
 // ---------------------------------------------------------------------------
 // Zero-length buffer
 // ---------------------------------------------------------------------------
@@ -596,4 +644,288 @@ TEST_P(BufferTest, ConcurrentSubBufferWrites) {
   }
 }
 
+// ---------------------------------------------------------------------------
+// Transient arena
+// ---------------------------------------------------------------------------
+
+TEST_P(BufferTest, TransientArena) {
+  device().setTransientArenaSize(64 * 1024);
+  EXPECT_EQ(device().getTransientArenaSize(), 64 * 1024u);
+
+  const size_t N = 1000;
+  auto runFrame = [&](std::vector<Buffer>& bufs, uint32_t seed) {
+    bufs.clear();
+    // More than one block's worth, so the arena has to grow.
+    for (uint32_t b = 0; b < 24; b++) {
+      bufs.push_back(
+          device().allocateBuffer(N * sizeof(uint32_t), AllocHint::Transient));
+      EXPECT_EQ(bufs.back().size(), N * sizeof(uint32_t));
+      std::vector<uint32_t> data(N, seed + b);
+      bufs.back().copy(stream(), data.data(), N * sizeof(uint32_t));
+    }
+    // Buffers from the same frame must not alias.
+    for (uint32_t b = 0; b < bufs.size(); b++) {
+      std::vector<uint32_t> out(N, 0);
+      bufs[b].copyTo(stream(), out.data(), N * sizeof(uint32_t));
+      stream().sync();
+      EXPECT_EQ(out.front(), seed + b) << "buffer " << b;
+      EXPECT_EQ(out.back(), seed + b) << "buffer " << b;
+    }
+  };
+
+  std::vector<Buffer> frame1, frame2;
+  runFrame(frame1, 100);
+  stream().sync();
+  device().resetTransientArena();
+  runFrame(frame2, 200);
+
+  if (backend() == Backend::CPU) {
+    // The second frame reuses the first frame's memory, in order.
+    for (size_t b = 0; b < frame1.size(); b++) {
+      EXPECT_EQ(
+          static_cast<implementation::BufferCPU*>(frame1[b].impl().get())->ptr,
+          static_cast<implementation::BufferCPU*>(frame2[b].impl().get())->ptr);
+    }
+    // Arena blocks are read-write, so other access modes bypass it.
+    using implementation::SubBufferCPU;
+    auto readOnly = device().allocateBuffer(
+        N * sizeof(uint32_t),
+        BufferOptions(Access::ReadOnly, AllocHint::Transient));
+    EXPECT_EQ(dynamic_cast<SubBufferCPU*>(readOnly.impl().get()), nullptr);
+    EXPECT_NE(dynamic_cast<SubBufferCPU*>(frame2[0].impl().get()), nullptr);
+  }
+
+  device().setTransientArenaSize(0);
+  EXPECT_EQ(device().getTransientArenaSize(), 0u);
+  auto plain = device().allocateBuffer(256, AllocHint::Transient);
+  EXPECT_EQ(plain.size(), 256u);
+}
+
+// ---------------------------------------------------------------------------
+// Argument buffer uploads
+// ---------------------------------------------------------------------------
+
+TEST_P(BufferTest, ArgumentBufferDirtyUpload) {
+  ArgumentBuffer ab;
+  ab.set(0, 1u);
+  ab.set(4, 2u);
+  ab.set(8, 3u);
+  ab.upload(device(), stream());
+  Buffer gpu(ab.bufferImpl());
+
+  // Scribble over the device copy; only bytes written since the upload
+  // should be replaced.
+  std::vector<uint8_t> junk(12, 0xFF);
+  gpu.copy(stream(), junk.data(), junk.size());
+  ab.set(4, 20u);
+  ab.upload(device(), stream());
+  EXPECT_EQ(ab.bufferImpl(), gpu.impl());
+  uint32_t out[4] = {};
+  gpu.copyTo(stream(), out, 12);
+  stream().sync();
+  EXPECT_EQ(out[0], 0xFFFFFFFFu);
+  EXPECT_EQ(out[1], 20u);
+  EXPECT_EQ(out[2], 0xFFFFFFFFu);
+
+  // Growing reallocates and copies everything.
+  ab.set(12, 4u);
+  ab.upload(device(), stream());
+  Buffer(ab.bufferImpl()).copyTo(stream(), out, 16);
+  stream().sync();
+  EXPECT_EQ(out[0], 1u);
+  EXPECT_EQ(out[1], 20u);
+  EXPECT_EQ(out[2], 3u);
+  EXPECT_EQ(out[3], 4u);
+}
+
+TEST_P(BufferTest, ArgumentRingSlices) {
+  ArgumentRing ring(device(), 4096);
+  Stream s = stream();
+  ArgumentBuffer ab;
+  ab.set(0, 7u);
+  ab.upload(ring, s);
+  auto first = ab.bufferImpl();
+  ASSERT_TRUE(first);
+
+  // Unchanged data keeps its slice until the next fence.
+  ab.upload(ring, s);
+  EXPECT_EQ(ab.bufferImpl(), first);
+
+  // A change goes to a new slice; the old one keeps its contents.
+  ab.set(0, 8u);
+  ab.upload(ring, s);
+  EXPECT_NE(ab.bufferImpl(), first);
+  uint32_t oldValue = 0, newValue = 0;
+  Buffer(first).copyTo(s, &oldValue, sizeof(oldValue));
+  Buffer(ab.bufferImpl()).copyTo(s, &newValue, sizeof(newValue));
+  s.sync();
+  EXPECT_EQ(oldValue, 7u);
+  EXPECT_EQ(newValue, 8u);
+
+  auto second = ab.bufferImpl();
+  ring.fence(s);
+  ab.upload(ring, s);
+  EXPECT_NE(ab.bufferImpl(), second);
+}
+
+TEST_P(BufferTest, ArgumentRingReclaimsFencedSpace) {
+  Stream s = stream();
+  ArgumentRing fenced(device(), 4096);
+  for (int frame = 0; frame < 100; frame++) {
+    fenced.allocate(256);
+    s.sync();
+    fenced.fence(s);
+  }
+  // Every fence has completed by the next allocation, so the ring wraps
+  // instead of growing.
+  s.sync();
+  fenced.allocate(256);
+  EXPECT_EQ(fenced.capacity(), 4096u);
+
+  ArgumentRing unfenced(device(), 4096);
+  std::vector<Buffer> live;
+  for (int i = 0; i < 100; i++) {
+    live.push_back(unfenced.allocate(256));
+    EXPECT_EQ(live.back().size(), 256u);
+  }
+  EXPECT_GT(unfenced.capacity(), 4096u);
+
+  // Live slices never alias.
+  for (uint32_t i = 0; i < live.size(); i++) {
+    live[i].copy(s, &i, sizeof(i));
+  }
+  for (uint32_t i = 0; i < live.size(); i++) {
+    uint32_t value = 0;
+    live[i].copyTo(s, &value, sizeof(value));
+    s.sync();
+    EXPECT_EQ(value, i);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// File streaming
+// ---------------------------------------------------------------------------
+
+TEST_P(BufferTest, FileRoundTrip) {
+  // Larger than the staging ring (3 x 4 MiB) and not a multiple of the chunk
+  // size, so the pipeline wraps and ends on a partial chunk.
+  const size_t N = (13 << 20) / sizeof(uint32_t) + 7;
+  const size_t bytes = N * sizeof(uint32_t);
+  std::vector<uint32_t> input(N), output(N, 0);
+  for (size_t i = 0; i < N; i++) {
+    input[i] = static_cast<uint32_t>(i * 2654435761u);
+  }
+
+  auto path = std::filesystem::temp_directory_path() /
+              ("ghost_buffer_file_" +
+               std::to_string(reinterpret_cast<uintptr_t>(this)));
+  auto src = device().allocateBuffer(bytes);
+  auto dst = device().allocateBuffer(bytes);
+  src.copy(stream(), input.data(), bytes);
+  src.writeToFile(stream(), path, 0, bytes);
+  EXPECT_EQ(std::filesystem::file_size(path), bytes);
+
+  dst.readFromFile(stream(), path, 0, bytes);
+  dst.copyTo(stream(), output.data(), bytes);
+  stream().sync();
+  EXPECT_TRUE(output == input);
+
+  // Offsets on both sides: file words [4, 20) into buffer words [100, 116).
+  std::fill(output.begin(), output.end(), 0);
+  dst.fill(stream(), 0, bytes, uint8_t(0));
+  dst.readFromFile(stream(), path, 100 * sizeof(uint32_t),
+                   16 * sizeof(uint32_t), 4 * sizeof(uint32_t));
+  dst.copyTo(stream(), output.data(), 128 * sizeof(uint32_t));
+  stream().sync();
+  for (size_t i = 0; i < 128; i++) {
+    uint32_t expected = (i >= 100 && i < 116) ? input[i - 96] : 0;
+    EXPECT_EQ(output[i], expected) << "index " << i;
+  }
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+}
+
+TEST_P(BufferTest, ReadFromShortFileThrows) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("ghost_buffer_short_" +
+               std::to_string(reinterpret_cast<uintptr_t>(this)));
+  auto buf = device().allocateBuffer(1024);
+  buf.writeToFile(stream(), path, 0, 512);
+  EXPECT_THROW(buf.readFromFile(stream(), path, 0, 1024), std::runtime_error);
+  EXPECT_THROW(buf.readFromFile(stream(), path.string() + ".missing", 0, 16),
+               std::runtime_error);
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+}
+
 GHOST_INSTANTIATE_BACKEND_TESTS(BufferTest);
+
+// ===========================================================================
+// CPU shared-memory buffers — exported and imported through a native handle.
+// ===========================================================================
+
+class CPUSharedMemoryBufferTest : public ::testing::Test {
+ protected:
+  DeviceCPU& device() { return device_; }
+
+  Stream stream() { return device_.defaultStream(); }
+
+  DeviceCPU device_;
+};
+
+TEST_F(CPUSharedMemoryBufferTest, ImportAliasesExport) {
+  const size_t N = 64;
+  auto buf = device().allocateSharedMemoryBuffer(N * sizeof(uint32_t));
+  EXPECT_EQ(buf.size(), N * sizeof(uint32_t));
+
+  auto imported = device().importSharedMemoryBuffer(
+      device().exportSharedMemoryBuffer(buf), N * sizeof(uint32_t));
+
+  std::vector<uint32_t> input(N), output(N, 0);
+  for (size_t i = 0; i < N; i++) input[i] = static_cast<uint32_t>(i * 3);
+  buf.copy(stream(), input.data(), N * sizeof(uint32_t));
+  imported.copyTo(stream(), output.data(), N * sizeof(uint32_t));
+  EXPECT_EQ(output, input);
+
+  // The import maps the same pages; it must not be a snapshot.
+  imported.fill(stream(), 0, N * sizeof(uint32_t), uint8_t(0x5A));
+  std::vector<uint8_t> bytes(N * sizeof(uint32_t), 0);
+  buf.copyTo(stream(), bytes.data(), bytes.size());
+  for (size_t i = 0; i < bytes.size(); i++) {
+    EXPECT_EQ(bytes[i], 0x5A) << "index " << i;
+  }
+}
+
+TEST_F(CPUSharedMemoryBufferTest, ExportRejectsHeapBuffer) {
+  auto buf = device().allocateBuffer(256);
+  EXPECT_THROW(device().exportSharedMemoryBuffer(buf), std::invalid_argument);
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+TEST_F(CPUSharedMemoryBufferTest, VisibleAcrossFork) {
+  const size_t N = 256;
+  auto buf = device().allocateSharedMemoryBuffer(N);
+  int fd = device().exportSharedMemoryBuffer(buf);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // Child: map the inherited descriptor and write a pattern into it.
+    DeviceCPU child;
+    auto mine = child.importSharedMemoryBuffer(fd, N);
+    mine.fill(child.defaultStream(), 0, N, uint8_t(0xC3));
+    _exit(0);
+  }
+  ::close(fd);
+  int status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+
+  std::vector<uint8_t> bytes(N, 0);
+  buf.copyTo(stream(), bytes.data(), N);
+  for (size_t i = 0; i < N; i++) {
+    EXPECT_EQ(bytes[i], 0xC3) << "index " << i;
+  }
+}
+#endif
@@ -1,5 +1,8 @@
 #include <ghost/cpu/impl_device.h>
 
+#include <atomic>
+#include <thread>
+
 #include "ghost_test.h"
 
 using namespace ghost;
@@ -30,6 +33,14 @@ static void cpu_add_buffers(size_t i, size_t n,
   out[i] = A[i] + B[i];
 }
 
+static std::atomic<int64_t> g_dispatchSum{0};
+
+// Adds the scalar argument once per dispatch.
+static void cpu_accumulate(size_t i, size_t n,
+                           const std::vector<Attribute>& args) {
+  if (i == 0) g_dispatchSum += args[1].asInt();
+}
+
 // ---------------------------------------------------------------------------
 // Inline kernel test fixture
 // ---------------------------------------------------------------------------
@@ -102,12 +113,86 @@ TEST_P(CPUInlineKernelTest, InlineAddBuffers) {
   }
 }
 
+TEST_P(CPUInlineKernelTest, BoundDispatchReuse) {
+  auto lib =
+      cpuDevice().loadLibraryFromFunctions({{"accumulate", cpu_accumulate}});
+  auto fn = lib.lookupFunction("accumulate");
+  auto buf = device().allocateBuffer(16);
+  Stream s = stream();
+  g_dispatchSum = 0;
+
+  LaunchArgs la;
+  la.global_size(4).local_size(1);
+  Dispatch d = fn.bind(la, buf, int32_t(2));
+  ASSERT_TRUE(d.valid());
+  EXPECT_EQ(d.size(), 2u);
+  d.enqueue(s);
+  s.sync();
+  EXPECT_EQ(g_dispatchSum.load(), 2);
+
+  // Arguments and launch configuration update in place.
+  d.set(1, int32_t(5));
+  EXPECT_EQ(d.arg(1).asInt(), 5);
+  d.launchArgs(LaunchArgs().global_size(2).local_size(1));
+  d.enqueue(s);
+  s.sync();
+  EXPECT_EQ(g_dispatchSum.load(), 7);
+
+  EXPECT_THROW(d.set(1, 1.0f), std::invalid_argument);
+  EXPECT_THROW(d.set(2, int32_t(1)), std::out_of_range);
+
+  d.writes(1);
+  EXPECT_EQ(d.arg(0).access(), Access::WriteOnly);
+  d.set(0, buf);
+  EXPECT_EQ(d.arg(0).access(), Access::WriteOnly);
+  EXPECT_FALSE(Dispatch().valid());
+}
+
 TEST_P(CPUInlineKernelTest, InlineLookupMissing) {
   auto lib = cpuDevice().loadLibraryFromFunctions(
       {{"mult_const_f", cpu_mult_const_f}});
   EXPECT_THROW(lib.lookupFunction("nonexistent"), std::exception);
 }
 
+TEST_P(CPUInlineKernelTest, LookupIsMemoized) {
+  auto lib = cpuDevice().loadLibraryFromFunctions(
+      {{"mult_const_f", cpu_mult_const_f}, {"add_buffers", cpu_add_buffers}});
+  auto fn = lib.lookupFunction("mult_const_f");
+  EXPECT_EQ(lib.lookupFunction("mult_const_f").impl(), fn.impl());
+  const FunctionName name("mult_const_f");
+  EXPECT_EQ(name, FunctionName(std::string("mult_const_f")));
+  EXPECT_EQ(name.str(), "mult_const_f");
+  EXPECT_EQ(lib.lookupFunction(name).impl(), fn.impl());
+  EXPECT_NE(lib.lookupFunction("add_buffers").impl(), fn.impl());
+
+  // A failed lookup is not cached.
+  EXPECT_THROW(lib.lookupFunction("nonexistent"), std::exception);
+  EXPECT_THROW(lib.lookupFunction("nonexistent"), std::exception);
+  EXPECT_THROW(lib.lookupFunction(FunctionName("nonexistent")),
+               std::exception);
+
+  // Concurrent first lookups share one function.
+  auto fresh = cpuDevice().loadLibraryFromFunctions(
+      {{"add_buffers", cpu_add_buffers}});
+  std::vector<std::shared_ptr<implementation::Function>> found(4);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < found.size(); i++) {
+    threads.emplace_back(
+        [&, i] { found[i] = fresh.lookupFunction("add_buffers").impl(); });
+  }
+  for (auto& t : threads) t.join();
+  for (auto& impl : found) EXPECT_EQ(impl, found[0]);
+
+  // Changing the write default only affects later lookups.
+  lib.setWriteDefault(WriteDefault::FirstWritten);
+  auto stamped = lib.lookupFunction(name);
+  EXPECT_NE(stamped.impl(), fn.impl());
+  EXPECT_EQ(stamped.impl()->writeDefault, WriteDefault::FirstWritten);
+  EXPECT_EQ(fn.impl()->writeDefault, WriteDefault::Conservative);
+  EXPECT_EQ(lib.lookupFunction(name).impl(), stamped.impl());
+  EXPECT_EQ(lib.lookupFunction("mult_const_f").impl(), stamped.impl());
+}
+
 TEST_P(CPUInlineKernelTest, InlineMultipleDispatches) {
   auto lib = cpuDevice().loadLibraryFromFunctions(
       {{"mult_const_f", cpu_mult_const_f}});
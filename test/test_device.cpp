@@ -215,6 +215,35 @@ TEST_P(DeviceTest, MultipleDevicesSameBackend) {
   EXPECT_EQ(buf2.size(), 256u);
 }
 
+// A failed precompile surfaces through its future, duplicate entries share
+// one build, and the matching load call rethrows the parked error.
+TEST_P(DeviceTest, PrecompileReportsErrorsThroughFutures) {
+  PrecompileEntry entry;
+  entry.source = "this is not valid GPU code!!!";
+  auto futures = device().precompile({entry, entry}, 2);
+  ASSERT_EQ(futures.size(), 2u);
+  EXPECT_ANY_THROW(futures[0].get());
+  EXPECT_ANY_THROW(futures[1].get());
+  EXPECT_ANY_THROW(device().loadLibraryFromText(entry.source));
+}
+
+// Destroying a device waits for its precompile workers; every future still
+// resolves, with queued builds failing.
+TEST_P(DeviceTest, PrecompileOutlivedByFutures) {
+  std::vector<std::shared_future<Library>> futures;
+  {
+    auto dev = createDevice(backend());
+    ASSERT_NE(dev.get(), nullptr);
+    std::vector<PrecompileEntry> manifest(16);
+    for (size_t i = 0; i < manifest.size(); i++) {
+      manifest[i].source = "not valid GPU code " + std::to_string(i);
+    }
+    futures = dev->precompile(manifest, 1);
+  }
+  ASSERT_EQ(futures.size(), 16u);
+  for (auto& f : futures) EXPECT_ANY_THROW(f.get());
+}
+
 GHOST_INSTANTIATE_BACKEND_TESTS(DeviceTest);
 
 // ---------------------------------------------------------------------------
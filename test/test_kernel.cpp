@@ -1,13 +1,31 @@
 #include <ghost/argument_buffer.h>
 #include <ghost/kernel_source.h>
 
+#include <cstdlib>
 #include <filesystem>
+#include <new>
+#include <thread>
 
 #include "ghost_test.h"
 
 using namespace ghost;
 using namespace ghost::test;
 
+namespace {
+// Allocations made by the calling thread, for tests of allocation-free paths.
+thread_local size_t threadAllocations = 0;
+}  // namespace
+
+void* operator new(size_t size) {
+  threadAllocations++;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
 class KernelTest : public GhostKernelTest {};
 
 // ---------------------------------------------------------------------------
@@ -65,6 +83,46 @@ TEST_P(KernelTest, LookupMissingFunctionThrows) {
   EXPECT_THROW(lib.lookupFunction("nonexistent_kernel_xyz"), std::exception);
 }
 
+// Programs warmed up by precompile are handed, once, to the matching
+// loadLibraryFromText call and run correctly.
+TEST_P(KernelTest, PrecompileParksLibraries) {
+  const char* src = multConstSource();
+  const char* src2 = addBuffersSource();
+  if (!src || !src2) GTEST_SKIP();
+
+  PrecompileEntry a, b;
+  a.source = src;
+  a.functions = {"mult_const_f"};
+  b.source = src2;
+  auto futures = device().precompile({a, b});
+  ASSERT_EQ(futures.size(), 2u);
+  for (auto& f : futures) EXPECT_NO_THROW(f.get());
+
+  // Libraries cache their lookups, so the same function object means the
+  // same library. A parked library is handed out once; the next load builds
+  // its own.
+  Library lib = device().loadLibraryFromText(src);
+  Function fn = lib.lookupFunction("mult_const_f");
+  EXPECT_EQ(fn.impl(),
+            futures[0].get().lookupFunction("mult_const_f").impl());
+  Library again = device().loadLibraryFromText(src);
+  EXPECT_NE(again.lookupFunction("mult_const_f").impl(), fn.impl());
+
+  const size_t N = 16;
+  std::vector<float> input(N), output(N, 0.0f);
+  for (size_t i = 0; i < N; i++) input[i] = static_cast<float>(i);
+  auto inBuf = device().allocateBuffer(N * sizeof(float));
+  auto outBuf = device().allocateBuffer(N * sizeof(float));
+  inBuf.copy(stream(), input.data(), N * sizeof(float));
+  LaunchArgs la;
+  la.global_size(static_cast<uint32_t>(N)).local_size(1);
+  fn(la, stream())(outBuf, inBuf, 2.0f);
+  outBuf.copyTo(stream(), output.data(), N * sizeof(float));
+  stream().sync();
+  for (size_t i = 0; i < N; i++)
+    EXPECT_FLOAT_EQ(output[i], static_cast<float>(i) * 2.0f) << "index " << i;
+}
+
 TEST_P(KernelTest, InvalidSourceThrows) {
   EXPECT_THROW(device().loadLibraryFromText("this is not valid GPU code!!!"),
                std::exception);
@@ -249,6 +307,51 @@ TEST_P(KernelTest, MultipleDispatches) {
   }
 }
 
+// Dispatch one Function from several threads at once, each with its own
+// scale, and repeat launches with only the scalar changing.
+TEST_P(KernelTest, ConcurrentDispatchSameFunction) {
+  const char* src = multConstSource();
+  if (!src) GTEST_SKIP();
+
+  const size_t N = 256;
+  const int kThreads = 4;
+  const int kLaunches = 50;
+  std::vector<float> input(N);
+  for (size_t i = 0; i < N; i++) input[i] = static_cast<float>(i);
+
+  auto lib = device().loadLibraryFromText(src);
+  auto fn = lib.lookupFunction("mult_const_f");
+  auto inBuf = device().allocateBuffer(N * sizeof(float));
+  inBuf.copy(stream(), input.data(), N * sizeof(float));
+  stream().sync();
+
+  std::vector<std::vector<float>> outputs(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      auto s = device().createStream();
+      auto outBuf = device().allocateBuffer(N * sizeof(float));
+      LaunchArgs la;
+      la.global_size(static_cast<uint32_t>(N)).local_size(64);
+      for (int k = 0; k < kLaunches; k++) {
+        fn(la, s)(outBuf, inBuf, static_cast<float>(t + k));
+      }
+      outputs[t].resize(N);
+      outBuf.copyTo(s, outputs[t].data(), N * sizeof(float));
+      s.sync();
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  for (int t = 0; t < kThreads; t++) {
+    const float scale = static_cast<float>(t + kLaunches - 1);
+    for (size_t i = 0; i < N; i++) {
+      ASSERT_FLOAT_EQ(outputs[t][i], static_cast<float>(i) * scale)
+          << "thread " << t << " index " << i;
+    }
+  }
+}
+
 // ---------------------------------------------------------------------------
 // Function attributes
 // ---------------------------------------------------------------------------
@@ -813,6 +916,147 @@ TEST_P(KernelTest, KernelSourceDefines) {
   }
 }
 
+// Concurrent requests: each variant compiles once, and threads asking for the
+// same variant share its Function.
+TEST_P(KernelTest, KernelSourceConcurrentVariants) {
+  const char* src = setGlobalsKernelSource(backend());
+  if (!src) GTEST_SKIP() << "KernelSource test needs OpenCL source";
+
+  KernelSource ks(src);
+  const int kVariants = 3;
+  const int kThreadsPerVariant = 4;
+  std::vector<std::shared_ptr<implementation::Function>> impls(
+      kVariants * kThreadsPerVariant);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kVariants * kThreadsPerVariant; i++) {
+    threads.emplace_back([&, i] {
+      float scale = static_cast<float>(i % kVariants + 1);
+      impls[i] = ks.getFunction(device(), "scaled_fn",
+                                {{"SCALE_FACTOR", Attribute(scale)}})
+                     .impl();
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  for (int i = 0; i < kVariants * kThreadsPerVariant; i++) {
+    ASSERT_TRUE(impls[i]) << "thread " << i;
+    EXPECT_EQ(impls[i].get(), impls[i % kVariants].get()) << "thread " << i;
+  }
+  EXPECT_NE(impls[0].get(), impls[1].get());
+  EXPECT_NE(impls[1].get(), impls[2].get());
+}
+
+// One KernelSource serving two devices keeps a separate variant per device.
+TEST_P(KernelTest, KernelSourcePerDevice) {
+  const char* src = setGlobalsKernelSource(backend());
+  if (!src) GTEST_SKIP() << "KernelSource test needs OpenCL source";
+
+  auto other = createDevice(backend());
+  ASSERT_NE(other.get(), nullptr);
+
+  KernelSource ks(src);
+  const std::vector<std::pair<std::string, Attribute>> constants = {
+      {"SCALE_FACTOR", Attribute(2.0f)}};
+  auto fn1 = ks.getFunction(device(), "scaled_fn", constants);
+  auto fn2 = ks.getFunction(*other, "scaled_fn", constants);
+  EXPECT_NE(fn1.impl().get(), fn2.impl().get());
+
+  // Each device still gets its own cached variant back.
+  EXPECT_EQ(ks.getFunction(device(), "scaled_fn", constants).impl().get(),
+            fn1.impl().get());
+  EXPECT_EQ(ks.getFunction(*other, "scaled_fn", constants).impl().get(),
+            fn2.impl().get());
+}
+
+// A resolved Variant handle shares the cache with the name-based lookup and
+// is rejected by other sources and devices.
+TEST_P(KernelTest, KernelSourceVariantHandle) {
+  const char* src = setGlobalsKernelSource(backend());
+  if (!src) GTEST_SKIP() << "KernelSource test needs OpenCL source";
+
+  KernelSource ks(src);
+  const std::vector<std::pair<std::string, Attribute>> constants = {
+      {"SCALE_FACTOR", Attribute(4.0f)}};
+  KernelSource::Variant v = ks.variant(device(), "scaled_fn", constants);
+  ASSERT_TRUE(v.valid());
+  EXPECT_FALSE(KernelSource::Variant().valid());
+
+  auto fromHandle = ks.getFunction(device(), v);
+  auto byName = ks.getFunction(device(), "scaled_fn", constants);
+  EXPECT_EQ(fromHandle.impl().get(), byName.impl().get());
+  EXPECT_EQ(ks.getFunction(device(), v).impl().get(), byName.impl().get());
+
+  KernelSource otherSource(src);
+  EXPECT_THROW(otherSource.getFunction(device(), v), std::invalid_argument);
+  auto other = createDevice(backend());
+  ASSERT_NE(other.get(), nullptr);
+  EXPECT_THROW(ks.getFunction(*other, v), std::invalid_argument);
+}
+
+// A cache hit through a Variant handle does not allocate.
+TEST_P(KernelTest, KernelSourceVariantHitDoesNotAllocate) {
+  const char* src = setGlobalsKernelSource(backend());
+  if (!src) GTEST_SKIP() << "KernelSource test needs OpenCL source";
+
+  KernelSource ks(src);
+  KernelSource::Variant v = ks.variant(device(), "scaled_fn",
+                                       {{"SCALE_FACTOR", Attribute(5.0f)}});
+  Function built = ks.getFunction(device(), v);
+
+  size_t before = threadAllocations;
+  Function hit = ks.getFunction(device(), v);
+  EXPECT_EQ(threadAllocations, before);
+  EXPECT_EQ(hit.impl().get(), built.impl().get());
+}
+
+// A count limit evicts the least recently used variant; an evicted variant
+// is rebuilt on demand.
+TEST_P(KernelTest, KernelSourceCacheLimit) {
+  const char* src = setGlobalsKernelSource(backend());
+  if (!src) GTEST_SKIP() << "KernelSource test needs OpenCL source";
+
+  KernelSource ks(src);
+  KernelSource::CacheLimits limits;
+  limits.maxVariants = 2;
+  ks.setCacheLimits(limits);
+  EXPECT_EQ(ks.cacheLimits().maxVariants, 2u);
+
+  auto scaled = [&](float scale) {
+    return ks.getFunction(device(), "scaled_fn",
+                          {{"SCALE_FACTOR", Attribute(scale)}});
+  };
+  auto fn1 = scaled(1.0f);
+  auto fn2 = scaled(2.0f);
+  scaled(1.0f);  // 2.0 is now least recently used.
+  scaled(3.0f);
+  EXPECT_EQ(ks.cachedVariants(), 2u);
+  EXPECT_EQ(scaled(1.0f).impl().get(), fn1.impl().get());
+
+  // The evicted variant compiles again and still runs.
+  auto again = scaled(2.0f);
+  EXPECT_NE(again.impl().get(), fn2.impl().get());
+  EXPECT_EQ(ks.cachedVariants(), 2u);
+
+  const size_t N = 64;
+  const uint32_t localSize = 64;
+  const size_t safeN = N * localSize;
+  std::vector<float> input(safeN, 1.0f), output(safeN, 0.0f);
+  auto inBuf = device().allocateBuffer(safeN * sizeof(float));
+  auto outBuf = device().allocateBuffer(safeN * sizeof(float));
+  inBuf.copy(stream(), input.data(), safeN * sizeof(float));
+  LaunchArgs la;
+  la.global_size(static_cast<uint32_t>(N)).local_size(localSize);
+  again(la, stream())(outBuf, inBuf, static_cast<uint32_t>(N));
+  outBuf.copyTo(stream(), output.data(), safeN * sizeof(float));
+  stream().sync();
+  EXPECT_FLOAT_EQ(output[0], 2.0f);
+
+  limits.maxVariants = 1;
+  ks.setCacheLimits(limits);
+  EXPECT_EQ(ks.cachedVariants(), 1u);
+  EXPECT_EQ(scaled(2.0f).impl().get(), again.impl().get());
+}
+
 // KernelSource with named specialization (Metal function constants).
 TEST_P(KernelTest, KernelSourceSpecialization) {
   if (backend() != Backend::Metal) {